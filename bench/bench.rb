@@ -0,0 +1,195 @@
+# Benchmarks of poll dispatch, accessors and allocations per event.
+# Needs the extension built against the simulated wiiuse, see "rake bench".
+#
+#   ruby -I<build dir> bench/bench.rb [results.json]
+#
+# BENCH_TIME		seconds spent on every poll benchmark (default 1)
+# BENCH_CALLS		calls made on every accessor benchmark (default 200000)
+# BENCH_WIIMOTES	controller counts, comma separated (default 1,4,16)
+# BENCH_AUDIO		seconds of audio converted by every encode benchmark (default 10)
+
+require 'json'
+require 'rbconfig'
+require 'wii4r'
+
+include Wii
+
+abort "wii4r is not built against the simulated wiiuse, run: rake bench" unless MOCK
+
+TIME = (ENV["BENCH_TIME"] || 1).to_f
+CALLS = (ENV["BENCH_CALLS"] || 200_000).to_i
+WIIMOTES = (ENV["BENCH_WIIMOTES"] || "1,4,16").split(",").map(&:to_i)
+AUDIO = (ENV["BENCH_AUDIO"] || 10).to_f
+
+def now
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def allocated
+  GC.stat(:total_allocated_objects)
+end
+
+# manager with "n" simulated wiimotes reporting at every poll, motion sensing and ir enabled
+def manager(n)
+  ENV["WII4R_MOCK_WIIMOTES"] = n.to_s
+  ENV["WII4R_MOCK_RATE"] = "0"
+  wm = WiimoteManager.new(capacity: n)
+  wm.connect
+  wm.each_wiimote { |w|
+    w.motion_sensing = true
+    w.ir = true
+  }
+  wm
+end
+
+# runs the block for TIME seconds, the block returns the number of events it handled
+def throughput
+  events = 0
+  GC.start
+  objs = allocated
+  start = now
+  events += yield while now - start < TIME
+  elapsed = now - start
+  objs = allocated - objs
+  { "events" => events, "events_per_sec" => (events / elapsed).round, "allocations_per_event" => (objs.to_f / events).round(3) }
+end
+
+# calls the block CALLS times
+def per_call
+  GC.start
+  objs = allocated
+  start = now
+  i = 0
+  while i < CALLS
+    yield
+    i += 1
+  end
+  elapsed = now - start
+  { "ns_per_call" => (elapsed * 1e9 / CALLS).round(1), "allocations_per_call" => (allocated - objs).to_f / CALLS }
+end
+
+results = []
+record = lambda { |n, name, values|
+  results << { "wiimotes" => n, "benchmark" => name }.merge(values)
+  puts format("%3d  %-24s %s", n, name, values.map { |k, v| "#{k}=#{v}" }.join(" "))
+}
+
+WIIMOTES.each { |n|
+  wm = manager(n)
+  w = wm.wiimotes.first
+  buf = []
+
+  record.call(n, "poll", throughput {
+    events = 0
+    wm.poll { |(wiimote, event)| events += 1 }
+    events
+  })
+  record.call(n, "drain", throughput {
+    wm.drain.bytesize / WiimoteManager::EVENT_SIZE
+  })
+  record.call(n, "poll+pressed?", throughput {
+    events = 0
+    wm.poll { |(wiimote, event)|
+      wiimote.pressed?(BUTTON_A)
+      events += 1
+    }
+    events
+  })
+  # events counted whether they are yielded or skipped by the subscription
+  sub = wm.subscribe(slot: 0, buttons: BUTTON_A | BUTTON_B)
+  record.call(n, "poll(subscribe)", throughput {
+    skipped = wm.filtered_events
+    yielded = 0
+    wm.poll { |(wiimote, event)| yielded += 1 }
+    yielded + wm.filtered_events - skipped
+  })
+  wm.unsubscribe(sub)
+  # 16 gestures matched on every wiimote
+  gestures = GestureSet.new
+  16.times { |i| gestures.add(:"g#{i}", Array.new(40) { |j| [Math.sin(i + j * 0.1), Math.cos(i * j * 0.1), 1.0] }) }
+  wm.each_wiimote { |wiimote| wiimote.gestures = gestures }
+  record.call(n, "poll+gestures", throughput {
+    events = 0
+    wm.poll { |(wiimote, event)| events += 1 }
+    events
+  })
+  wm.each_wiimote { |wiimote| wiimote.gestures = nil }
+  wm.each_wiimote { |wiimote| wiimote.orientation_filter = 0.1 }
+  record.call(n, "poll+orientation", throughput {
+    events = 0
+    wm.poll { |(wiimote, event)| events += 1 }
+    events
+  })
+  wm.each_wiimote { |wiimote| wiimote.orientation_filter = nil }
+  # the history is kept for window_stats below
+  wm.each_wiimote { |wiimote| wiimote.history = 1000 }
+  record.call(n, "poll+history", throughput {
+    events = 0
+    wm.poll { |(wiimote, event)| events += 1 }
+    events
+  })
+  wm.each_wiimote { |wiimote| wiimote.ir_tracking = true }
+  record.call(n, "poll+ir_tracking", throughput {
+    events = 0
+    wm.poll { |(wiimote, event)| events += 1 }
+    events
+  })
+
+  wm.poll { }
+  record.call(n, "pressed?", per_call { w.pressed?(BUTTON_A) })
+  record.call(n, "all_buttons", per_call { w.all_buttons })
+  record.call(n, "acceleration", per_call { w.acceleration })
+  record.call(n, "acceleration(buf)", per_call { w.acceleration(buf) })
+  record.call(n, "position", per_call { w.position })
+  record.call(n, "ir_tracks(buf)", per_call { w.ir_tracks(buf) })
+  w.calibrate([[[0, 0], [0, 0]], [[1023, 0], [1919, 0]], [[1023, 767], [1919, 1079]], [[0, 767], [0, 1079]]])
+  wm.poll { }
+  record.call(n, "calibrated_position(buf)", per_call { w.calibrated_position(buf) })
+  record.call(n, "snapshot", per_call { w.snapshot })
+  record.call(n, "status", per_call { w.status })
+  record.call(n, "positions", per_call { wm.positions })
+  motion = Array.new(40) { |j| [Math.sin(3 + j * 0.1), Math.cos(0.3 * j), 1.0] }
+  record.call(n, "gesture match(16)", per_call { gestures.match(motion) })
+  record.call(n, "window_stats(#{w.window_stats(:gforce)[:count]})", per_call { w.window_stats(:gforce) })
+
+  wm.cleanup!
+}
+
+# speaker conversion (resampling and ADPCM encoding) of AUDIO seconds of a sine in every format:
+# "realtime" is how many sounds of that format can be converted on the fly at once
+encode = []
+[[8000, 1, 16], [22050, 1, 16], [44100, 2, 16], [48000, 2, 24], [44100, 2, :float], [44100, 2, 8]].each { |rate, channels, bits|
+  frames = (rate * AUDIO).to_i
+  wave = Array.new(frames * channels) { |i| Math.sin(i / channels * 2 * Math::PI * 440 / rate) * 0.5 }
+  data = case bits
+    when 8 then wave.map { |x| (x * 127 + 128).round }.pack("C*")
+    when 16 then wave.map { |x| (x * 32767).round }.pack("s<*")
+    when 24 then wave.map { |x| [(x * 8388607).round].pack("l<")[0, 3] }.join
+    else wave.pack("e*")
+  end
+  bank = SoundBank.new
+  bank.load_pcm(:warmup, data, rate, channels, bits)
+  start = now
+  bank.load_pcm(:sound, data, rate, channels, bits)
+  elapsed = now - start
+  values = { "ms" => (elapsed * 1000).round(3), "frames_per_sec" => (frames / elapsed).round, "realtime" => (AUDIO / elapsed).round }
+  encode << { "rate" => rate, "channels" => channels, "bits" => bits.to_s }.merge(values)
+  puts format("encode %5d Hz %d ch %-5s %s", rate, channels, bits, values.map { |k, v| "#{k}=#{v}" }.join(" "))
+}
+
+report = {
+  "ruby" => RUBY_DESCRIPTION,
+  "platform" => RbConfig::CONFIG["host"],
+  "time" => Time.now.utc.strftime("%Y-%m-%dT%H:%M:%SZ"),
+  "revision" => (`git rev-parse --short HEAD 2>/dev/null`.strip rescue ""),
+  "bench_time" => TIME,
+  "bench_calls" => CALLS,
+  "bench_audio" => AUDIO,
+  "simd" => SIMD,
+  "results" => results,
+  "encode" => encode
+}
+
+output = ARGV[0] || "bench/results.json"
+File.write(output, JSON.pretty_generate(report) + "\n")
+puts "results written to #{output}"
@@ -0,0 +1,75 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+#include<errno.h>
+
+int capture_open(connman *conn, const char *path) {
+  capture_header header;
+  FILE *fp = fopen(path, "wb");
+  if(!fp) return 0;
+
+  memset(&header, 0, sizeof(capture_header));
+  memcpy(header.magic, WII4R_CAPTURE_MAGIC, sizeof(header.magic));
+  header.version = WII4R_CAPTURE_VERSION;
+  header.record_size = sizeof(wii_event);
+  header.capacity = (uint16_t) conn->n;
+  if(fwrite(&header, sizeof(capture_header), 1, fp) != 1) {
+    int err = errno;
+    fclose(fp);
+    errno = err;
+    return 0;
+  }
+
+  pthread_mutex_lock(&(conn->capture_lock));
+  conn->capture = fp;
+  conn->captured = 0;
+  pthread_mutex_unlock(&(conn->capture_lock));
+  return 1;
+}
+
+//called by the thread which polled, right after conn->state has been refreshed
+void capture_write(connman *conn) {
+  int i;
+  pthread_mutex_lock(&(conn->capture_lock));
+  if(conn->capture) {
+    for(i = 0; i < conn->n; i++) {
+      if(conn->wms[i]->event == WIIUSE_NONE) continue;
+      if(fwrite(&(conn->state[i]), sizeof(wii_event), 1, conn->capture) == 1)
+        conn->captured++;
+    }
+  }
+  pthread_mutex_unlock(&(conn->capture_lock));
+}
+
+unsigned long capture_close(connman *conn) {
+  unsigned long captured;
+  pthread_mutex_lock(&(conn->capture_lock));
+  if(conn->capture) fclose(conn->capture);
+  conn->capture = NULL;
+  captured = conn->captured;
+  pthread_mutex_unlock(&(conn->capture_lock));
+  return captured;
+}
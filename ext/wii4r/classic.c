@@ -99,6 +99,66 @@ static VALUE rb_cc_rel(VALUE self, VALUE arg) {
     return Qfalse;
 }
 
+/*
+ * call-seq:
+ *	classicctrl.buttons	-> int
+ *
+ * Returns the bitmask of the buttons being pressed on <i>self</i> (C_BUTTON_* constants, or'ed).
+ *
+ */
+
+static VALUE rb_cc_buttons(VALUE self) {
+  classic_ctrl_t *cc;
+  Data_Get_Struct(self, classic_ctrl_t, cc);
+  if(!cc) return Qnil;
+  return INT2NUM((uint16_t) cc->btns);
+}
+
+/*
+ * call-seq:
+ *	classicctrl.buttons_pressed	-> int
+ *
+ * Returns the bitmask of the buttons just pressed on <i>self</i>, the ones for which just_pressed? is true.
+ *
+ */
+
+static VALUE rb_cc_buttons_pressed(VALUE self) {
+  classic_ctrl_t *cc;
+  Data_Get_Struct(self, classic_ctrl_t, cc);
+  if(!cc) return Qnil;
+  return INT2NUM((uint16_t) (cc->btns & ~(cc->btns_held)));
+}
+
+/*
+ * call-seq:
+ *	classicctrl.buttons_held	-> int
+ *
+ * Returns the bitmask of the buttons being held on <i>self</i>.
+ *
+ */
+
+static VALUE rb_cc_buttons_held(VALUE self) {
+  classic_ctrl_t *cc;
+  Data_Get_Struct(self, classic_ctrl_t, cc);
+  if(!cc) return Qnil;
+  return INT2NUM((uint16_t) cc->btns_held);
+}
+
+/*
+ * call-seq:
+ *	classicctrl.buttons_released	-> int
+ *
+ * Returns the bitmask of the buttons just released on <i>self</i>.
+ *
+ */
+
+static VALUE rb_cc_buttons_released(VALUE self) {
+  classic_ctrl_t *cc;
+  Data_Get_Struct(self, classic_ctrl_t, cc);
+  if(!cc) return Qnil;
+  return INT2NUM((uint16_t) cc->btns_released);
+}
+
 /*
  * call-seq:
  *	classicctrl.right_joystick_angle	-> float
@@ -224,6 +284,10 @@ void init_cc() {
   rb_define_method(cc_class, "just_pressed?", rb_cc_jpressed, 1);
   rb_define_method(cc_class, "held?", rb_cc_held, 1);
   rb_define_method(cc_class, "released?", rb_cc_rel, 1);
+  rb_define_method(cc_class, "buttons", rb_cc_buttons, 0);
+  rb_define_method(cc_class, "buttons_pressed", rb_cc_buttons_pressed, 0);
+  rb_define_method(cc_class, "buttons_held", rb_cc_buttons_held, 0);
+  rb_define_method(cc_class, "buttons_released", rb_cc_buttons_released, 0);
   rb_define_method(cc_class, "left_joystick_angle", rb_cc_ljangle, 0);
   rb_define_method(cc_class, "left_joystick_magnitude", rb_cc_ljmag, 0);
   rb_define_method(cc_class, "right_joystick_angle", rb_cc_rjangle, 0);
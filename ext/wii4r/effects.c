@@ -0,0 +1,193 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+#include<time.h>
+
+//an effect running on a wiimote: its steps are applied one after the other, "repeat" times
+typedef struct _effect {
+  wiimote *wm;
+  pthread_mutex_t *io;		//io_lock of the manager of "wm", NULL if none
+  int kind;			//EFFECT_RUMBLE or EFFECT_LEDS
+  effect_step *steps;
+  int nsteps;
+  int step;			//next step to apply
+  int repeat;			//repetitions left, 0 = forever
+  int last;			//value applied when the effect ends or is cancelled
+  uint64_t due;			//monotonic time (ns) of the next step
+  struct _effect *next;
+} effect;
+
+static pthread_once_t effects_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t effects_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t effects_cond;
+static pthread_t effects_thread;
+static int effects_started = 0;
+static effect *effects = NULL;
+
+static void effect_apply(effect *e, int value) {
+  //the poller may be in wiiuse_poll on the same wiimote
+  if(e->io) pthread_mutex_lock(e->io);
+  if(e->kind == EFFECT_RUMBLE) wiiuse_rumble(e->wm, value);
+  else wiiuse_set_leds(e->wm, value);
+  if(e->io) pthread_mutex_unlock(e->io);
+}
+
+//unlinks and frees "e", "prev" is the effect before it in the list (NULL if it is the first)
+static void effect_remove(effect *e, effect *prev) {
+  if(prev) prev->next = e->next;
+  else effects = e->next;
+  free(e->steps);
+  free(e);
+}
+
+//applies the steps of "e" due at "now", returns 0 if the effect is over
+static int effect_run(effect *e, uint64_t now) {
+  while(e->due <= now) {
+    if(e->step == e->nsteps) {
+      if(e->repeat == 1) return 0;
+      if(e->repeat > 1) e->repeat--;
+      e->step = 0;
+    }
+    effect_apply(e, e->steps[e->step].value);
+    e->due += (uint64_t) e->steps[e->step].ms * 1000000ULL;
+    e->step++;
+  }
+  return 1;
+}
+
+//body of the effects thread: wakes up when the next step of an effect is due
+static void * effects_loop(void * ptr) {
+  effect *e, *prev, *next;
+  uint64_t now, due;
+  struct timespec t;
+
+  pthread_mutex_lock(&effects_lock);
+  for(;;) {
+    now = wii_now();
+    due = 0;
+    for(prev = NULL, e = effects; e; e = next) {
+      next = e->next;
+      if(!effect_run(e, now)) {
+        effect_apply(e, e->last);
+        effect_remove(e, prev);
+        continue;
+      }
+      if(!due || e->due < due) due = e->due;
+      prev = e;
+    }
+    if(!due) pthread_cond_wait(&effects_cond, &effects_lock);
+    else {
+      t.tv_sec = due / 1000000000ULL;
+      t.tv_nsec = due % 1000000000ULL;
+      pthread_cond_timedwait(&effects_cond, &effects_lock, &t);
+    }
+  }
+  return NULL;
+}
+
+static void effects_init(void) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&effects_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+//removes the effect "kind" of "wm", applying its last value if "restore", call with effects_lock held
+static int effect_unlink(wiimote *wm, int kind, int restore) {
+  effect *e, *prev;
+  for(prev = NULL, e = effects; e; prev = e, e = e->next) {
+    if(e->wm == wm && e->kind == kind) {
+      if(restore) effect_apply(e, e->last);
+      effect_remove(e, prev);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int effect_start(wiimote *wm, pthread_mutex_t *io, int kind, const effect_step *steps, int nsteps, int repeat, int last) {
+  effect *e;
+  int i;
+  pthread_once(&effects_once, effects_init);
+
+  e = calloc(1, sizeof(effect));
+  if(!e) return 0;
+  e->steps = malloc(nsteps * sizeof(effect_step));
+  if(!(e->steps)) {
+    free(e);
+    return 0;
+  }
+  memcpy(e->steps, steps, nsteps * sizeof(effect_step));
+  for(i = 0; i < nsteps; i++)
+    if(!(e->steps[i].ms)) e->steps[i].ms = 1;
+  e->wm = wm;
+  e->io = io;
+  e->kind = kind;
+  e->nsteps = nsteps;
+  e->repeat = repeat;
+  e->last = last;
+
+  pthread_mutex_lock(&effects_lock);
+  if(!effects_started) {
+    if(pthread_create(&effects_thread, NULL, effects_loop, NULL)) {
+      pthread_mutex_unlock(&effects_lock);
+      free(e->steps);
+      free(e);
+      return 0;
+    }
+    pthread_detach(effects_thread);
+    effects_started = 1;
+  }
+  effect_unlink(wm, kind, 0);
+  //the first step is applied right away, the thread goes on from the second one
+  e->due = wii_now();
+  effect_run(e, e->due);
+  e->next = effects;
+  effects = e;
+  pthread_cond_signal(&effects_cond);
+  pthread_mutex_unlock(&effects_lock);
+  return 1;
+}
+
+int effect_cancel(wiimote *wm, int kind, int restore) {
+  int cancelled;
+  pthread_mutex_lock(&effects_lock);
+  cancelled = effect_unlink(wm, kind, restore);
+  pthread_mutex_unlock(&effects_lock);
+  return cancelled;
+}
+
+void effects_cancel_all(wiimote **wms, int n) {
+  int i;
+  if(!wms) return;
+  pthread_mutex_lock(&effects_lock);
+  for(i = 0; i < n; i++) {
+    effect_unlink(wms[i], EFFECT_RUMBLE, 0);
+    effect_unlink(wms[i], EFFECT_LEDS, 0);
+  }
+  pthread_mutex_unlock(&effects_lock);
+}
@@ -3,5 +3,24 @@ require 'mkmf'
 name = "wii4r"
 
 dir_config(name)
-have_library("wiiuse", "wiiuse_init")
+
+# ruby extconf.rb --enable-mock-wiiuse (rake compile -- --enable-mock-wiiuse)
+# links the simulated wiiuse of mock/ instead of libwiiuse, no bluetooth stack needed
+if enable_config("mock-wiiuse", false)
+  mock = File.join(File.dirname(File.expand_path(__FILE__)), "mock")
+  $INCFLAGS = "-I#{mock} #{$INCFLAGS}"
+  $VPATH << mock
+  $srcs = Dir[File.join(File.dirname(File.expand_path(__FILE__)), "*.c")].map { |f| File.basename(f) } + ["mock_wiiuse.c"]
+  $defs << "-DWII4R_MOCK"
+  have_library("m", "sinf")
+else
+  have_library("wiiuse", "wiiuse_init")
+end
+# ruby extconf.rb --enable-avx2 | --disable-simd
+# builds the sound conversion for AVX2 (SSE2 is used by default on x86-64) or without vector code
+$CFLAGS << " -mavx2" if enable_config("avx2", false)
+$defs << "-DWII4R_NO_SIMD" unless enable_config("simd", true)
+have_func("rb_thread_call_without_gvl", "ruby/thread.h")
+have_func("rb_thread_blocking_region", "ruby.h")
+have_header("ruby/memory_view.h")
 create_makefile(name)
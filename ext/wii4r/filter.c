@@ -0,0 +1,83 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+
+int filter_add(connman *conn, const wii_filter *filter) {
+  wii_filter *filters;
+  if(!(conn->filter_accel)) {
+    conn->filter_accel = calloc(conn->n, sizeof(conn->filter_accel[0]));
+    if(!(conn->filter_accel)) return 0;
+  }
+  filters = realloc(conn->filters, (conn->nfilters + 1) * sizeof(wii_filter));
+  if(!filters) return 0;
+  conn->filters = filters;
+  filters[conn->nfilters] = *filter;
+  filters[conn->nfilters].id = ++(conn->filter_id);
+  conn->nfilters++;
+  return conn->filter_id;
+}
+
+int filter_remove(connman *conn, int id) {
+  int i;
+  for(i = 0; i < conn->nfilters; i++) {
+    if(conn->filters[i].id == id) {
+      memmove(conn->filters + i, conn->filters + i + 1, (conn->nfilters - i - 1) * sizeof(wii_filter));
+      conn->nfilters--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//returns 1 if "ev" matches "filter", "last" is the acceleration of the last event of its slot that reached ruby
+static int filter_match(const wii_filter *filter, const wii_event *ev, const uint8_t *last) {
+  int i;
+  if(filter->slot >= 0 && filter->slot != ev->slot) return 0;
+  if(!(filter->events & (1U << ev->type))) return 0;
+  if(ev->type != WIIUSE_EVENT || (!(filter->buttons) && !(filter->accel_delta))) return 1;
+  //just pressed (pressed but not held) or released
+  if(((ev->btns & ~(ev->btns_held)) | ev->btns_released) & filter->buttons) return 1;
+  if(filter->accel_delta && (ev->flags & WII_EV_ACC)) {
+    for(i = 0; i < 3; i++)
+      if(abs((int) ev->accel[i] - (int) last[i]) >= filter->accel_delta) return 1;
+  }
+  return 0;
+}
+
+int filter_pass(connman *conn, const wii_event *ev) {
+  uint8_t *last;
+  int i;
+  if(!(conn->nfilters)) return 1;
+  last = conn->filter_accel[ev->slot];
+  for(i = 0; i < conn->nfilters; i++) {
+    if(filter_match(&(conn->filters[i]), ev, last)) {
+      if(ev->type == WIIUSE_EVENT) memcpy(last, ev->accel, 3);
+      return 1;
+    }
+  }
+  conn->filtered++;
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<math.h>
+
+#define FUSION_DEG		(180.0f / (float) M_PI)
+
+//the orientation is the rotation yaw (z axis) * pitch (x axis) * -roll (y axis): the gravity measured at
+//rest is then [sin(roll) cos(pitch), sin(pitch), cos(roll) cos(pitch)], as wiiuse computes roll and pitch
+
+//quaternion of roll, pitch and yaw (radians) in "q"
+static void fusion_quat(float roll, float pitch, float yaw, float *q) {
+  float cr = cosf(-roll / 2), sr = sinf(-roll / 2);
+  float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+  float cy = cosf(yaw / 2), sy = sinf(yaw / 2);
+  float w = cp * cr, x = sp * cr, y = cp * sr, z = sp * sr;
+  q[0] = cy * w - sy * z;
+  q[1] = cy * x - sy * y;
+  q[2] = cy * y + sy * x;
+  q[3] = cy * z + sy * w;
+}
+
+//roll, pitch and yaw (radians) of the quaternion "q" in "a"
+static void fusion_euler(const float *q, float *a) {
+  float w = q[0], x = q[1], y = q[2], z = q[3];
+  float s = 2 * (y * z + w * x);
+  a[0] = atan2f(2 * (x * z - w * y), 1 - 2 * (x * x + y * y));
+  a[1] = asinf(s > 1 ? 1 : (s < -1 ? -1 : s));
+  a[2] = atan2f(-2 * (x * y - w * z), 1 - 2 * (x * x + z * z));
+}
+
+//"a" - "b" wrapped in [-pi, pi]
+static float fusion_diff(float a, float b) {
+  float d = a - b;
+  while(d > (float) M_PI) d -= 2 * (float) M_PI;
+  while(d < -(float) M_PI) d += 2 * (float) M_PI;
+  return d;
+}
+
+//return 1 if the yaw computed by wiiuse for "ev" is valid, it needs two ir sources
+static int fusion_ir_yaw(const wii_event *ev) {
+  int dots = ev->dots;
+  if(!(ev->flags & WII_EV_IR)) return 0;
+  dots &= dots - 1;
+  return dots != 0;
+}
+
+void fusion_reset(fusion_state *f, float tau) {
+  f->tau = tau;
+  f->q[0] = 1;
+  f->q[1] = f->q[2] = f->q[3] = 0;
+  f->ts = 0;
+}
+
+void fusion_update(fusion_state *f, const wii_event *ev) {
+  float cur[3], acc[3], t[4], norm, trust, k, d;
+  int i;
+  if(!(f->tau) || ev->type != WIIUSE_EVENT || !(ev->flags & WII_EV_ACC)) return;
+  norm = sqrtf(ev->gforce[0] * ev->gforce[0] + ev->gforce[1] * ev->gforce[1] + ev->gforce[2] * ev->gforce[2]);
+  if(norm < 1e-3f) return;
+  acc[0] = atan2f(ev->gforce[0], ev->gforce[2]);
+  d = ev->gforce[1] / norm;
+  acc[1] = asinf(d > 1 ? 1 : (d < -1 ? -1 : d));
+
+  if(!(f->ts)) {
+    //the first report gives the starting orientation
+    acc[2] = fusion_ir_yaw(ev) ? ev->orient[2] / FUSION_DEG : 0;
+    fusion_quat(acc[0], acc[1], acc[2], f->q);
+    f->ts = ev->ts;
+    return;
+  }
+  k = ev->ts > f->ts ? 1 - expf(-(float) (ev->ts - f->ts) / 1e9f / f->tau) : 0;
+  f->ts = ev->ts;
+
+  //the accelerometer measures the tilt only while the wiimote is not accelerated, about 1 g
+  fusion_euler(f->q, cur);
+  trust = 1 - 2 * fabsf(norm - 1);
+  if(trust > 0) {
+    cur[0] += trust * fusion_diff(acc[0], cur[0]);
+    cur[1] += trust * (acc[1] - cur[1]);
+  }
+  if(fusion_ir_yaw(ev)) cur[2] += fusion_diff(ev->orient[2] / FUSION_DEG, cur[2]);
+  fusion_quat(cur[0], cur[1], cur[2], t);
+
+  //moves "q" towards the target by "k", along the shortest way
+  if(f->q[0] * t[0] + f->q[1] * t[1] + f->q[2] * t[2] + f->q[3] * t[3] < 0)
+    for(i = 0; i < 4; i++) t[i] = -t[i];
+  norm = 0;
+  for(i = 0; i < 4; i++) {
+    f->q[i] += k * (t[i] - f->q[i]);
+    norm += f->q[i] * f->q[i];
+  }
+  norm = 1 / sqrtf(norm);
+  for(i = 0; i < 4; i++) f->q[i] *= norm;
+}
+
+void fusion_angles(const fusion_state *f, float *angles) {
+  int i;
+  fusion_euler(f->q, angles);
+  for(i = 0; i < 3; i++) angles[i] *= FUSION_DEG;
+}
@@ -0,0 +1,423 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+#include<limits.h>
+#include<math.h>
+
+//a motion starts when the acceleration is outside [START_LO, START_HI] and ends after QUIET reports
+//in [REST_LO, REST_HI] (squared magnitudes in fixed point: 0.65 g, 1.35 g, 0.8 g, 1.2 g)
+#define GESTURE_START_LO	433
+#define GESTURE_START_HI	1866
+#define GESTURE_REST_LO		655
+#define GESTURE_REST_HI		1475
+#define GESTURE_QUIET		6
+
+//shortest motion matched (reports)
+#define GESTURE_MIN_SAMPLES	8
+
+//greatest distance between the points of a gesture and of a template aligned by the time warping
+#define GESTURE_BAND		8
+
+#define GESTURE_INF		(INT_MAX / 2)
+
+//a gesture of a set and its name
+typedef struct _gesture_template {
+  ID name;
+  int8_t pts[GESTURE_POINTS][3];
+} gesture_template;
+
+//struct to describe the GestureSet class
+struct _gesture_set {
+  gesture_template *templates;
+  int n;
+  int size;
+  float threshold;		//lowest score of a gesture recognised
+};
+
+static void free_gesture_set(void * ptr) {
+  gesture_set *set = (gesture_set *) ptr;
+  free(set->templates);
+  free(set);
+}
+
+static VALUE rb_gs_alloc(VALUE klass) {
+  gesture_set *set;
+  VALUE obj = Data_Make_Struct(klass, gesture_set, NULL, free_gesture_set, set);
+  set->threshold = 0.75f;
+  return obj;
+}
+
+gesture_set * gesture_set_get(VALUE obj) {
+  gesture_set *set;
+  if(!rb_obj_is_kind_of(obj, gesture_class)) rb_raise(rb_eTypeError, "not a GestureSet");
+  Data_Get_Struct(obj, gesture_set, set);
+  return set;
+}
+
+//gravity force "g" in fixed point
+static int8_t gesture_fixed(float g) {
+  long v = lrintf(g * GESTURE_ONE_G);
+  return (int8_t) (v < -127 ? -127 : (v > 127 ? 127 : v));
+}
+
+//resamples the "len" (>= 2) accelerations of "src" to the GESTURE_POINTS of "dst", interpolating linearly
+static void gesture_resample(const int8_t (*src)[3], int len, int8_t (*dst)[3]) {
+  int i, k, j, f, pos;
+  for(i = 0; i < GESTURE_POINTS; i++) {
+    pos = i * (len - 1) * 256 / (GESTURE_POINTS - 1);
+    j = pos >> 8;
+    f = pos & 255;
+    for(k = 0; k < 3; k++) {
+      if(j + 1 < len) dst[i][k] = (int8_t) ((src[j][k] * (256 - f) + src[j + 1][k] * f) / 256);
+      else dst[i][k] = src[j][k];
+    }
+  }
+}
+
+//dynamic time warping distance between "x" and "y" within GESTURE_BAND, "bound" if it is not lower than "bound"
+static int gesture_dtw(const int8_t (*x)[3], const int8_t (*y)[3], int bound) {
+  int prev[GESTURE_POINTS], cur[GESTURE_POINTS];
+  int i, j, lo, hi, best, cost, rowmin;
+  for(i = 0; i < GESTURE_POINTS; i++) {
+    lo = i > GESTURE_BAND ? i - GESTURE_BAND : 0;
+    hi = i + GESTURE_BAND < GESTURE_POINTS ? i + GESTURE_BAND : GESTURE_POINTS - 1;
+    rowmin = GESTURE_INF;
+    for(j = 0; j < GESTURE_POINTS; j++) cur[j] = GESTURE_INF;
+    for(j = lo; j <= hi; j++) {
+      cost = abs(x[i][0] - y[j][0]) + abs(x[i][1] - y[j][1]) + abs(x[i][2] - y[j][2]);
+      if(!i && !j) best = 0;
+      else {
+        best = GESTURE_INF;
+        if(i && prev[j] < best) best = prev[j];
+        if(j && cur[j - 1] < best) best = cur[j - 1];
+        if(i && j && prev[j - 1] < best) best = prev[j - 1];
+      }
+      cur[j] = best + cost;
+      if(cur[j] < rowmin) rowmin = cur[j];
+    }
+    //the distance only grows row after row
+    if(rowmin >= bound) return bound;
+    memcpy(prev, cur, sizeof(prev));
+  }
+  return prev[GESTURE_POINTS - 1];
+}
+
+//score of the distance "dist": 1 for the same gesture, 0 when the points differ of 1 g on every axis
+static float gesture_score(int dist) {
+  float score = 1.0f - (float) dist / (GESTURE_POINTS * 3 * GESTURE_ONE_G);
+  return score < 0 ? 0 : score;
+}
+
+//returns the template of "set" nearest to "pts" (its score in "score"), -1 if the set is empty
+static int gesture_nearest(const gesture_set *set, const int8_t (*pts)[3], float *score) {
+  int i, dist, best = -1, bound = GESTURE_INF;
+  for(i = 0; i < set->n; i++) {
+    dist = gesture_dtw(pts, (const int8_t (*)[3]) set->templates[i].pts, bound);
+    if(dist < bound) {
+      bound = dist;
+      best = i;
+    }
+  }
+  *score = best < 0 ? 0 : gesture_score(bound);
+  return best;
+}
+
+static int gesture_find(const gesture_set *set, ID name) {
+  int i;
+  for(i = 0; i < set->n; i++)
+    if(set->templates[i].name == name) return i;
+  return -1;
+}
+
+//adds the gesture "pts" to "set" as "name", replacing the one with the same name, returns 0 if there is no memory
+static int gesture_put(gesture_set *set, ID name, const int8_t (*pts)[3]) {
+  gesture_template *templates;
+  int i = gesture_find(set, name);
+  if(i < 0) {
+    if(set->n == set->size) {
+      templates = realloc(set->templates, (set->size ? 2 * set->size : 8) * sizeof(gesture_template));
+      if(!templates) return 0;
+      set->templates = templates;
+      set->size = set->size ? 2 * set->size : 8;
+    }
+    i = set->n++;
+    set->templates[i].name = name;
+  }
+  memcpy(set->templates[i].pts, pts, sizeof(set->templates[i].pts));
+  return 1;
+}
+
+void gesture_attach(gesture_state *g, gesture_set *set) {
+  memset(g, 0, sizeof(gesture_state));
+  g->set = set;
+}
+
+ID gesture_update(gesture_state *g, const wii_event *ev, float *score) {
+  int8_t pts[GESTURE_POINTS][3], *a;
+  int32_t m;
+  int len, i;
+  if(!(g->set) || ev->type != WIIUSE_EVENT || !(ev->flags & WII_EV_ACC)) return 0;
+
+  a = g->seg[g->len];
+  for(i = 0; i < 3; i++) a[i] = gesture_fixed(ev->gforce[i]);
+  m = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+  if(!(g->len) && m > GESTURE_START_LO && m < GESTURE_START_HI) return 0;
+  g->len++;
+  g->quiet = (m > GESTURE_REST_LO && m < GESTURE_REST_HI) ? g->quiet + 1 : 0;
+  if(g->quiet < GESTURE_QUIET && g->len < GESTURE_MAX_SAMPLES) return 0;
+
+  //the motion is over, without the reports at rest
+  len = g->len - g->quiet;
+  g->len = g->quiet = 0;
+  if(len < GESTURE_MIN_SAMPLES) return 0;
+  gesture_resample((const int8_t (*)[3]) g->seg, len, pts);
+  if(g->recording) {
+    gesture_put(g->set, g->recording, (const int8_t (*)[3]) pts);
+    g->recording = 0;
+    return 0;
+  }
+  i = gesture_nearest(g->set, (const int8_t (*)[3]) pts, score);
+  if(i < 0 || *score < g->set->threshold) return 0;
+  g->last = g->set->templates[i].name;
+  g->last_score = *score;
+  g->last_ts = ev->ts;
+  return g->last;
+}
+
+//converts the array of [x, y, z] gravity forces "samples" to the points of a gesture
+static void gesture_points(VALUE samples, int8_t (*pts)[3]) {
+  int8_t seg[GESTURE_MAX_SAMPLES][3];
+  VALUE sample;
+  long len, i;
+  int k;
+  Check_Type(samples, T_ARRAY);
+  len = RARRAY_LEN(samples);
+  if(len < 2) rb_raise(rb_eArgError, "a gesture needs at least 2 samples");
+  if(len > GESTURE_MAX_SAMPLES) rb_raise(rb_eArgError, "a gesture can have at most %d samples", GESTURE_MAX_SAMPLES);
+  for(i = 0; i < len; i++) {
+    sample = rb_ary_entry(samples, i);
+    Check_Type(sample, T_ARRAY);
+    if(RARRAY_LEN(sample) != 3) rb_raise(rb_eArgError, "a sample must be [x, y, z]");
+    for(k = 0; k < 3; k++) seg[i][k] = gesture_fixed((float) NUM2DBL(rb_ary_entry(sample, k)));
+  }
+  gesture_resample((const int8_t (*)[3]) seg, (int) len, pts);
+}
+
+/*
+ *  call-seq:
+ *	set.add(name, samples)	-> set
+ *
+ *  Keeps in <i>self</i> as <i>name</i> the gesture made of <i>samples</i>, an array of 2 to 256 gravity forces
+ *  [x, y, z] in the order they were read (as <code>Wiimote#gravity_force</code> returns them, one per report).
+ *  A gesture with the same name is replaced. Gestures can also be recorded with <code>Wiimote#record_gesture</code>.
+ *
+ *	set.add(:swing, set.points(:swing))
+ *
+ */
+
+static VALUE rb_gs_add(VALUE self, VALUE name, VALUE samples) {
+  gesture_set *set;
+  int8_t pts[GESTURE_POINTS][3];
+  ID id = rb_to_id(name);
+  Data_Get_Struct(self, gesture_set, set);
+  gesture_points(samples, pts);
+  if(!gesture_put(set, id, (const int8_t (*)[3]) pts)) rb_raise(gen_exp_class, "not enough memory");
+  return self;
+}
+
+/*
+ *  call-seq:
+ *	set.points(name)	-> array or nil
+ *
+ *  Returns the 32 gravity forces [x, y, z] the gesture <i>name</i> was resampled to, nil if there is none.
+ *  They can be saved and given back to <code>add</code>.
+ *
+ */
+
+static VALUE rb_gs_points(VALUE self, VALUE name) {
+  gesture_set *set;
+  VALUE ary;
+  int i, j;
+  Data_Get_Struct(self, gesture_set, set);
+  i = gesture_find(set, rb_to_id(name));
+  if(i < 0) return Qnil;
+  ary = rb_ary_new2(GESTURE_POINTS);
+  for(j = 0; j < GESTURE_POINTS; j++) {
+    const int8_t *p = set->templates[i].pts[j];
+    rb_ary_push(ary, rb_ary_new3(3, rb_float_new((double) p[0] / GESTURE_ONE_G),
+      rb_float_new((double) p[1] / GESTURE_ONE_G), rb_float_new((double) p[2] / GESTURE_ONE_G)));
+  }
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *	set.match(samples)	-> [name, score] or nil
+ *
+ *  Returns the gesture of <i>self</i> most similar to <i>samples</i> (as in <code>add</code>) and its score,
+ *  from 0 to 1 (the same gesture), nil if no gesture scores at least <code>threshold</code>.
+ *
+ */
+
+static VALUE rb_gs_match(VALUE self, VALUE samples) {
+  gesture_set *set;
+  int8_t pts[GESTURE_POINTS][3];
+  float score;
+  int i;
+  Data_Get_Struct(self, gesture_set, set);
+  gesture_points(samples, pts);
+  i = gesture_nearest(set, (const int8_t (*)[3]) pts, &score);
+  if(i < 0 || score < set->threshold) return Qnil;
+  return rb_ary_new3(2, ID2SYM(set->templates[i].name), rb_float_new(score));
+}
+
+/*
+ *  call-seq:
+ *	set.threshold	-> float
+ *
+ *  Returns the lowest score (from 0 to 1, default 0.75) of a gesture recognised.
+ *
+ */
+
+static VALUE rb_gs_threshold(VALUE self) {
+  gesture_set *set;
+  Data_Get_Struct(self, gesture_set, set);
+  return rb_float_new(set->threshold);
+}
+
+/*
+ *  call-seq:
+ *	set.threshold = score
+ *
+ *  Sets the lowest score (from 0 to 1) of a gesture recognised: a higher one means less gestures
+ *  recognised by mistake and more missed.
+ *
+ */
+
+static VALUE rb_gs_set_threshold(VALUE self, VALUE score) {
+  gesture_set *set;
+  double s = NUM2DBL(score);
+  Data_Get_Struct(self, gesture_set, set);
+  if(s < 0 || s > 1) rb_raise(rb_eArgError, "threshold must be between 0 and 1");
+  set->threshold = (float) s;
+  return score;
+}
+
+/*
+ *  call-seq:
+ *	set.include?(name)	-> true or false
+ *
+ *  Returns true if <i>self</i> has a gesture named <i>name</i>.
+ *
+ */
+
+static VALUE rb_gs_include(VALUE self, VALUE name) {
+  gesture_set *set;
+  Data_Get_Struct(self, gesture_set, set);
+  return gesture_find(set, rb_to_id(name)) >= 0 ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	set.names	-> array
+ *
+ *  Returns the names of the gestures of <i>self</i>, in the order they were added.
+ *
+ */
+
+static VALUE rb_gs_names(VALUE self) {
+  gesture_set *set;
+  VALUE ary;
+  int i;
+  Data_Get_Struct(self, gesture_set, set);
+  ary = rb_ary_new2(set->n);
+  for(i = 0; i < set->n; i++)
+    rb_ary_push(ary, ID2SYM(set->templates[i].name));
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *	set.size	-> int
+ *
+ *  Returns the number of gestures of <i>self</i>.
+ *
+ */
+
+static VALUE rb_gs_size(VALUE self) {
+  gesture_set *set;
+  Data_Get_Struct(self, gesture_set, set);
+  return INT2NUM(set->n);
+}
+
+/*
+ *  call-seq:
+ *	set.delete(name)	-> true or false
+ *
+ *  Removes the gesture named <i>name</i> from <i>self</i>, returns false if there was none.
+ *
+ */
+
+static VALUE rb_gs_delete(VALUE self, VALUE name) {
+  gesture_set *set;
+  int i;
+  Data_Get_Struct(self, gesture_set, set);
+  i = gesture_find(set, rb_to_id(name));
+  if(i < 0) return Qfalse;
+  memmove(set->templates + i, set->templates + i + 1, (set->n - i - 1) * sizeof(gesture_template));
+  set->n--;
+  return Qtrue;
+}
+
+/*
+ * A set of gestures recognised natively on the reports of the wiimotes it is given to
+ * (see <code>Wiimote#gestures=</code>): every motion, from when the wiimote leaves the rest to when it
+ * is still again, is resampled to 32 accelerations and compared with the gestures of the set by
+ * dynamic time warping. The gesture recognised is yielded by <code>WiimoteManager#poll</code> as a :gesture event.
+ *
+ *	set = Wii::GestureSet.new
+ *	wiimote.gestures = set
+ *	wiimote.record_gesture(:swing)		# the next motion of the wiimote
+ *	wm.poll { |(wiimote, event, time, gesture, score)|
+ *		puts "#{gesture} (#{score})" if event == :gesture
+ *	}
+ *
+ */
+
+void init_gesture_set(void) {
+  gesture_class = rb_define_class_under(wii_mod, "GestureSet", rb_cObject);
+  rb_define_alloc_func(gesture_class, rb_gs_alloc);
+
+  rb_define_method(gesture_class, "add", rb_gs_add, 2);
+  rb_define_method(gesture_class, "points", rb_gs_points, 1);
+  rb_define_method(gesture_class, "match", rb_gs_match, 1);
+  rb_define_method(gesture_class, "threshold", rb_gs_threshold, 0);
+  rb_define_method(gesture_class, "threshold=", rb_gs_set_threshold, 1);
+  rb_define_method(gesture_class, "include?", rb_gs_include, 1);
+  rb_define_method(gesture_class, "names", rb_gs_names, 0);
+  rb_define_method(gesture_class, "size", rb_gs_size, 0);
+  rb_define_method(gesture_class, "delete", rb_gs_delete, 1);
+}
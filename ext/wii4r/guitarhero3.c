@@ -99,6 +99,66 @@ static VALUE rb_gh3_rel(VALUE self, VALUE arg) {
     return Qfalse;
 }
 
+/*
+ * call-seq:
+ *	gh3ctrl.buttons	-> int
+ *
+ * Returns the bitmask of the buttons being pressed on <i>self</i> (GUITAR_BUTTON_* constants, or'ed).
+ *
+ */
+
+static VALUE rb_gh3_buttons(VALUE self) {
+  guitar_hero_3_t *gh3;
+  Data_Get_Struct(self, guitar_hero_3_t, gh3);
+  if(!gh3) return Qnil;
+  return INT2NUM((uint16_t) gh3->btns);
+}
+
+/*
+ * call-seq:
+ *	gh3ctrl.buttons_pressed	-> int
+ *
+ * Returns the bitmask of the buttons just pressed on <i>self</i>, the ones for which just_pressed? is true.
+ *
+ */
+
+static VALUE rb_gh3_buttons_pressed(VALUE self) {
+  guitar_hero_3_t *gh3;
+  Data_Get_Struct(self, guitar_hero_3_t, gh3);
+  if(!gh3) return Qnil;
+  return INT2NUM((uint16_t) (gh3->btns & ~(gh3->btns_held)));
+}
+
+/*
+ * call-seq:
+ *	gh3ctrl.buttons_held	-> int
+ *
+ * Returns the bitmask of the buttons being held on <i>self</i>.
+ *
+ */
+
+static VALUE rb_gh3_buttons_held(VALUE self) {
+  guitar_hero_3_t *gh3;
+  Data_Get_Struct(self, guitar_hero_3_t, gh3);
+  if(!gh3) return Qnil;
+  return INT2NUM((uint16_t) gh3->btns_held);
+}
+
+/*
+ * call-seq:
+ *	gh3ctrl.buttons_released	-> int
+ *
+ * Returns the bitmask of the buttons just released on <i>self</i>.
+ *
+ */
+
+static VALUE rb_gh3_buttons_released(VALUE self) {
+  guitar_hero_3_t *gh3;
+  Data_Get_Struct(self, guitar_hero_3_t, gh3);
+  if(!gh3) return Qnil;
+  return INT2NUM((uint16_t) gh3->btns_released);
+}
+
 /*
  * call-seq:
  *	gh3ctrl.joystick_angle	-> float
@@ -169,6 +229,10 @@ void init_gh3() {
   rb_define_method(gh3_class, "just_pressed?", rb_gh3_jpressed, 1);
   rb_define_method(gh3_class, "held?", rb_gh3_held, 1);
   rb_define_method(gh3_class, "released?", rb_gh3_rel, 1);
+  rb_define_method(gh3_class, "buttons", rb_gh3_buttons, 0);
+  rb_define_method(gh3_class, "buttons_pressed", rb_gh3_buttons_pressed, 0);
+  rb_define_method(gh3_class, "buttons_held", rb_gh3_buttons_held, 0);
+  rb_define_method(gh3_class, "buttons_released", rb_gh3_buttons_released, 0);
   rb_define_method(gh3_class, "whammy_bar", rb_gh3_wbar, 0);
   rb_define_method(gh3_class, "joystick_angle", rb_gh3_jangle, 0);
   rb_define_method(gh3_class, "joystick_magnitude", rb_gh3_jmag, 0);
@@ -0,0 +1,118 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+
+#include "wii4r.h"
+#include<string.h>
+
+int history_resize(history_state *h, int size) {
+  history_sample *buf = NULL;
+  if(size > 0) {
+    buf = malloc(size * sizeof(history_sample));
+    if(!buf) return 0;
+  }
+  free(h->buf);
+  h->buf = buf;
+  h->size = size > 0 ? (uint32_t) size : 0;
+  h->head = 0;
+  h->count = 0;
+  return 1;
+}
+
+void history_push(history_state *h, const wii_event *ev) {
+  history_sample *s;
+  if(!(h->size) || ev->type != WIIUSE_EVENT) return;
+  s = &(h->buf[h->head]);
+  s->ts = ev->ts;
+  s->flags = 0;
+  memcpy(s->accel, ev->accel, sizeof(s->accel));
+  memcpy(s->gforce, ev->gforce, sizeof(s->gforce));
+  if(ev->flags & WII_EV_ACC) s->flags |= HISTORY_HAS_ACC;
+  if((ev->flags & WII_EV_IR) && ev->dots) {
+    s->flags |= HISTORY_HAS_IR;
+    s->ir[0] = ev->ir[0];
+    s->ir[1] = ev->ir[1];
+  }
+  if(ev->exp == EXP_NUNCHUK) {
+    s->flags |= HISTORY_HAS_EXP;
+    memcpy(s->exp_accel, ev->exp_accel, sizeof(s->exp_accel));
+    memcpy(s->exp_gforce, ev->exp_gforce, sizeof(s->exp_gforce));
+  }
+  h->head = h->head + 1 == h->size ? 0 : h->head + 1;
+  if(h->count < h->size) h->count++;
+}
+
+//the "n" values of "kind" of "s" in "v", returns 0 if "s" has none
+static int history_values(const history_sample *s, int kind, double *v) {
+  int i;
+  switch(kind) {
+    case HISTORY_ACCEL:
+      if(!(s->flags & HISTORY_HAS_ACC)) return 0;
+      for(i = 0; i < 3; i++) v[i] = s->accel[i];
+      return 1;
+    case HISTORY_GFORCE:
+      if(!(s->flags & HISTORY_HAS_ACC)) return 0;
+      for(i = 0; i < 3; i++) v[i] = s->gforce[i];
+      return 1;
+    case HISTORY_POSITION:
+      if(!(s->flags & HISTORY_HAS_IR)) return 0;
+      v[0] = s->ir[0];
+      v[1] = s->ir[1];
+      return 1;
+    case HISTORY_EXP_ACCEL:
+      if(!(s->flags & HISTORY_HAS_EXP)) return 0;
+      for(i = 0; i < 3; i++) v[i] = s->exp_accel[i];
+      return 1;
+    case HISTORY_EXP_GFORCE:
+      if(!(s->flags & HISTORY_HAS_EXP)) return 0;
+      for(i = 0; i < 3; i++) v[i] = s->exp_gforce[i];
+      return 1;
+  }
+  return 0;
+}
+
+int history_window(const history_state *h, int kind, uint64_t since, history_stats *st) {
+  double v[3], d;
+  uint32_t i, idx;
+  int a, n = kind == HISTORY_POSITION ? 2 : 3;
+  memset(st, 0, sizeof(history_stats));
+  st->axes = n;
+  //newest to oldest, up to the first sample before "since"; the variance is accumulated with Welford
+  for(i = 0; i < h->count; i++) {
+    idx = (h->head + h->size - 1 - i) % h->size;
+    if(h->buf[idx].ts < since) break;
+    if(!history_values(&(h->buf[idx]), kind, v)) continue;
+    st->count++;
+    for(a = 0; a < n; a++) {
+      if(st->count == 1 || v[a] < st->min[a]) st->min[a] = v[a];
+      if(st->count == 1 || v[a] > st->max[a]) st->max[a] = v[a];
+      d = v[a] - st->mean[a];
+      st->mean[a] += d / st->count;
+      st->var[a] += d * (v[a] - st->mean[a]);
+    }
+  }
+  for(a = 0; a < n && st->count; a++)
+    st->var[a] /= st->count;
+  return st->count;
+}
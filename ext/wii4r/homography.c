@@ -0,0 +1,145 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+
+#include "wii4r.h"
+#include<math.h>
+#include<string.h>
+
+//similarity "t" (scale, tx, ty) moving the centroid of the "n" points "p" to the origin and their mean distance
+//from it to sqrt(2), returns 0 if the points coincide
+static int homography_normalize(const double *p, int n, double *t) {
+  double cx = 0, cy = 0, d = 0;
+  int i;
+  for(i = 0; i < n; i++) {
+    cx += p[2 * i];
+    cy += p[2 * i + 1];
+  }
+  cx /= n;
+  cy /= n;
+  for(i = 0; i < n; i++)
+    d += sqrt((p[2 * i] - cx) * (p[2 * i] - cx) + (p[2 * i + 1] - cy) * (p[2 * i + 1] - cy));
+  d /= n;
+  if(d < 1e-9) return 0;
+  t[0] = sqrt(2.0) / d;
+  t[1] = -cx * t[0];
+  t[2] = -cy * t[0];
+  return 1;
+}
+
+//solves the "n" x "n" system "a" x = "b" (b is overwritten with x) by gaussian elimination with partial pivoting,
+//returns 0 if it is singular
+static int homography_gauss(double *a, double *b, int n) {
+  double f, tmp;
+  int i, j, k, p;
+  for(k = 0; k < n; k++) {
+    p = k;
+    for(i = k + 1; i < n; i++)
+      if(fabs(a[i * n + k]) > fabs(a[p * n + k])) p = i;
+    if(fabs(a[p * n + k]) < 1e-10) return 0;
+    if(p != k) {
+      for(j = 0; j < n; j++) {
+        tmp = a[k * n + j];
+        a[k * n + j] = a[p * n + j];
+        a[p * n + j] = tmp;
+      }
+      tmp = b[k];
+      b[k] = b[p];
+      b[p] = tmp;
+    }
+    for(i = k + 1; i < n; i++) {
+      f = a[i * n + k] / a[k * n + k];
+      for(j = k; j < n; j++) a[i * n + j] -= f * a[k * n + j];
+      b[i] -= f * b[k];
+    }
+  }
+  for(k = n - 1; k >= 0; k--) {
+    for(j = k + 1; j < n; j++) b[k] -= a[k * n + j] * b[j];
+    b[k] /= a[k * n + k];
+  }
+  return 1;
+}
+
+int homography_solve(const double *src, const double *dst, int n, double *h) {
+  double ts[3], td[3], ata[64], atb[8], row[2][8], rhs[2], x, y, u, v, hn[9], m[9];
+  int i, j, k, r;
+  if(n < 4 || !homography_normalize(src, n, ts) || !homography_normalize(dst, n, td)) return 0;
+
+  //least squares of the linear equations of every pair, with h[8] = 1, on the normalized points
+  memset(ata, 0, sizeof(ata));
+  memset(atb, 0, sizeof(atb));
+  for(i = 0; i < n; i++) {
+    x = ts[0] * src[2 * i] + ts[1];
+    y = ts[0] * src[2 * i + 1] + ts[2];
+    u = td[0] * dst[2 * i] + td[1];
+    v = td[0] * dst[2 * i + 1] + td[2];
+    memset(row, 0, sizeof(row));
+    row[0][0] = x; row[0][1] = y; row[0][2] = 1; row[0][6] = -x * u; row[0][7] = -y * u;
+    row[1][3] = x; row[1][4] = y; row[1][5] = 1; row[1][6] = -x * v; row[1][7] = -y * v;
+    rhs[0] = u;
+    rhs[1] = v;
+    for(r = 0; r < 2; r++)
+      for(j = 0; j < 8; j++) {
+        atb[j] += row[r][j] * rhs[r];
+        for(k = 0; k < 8; k++) ata[j * 8 + k] += row[r][j] * row[r][k];
+      }
+  }
+  if(!homography_gauss(ata, atb, 8)) return 0;
+  memcpy(hn, atb, sizeof(atb));
+  hn[8] = 1;
+
+  //h = inverse(Td) * hn * Ts
+  for(i = 0; i < 3; i++) {
+    m[3 * i] = hn[3 * i] * ts[0];
+    m[3 * i + 1] = hn[3 * i + 1] * ts[0];
+    m[3 * i + 2] = hn[3 * i] * ts[1] + hn[3 * i + 1] * ts[2] + hn[3 * i + 2];
+  }
+  for(j = 0; j < 3; j++) {
+    h[j] = (m[j] - td[1] * m[6 + j]) / td[0];
+    h[3 + j] = (m[3 + j] - td[2] * m[6 + j]) / td[0];
+    h[6 + j] = m[6 + j];
+  }
+  if(fabs(h[8]) < 1e-12) return 0;
+  for(j = 0; j < 9; j++) h[j] /= h[8];
+  return 1;
+}
+
+int homography_apply(const double *h, double x, double y, double *out) {
+  double w = h[6] * x + h[7] * y + h[8];
+  if(fabs(w) < 1e-12) return 0;
+  out[0] = (h[0] * x + h[1] * y + h[2]) / w;
+  out[1] = (h[3] * x + h[4] * y + h[5]) / w;
+  return 1;
+}
+
+void calib_update(calib_state *c, const wii_event *ev) {
+  double p[2];
+  if(!(c->enabled) || ev->type != WIIUSE_EVENT) return;
+  c->valid = 0;
+  if(!(ev->flags & WII_EV_IR) || !(ev->dots)) return;
+  if(!homography_apply(c->h, ev->ir[0], ev->ir[1], p)) return;
+  c->pos[0] = (float) p[0];
+  c->pos[1] = (float) p[1];
+  c->valid = 1;
+}
@@ -0,0 +1,494 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+/*
+ * Simulated wiiuse: generates the reports of virtual wiimotes, with no bluetooth stack.
+ * Read by wiiuse_init, so every WiimoteManager uses the values set when it was created:
+ *	WII4R_MOCK_WIIMOTES	number of wiimotes in range (default: as many as the manager can handle)
+ *	WII4R_MOCK_RATE		reports per second of every wiimote (default 100, 0 = a report at every poll)
+ *	WII4R_MOCK_EXPANSION	nunchuk, classic or guitar, inserted right after the connection (default none)
+ * The reports are deterministic: they depend only on the slot of the wiimote and on the number of reports.
+ */
+
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include "wiiuse.h"
+
+//state bits of a wiimote structure, as in wiiuse_internal.h
+#define MOCK_STATE_DEV_FOUND		0x0001
+#define MOCK_STATE_HANDSHAKE		0x0002
+#define MOCK_STATE_HANDSHAKE_COMPLETE	0x0004
+#define MOCK_STATE_CONNECTED		0x0008
+#define MOCK_STATE_RUMBLE		0x0010
+#define MOCK_STATE_ACC			0x0020
+#define MOCK_STATE_EXP			0x0040
+#define MOCK_STATE_IR			0x0080
+#define MOCK_STATE_SPEAKER		0x0100
+#define MOCK_STATE_IR_SENS_LVL1		0x0200
+#define MOCK_STATE_IR_SENS_ALL		0x3E00
+#define MOCK_STATE_SPEAKER_MUTE		0x4000
+
+#define MOCK_IS_CONNECTED(wm)		((wm)->state & MOCK_STATE_CONNECTED)
+
+//longest wait of a poll for the next report, in ns
+#define MOCK_POLL_TIMEOUT		10000000ULL
+
+//raw accelerometer value at 0 g and 1 g
+#define MOCK_ACC_ZERO			128
+#define MOCK_ACC_G			26
+
+#define MOCK_PI				3.14159265358979f
+
+static int mock_wiimotes = -1;
+static unsigned long long mock_period = 10000000ULL;
+static int mock_exp = EXP_NONE;
+
+static const unsigned short mock_buttons[] = {
+  WIIMOTE_BUTTON_A, WIIMOTE_BUTTON_B, WIIMOTE_BUTTON_ONE, WIIMOTE_BUTTON_TWO, WIIMOTE_BUTTON_MINUS, WIIMOTE_BUTTON_PLUS,
+  WIIMOTE_BUTTON_HOME, WIIMOTE_BUTTON_UP, WIIMOTE_BUTTON_DOWN, WIIMOTE_BUTTON_LEFT, WIIMOTE_BUTTON_RIGHT
+};
+
+static const unsigned short mock_classic_buttons[] = {
+  CLASSIC_CTRL_BUTTON_A, CLASSIC_CTRL_BUTTON_B, CLASSIC_CTRL_BUTTON_X, CLASSIC_CTRL_BUTTON_Y, CLASSIC_CTRL_BUTTON_ZL,
+  CLASSIC_CTRL_BUTTON_ZR, CLASSIC_CTRL_BUTTON_FULL_L, CLASSIC_CTRL_BUTTON_FULL_R, CLASSIC_CTRL_BUTTON_UP,
+  CLASSIC_CTRL_BUTTON_DOWN, CLASSIC_CTRL_BUTTON_LEFT, CLASSIC_CTRL_BUTTON_RIGHT, CLASSIC_CTRL_BUTTON_PLUS,
+  CLASSIC_CTRL_BUTTON_MINUS, CLASSIC_CTRL_BUTTON_HOME
+};
+
+static const unsigned short mock_gh3_buttons[] = {
+  GUITAR_HERO_3_BUTTON_GREEN, GUITAR_HERO_3_BUTTON_RED, GUITAR_HERO_3_BUTTON_YELLOW, GUITAR_HERO_3_BUTTON_BLUE,
+  GUITAR_HERO_3_BUTTON_ORANGE, GUITAR_HERO_3_BUTTON_STRUM_UP, GUITAR_HERO_3_BUTTON_STRUM_DOWN,
+  GUITAR_HERO_3_BUTTON_PLUS, GUITAR_HERO_3_BUTTON_MINUS
+};
+
+static unsigned long long mock_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long long) t.tv_sec * 1000000000ULL + (unsigned long long) t.tv_nsec;
+}
+
+static void mock_sleep(unsigned long long ns) {
+  struct timespec t;
+  t.tv_sec = ns / 1000000000ULL;
+  t.tv_nsec = ns % 1000000000ULL;
+  nanosleep(&t, NULL);
+}
+
+//reads the WII4R_MOCK_* environment variables
+static void mock_configure(void) {
+  const char *env;
+  double rate;
+
+  env = getenv("WII4R_MOCK_WIIMOTES");
+  mock_wiimotes = env ? atoi(env) : -1;
+
+  mock_period = 10000000ULL;
+  env = getenv("WII4R_MOCK_RATE");
+  if(env) {
+    rate = atof(env);
+    mock_period = rate > 0 ? (unsigned long long) (1e9 / rate) : 0;
+  }
+
+  mock_exp = EXP_NONE;
+  env = getenv("WII4R_MOCK_EXPANSION");
+  if(env) {
+    if(!strcmp(env, "nunchuk")) mock_exp = EXP_NUNCHUK;
+    else if(!strcmp(env, "classic")) mock_exp = EXP_CLASSIC;
+    else if(!strcmp(env, "guitar")) mock_exp = EXP_GUITAR_HERO_3;
+  }
+}
+
+//updates pressed / held / released like wiiuse does for a new report
+#define MOCK_BUTTONS(dev, type, now)			\
+  do {							\
+    type prev = (dev)->btns;				\
+    (dev)->btns = (now);				\
+    (dev)->btns_held = (dev)->btns & prev;		\
+    (dev)->btns_released = prev & ~((dev)->btns);	\
+  } while(0)
+
+//raw accelerometer value for "g" g
+static byte mock_raw(float g) {
+  int v = MOCK_ACC_ZERO + (int) (g * MOCK_ACC_G);
+  return (byte) (v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+//a wiimote (or nunchuk) slowly rotating around two axes
+static void mock_motion(float a, struct vec3b_t *accel, struct gforce_t *gforce, struct orient_t *orient) {
+  gforce->x = 0.5f * sinf(a);
+  gforce->y = 0.5f * cosf(a);
+  gforce->z = 0.8f + 0.2f * cosf(2 * a);
+  accel->x = mock_raw(gforce->x);
+  accel->y = mock_raw(gforce->y);
+  accel->z = mock_raw(gforce->z);
+  orient->roll = orient->a_roll = atan2f(gforce->x, gforce->z) * 180.0f / MOCK_PI;
+  orient->pitch = orient->a_pitch = atan2f(gforce->y, gforce->z) * 180.0f / MOCK_PI;
+  orient->yaw = 0;
+}
+
+static void mock_joystick(struct joystick_t *js, float a) {
+  js->ang = fmodf(a * 180.0f / MOCK_PI, 360.0f);
+  js->mag = 0.5f + 0.5f * sinf(a);
+}
+
+//fills "wm" with its next report
+static void mock_report(struct wiimote_t *wm) {
+  unsigned long phase = wm->mock.reports++ + (unsigned long) wm->unid * 7;
+  float a = (float) (phase % 200) * 2 * MOCK_PI / 200;
+  unsigned short pressed;
+  int i;
+
+  pressed = ((phase / 10) & 1) ? mock_buttons[(phase / 20) % (sizeof(mock_buttons) / sizeof(mock_buttons[0]))] : 0;
+  MOCK_BUTTONS(wm, unsigned short, pressed);
+
+  if(wm->state & MOCK_STATE_ACC) mock_motion(a, &(wm->accel), &(wm->gforce), &(wm->orient));
+
+  if(wm->state & MOCK_STATE_IR) {
+    unsigned int w = wm->ir.vres[0] ? wm->ir.vres[0] : 560;
+    unsigned int h = wm->ir.vres[1] ? wm->ir.vres[1] : 340;
+    wm->ir.ax = 512 + (int) (300 * cosf(a));
+    wm->ir.ay = 384 + (int) (200 * sinf(a));
+    wm->ir.x = (int) (w / 2) + (int) ((w / 3) * cosf(a));
+    wm->ir.y = (int) (h / 2) + (int) ((h / 3) * sinf(a));
+    wm->ir.z = 2.0f + 0.5f * sinf(a);
+    wm->ir.distance = 200.0f + 50.0f * sinf(a);
+    wm->ir.num_dots = 2;
+    for(i = 0; i < 4; i++) {
+      wm->ir.dot[i].visible = i < 2;
+      wm->ir.dot[i].x = i < 2 ? (unsigned int) (wm->ir.ax + (i ? 100 : -100)) : 0;
+      wm->ir.dot[i].y = i < 2 ? (unsigned int) wm->ir.ay : 0;
+      wm->ir.dot[i].rx = (short) wm->ir.dot[i].x;
+      wm->ir.dot[i].ry = (short) wm->ir.dot[i].y;
+      wm->ir.dot[i].order = (byte) i;
+      wm->ir.dot[i].size = i < 2 ? 3 : 0;
+    }
+    if(wm->state & MOCK_STATE_ACC) wm->orient.yaw = (wm->ir.ax - 512) / 10.0f;
+  }
+
+  switch(wm->exp.type) {
+    case EXP_NUNCHUK:
+      pressed = ((phase / 15) & 1) ? (((phase / 30) & 1) ? NUNCHUK_BUTTON_C : NUNCHUK_BUTTON_Z) : 0;
+      MOCK_BUTTONS(&(wm->exp.nunchuk), byte, (byte) pressed);
+      mock_motion(a + MOCK_PI / 2, &(wm->exp.nunchuk.accel), &(wm->exp.nunchuk.gforce), &(wm->exp.nunchuk.orient));
+      mock_joystick(&(wm->exp.nunchuk.js), a);
+      break;
+    case EXP_CLASSIC:
+      pressed = ((phase / 10) & 1) ? mock_classic_buttons[(phase / 20) % (sizeof(mock_classic_buttons) / sizeof(mock_classic_buttons[0]))] : 0;
+      MOCK_BUTTONS(&(wm->exp.classic), short, (short) pressed);
+      mock_joystick(&(wm->exp.classic.ljs), a);
+      mock_joystick(&(wm->exp.classic.rjs), -a);
+      wm->exp.classic.l_shoulder = 0.5f + 0.5f * sinf(a);
+      wm->exp.classic.r_shoulder = 0.5f + 0.5f * cosf(a);
+      break;
+    case EXP_GUITAR_HERO_3:
+      pressed = ((phase / 10) & 1) ? mock_gh3_buttons[(phase / 20) % (sizeof(mock_gh3_buttons) / sizeof(mock_gh3_buttons[0]))] : 0;
+      MOCK_BUTTONS(&(wm->exp.gh3), short, (short) pressed);
+      mock_joystick(&(wm->exp.gh3.js), a);
+      wm->exp.gh3.whammy_bar = 0.5f + 0.5f * sinf(a);
+      break;
+  }
+}
+
+//delivers the event "wm" has been waiting for, returns 0 if there was none
+static int mock_pending(struct wiimote_t *wm) {
+  if(!(wm->mock.pending)) return 0;
+  wm->event = (WIIUSE_EVENT_TYPE) wm->mock.pending;
+  switch(wm->mock.pending) {
+    case WIIUSE_NUNCHUK_INSERTED:
+      wm->exp.type = EXP_NUNCHUK;
+      wm->state |= MOCK_STATE_EXP;
+      break;
+    case WIIUSE_CLASSIC_CTRL_INSERTED:
+      wm->exp.type = EXP_CLASSIC;
+      wm->state |= MOCK_STATE_EXP;
+      break;
+    case WIIUSE_GUITAR_HERO_3_CTRL_INSERTED:
+      wm->exp.type = EXP_GUITAR_HERO_3;
+      wm->state |= MOCK_STATE_EXP;
+      break;
+  }
+  wm->mock.pending = WIIUSE_NONE;
+  return 1;
+}
+
+const char* wiiuse_version(void) {
+  return "0.12-mock";
+}
+
+struct wiimote_t** wiiuse_init(int wiimotes) {
+  struct wiimote_t **wm;
+  int i;
+  if(wiimotes <= 0) return NULL;
+  mock_configure();
+  wm = calloc(wiimotes, sizeof(struct wiimote_t *));
+  if(!wm) return NULL;
+  for(i = 0; i < wiimotes; i++) {
+    wm[i] = calloc(1, sizeof(struct wiimote_t));
+    if(!wm[i]) {
+      wiiuse_cleanup(wm, i);
+      return NULL;
+    }
+    wm[i]->unid = i + 1;
+    wm[i]->out_sock = -1;
+    wm[i]->in_sock = -1;
+    wm[i]->flags = WIIUSE_INIT_FLAGS;
+    wm[i]->event = WIIUSE_NONE;
+    wm[i]->orient_threshold = 0.5f;
+    wm[i]->accel_threshold = 5;
+    wm[i]->accel_calib.cal_zero.x = wm[i]->accel_calib.cal_zero.y = wm[i]->accel_calib.cal_zero.z = MOCK_ACC_ZERO;
+    wm[i]->accel_calib.cal_g.x = wm[i]->accel_calib.cal_g.y = wm[i]->accel_calib.cal_g.z = MOCK_ACC_G;
+  }
+  return wm;
+}
+
+void wiiuse_cleanup(struct wiimote_t** wm, int wiimotes) {
+  int i;
+  if(!wm) return;
+  for(i = 0; i < wiimotes; i++) {
+    wiiuse_disconnect(wm[i]);
+    free(wm[i]);
+  }
+  free(wm);
+}
+
+int wiiuse_find(struct wiimote_t** wm, int max_wiimotes, int timeout) {
+  int i, found = 0, in_range = max_wiimotes;
+  if(mock_wiimotes >= 0 && mock_wiimotes < in_range) in_range = mock_wiimotes;
+  for(i = 0; i < in_range; i++) {
+    if(MOCK_IS_CONNECTED(wm[i])) continue;
+    wm[i]->state |= MOCK_STATE_DEV_FOUND;
+    found++;
+  }
+  return found;
+}
+
+int wiiuse_connect(struct wiimote_t** wm, int wiimotes) {
+  int i, connected = 0;
+  for(i = 0; i < wiimotes; i++) {
+    if(!(wm[i]->state & MOCK_STATE_DEV_FOUND) || MOCK_IS_CONNECTED(wm[i])) continue;
+    wm[i]->state |= MOCK_STATE_CONNECTED | MOCK_STATE_HANDSHAKE | MOCK_STATE_HANDSHAKE_COMPLETE;
+    wm[i]->battery_level = 0.85f;
+    wm[i]->mock.reports = 0;
+    wm[i]->mock.next_report = 0;
+    switch(mock_exp) {
+      case EXP_NUNCHUK:
+        wm[i]->mock.pending = WIIUSE_NUNCHUK_INSERTED;
+        break;
+      case EXP_CLASSIC:
+        wm[i]->mock.pending = WIIUSE_CLASSIC_CTRL_INSERTED;
+        break;
+      case EXP_GUITAR_HERO_3:
+        wm[i]->mock.pending = WIIUSE_GUITAR_HERO_3_CTRL_INSERTED;
+        break;
+    }
+    connected++;
+  }
+  return connected;
+}
+
+void wiiuse_disconnect(struct wiimote_t* wm) {
+  if(!wm || !MOCK_IS_CONNECTED(wm)) return;
+  wm->state &= ~(MOCK_STATE_CONNECTED | MOCK_STATE_HANDSHAKE | MOCK_STATE_HANDSHAKE_COMPLETE);
+  wm->event = WIIUSE_NONE;
+}
+
+void wiiuse_disconnected(struct wiimote_t* wm) {
+  if(!wm) return;
+  wm->state &= ~(MOCK_STATE_CONNECTED | MOCK_STATE_HANDSHAKE | MOCK_STATE_HANDSHAKE_COMPLETE);
+  wm->event = WIIUSE_DISCONNECT;
+}
+
+int wiiuse_poll(struct wiimote_t** wm, int wiimotes) {
+  unsigned long long now, wait;
+  int i, events, connected, waited = 0;
+  if(!wm) return 0;
+
+  for(;;) {
+    now = mock_now();
+    wait = MOCK_POLL_TIMEOUT;
+    events = connected = 0;
+    for(i = 0; i < wiimotes; i++) {
+      wm[i]->event = WIIUSE_NONE;
+      if(!MOCK_IS_CONNECTED(wm[i])) continue;
+      connected++;
+      if(mock_pending(wm[i])) {
+        events++;
+        continue;
+      }
+      if(mock_period && now < wm[i]->mock.next_report) {
+        if(wm[i]->mock.next_report - now < wait) wait = wm[i]->mock.next_report - now;
+        continue;
+      }
+      mock_report(wm[i]);
+      wm[i]->event = WIIUSE_EVENT;
+      events++;
+      //a wiimote late by more than one report skips them, like a real one would not queue them
+      wm[i]->mock.next_report += mock_period;
+      if(wm[i]->mock.next_report < now) wm[i]->mock.next_report = now + mock_period;
+    }
+    //like wiiuse, there is nothing to wait for without a connected wiimote
+    if(events || waited || !connected) return events;
+    mock_sleep(wait);
+    waited = 1;
+  }
+}
+
+void wiiuse_rumble(struct wiimote_t* wm, int status) {
+  if(!wm || !MOCK_IS_CONNECTED(wm)) return;
+  if(status) wm->state |= MOCK_STATE_RUMBLE;
+  else wm->state &= ~MOCK_STATE_RUMBLE;
+}
+
+void wiiuse_toggle_rumble(struct wiimote_t* wm) {
+  if(!wm) return;
+  wiiuse_rumble(wm, !(wm->state & MOCK_STATE_RUMBLE));
+}
+
+void wiiuse_set_leds(struct wiimote_t* wm, int leds) {
+  if(!wm || !MOCK_IS_CONNECTED(wm)) return;
+  wm->leds = (byte) (leds & 0xF0);
+}
+
+void wiiuse_motion_sensing(struct wiimote_t* wm, int status) {
+  if(!wm) return;
+  if(status) wm->state |= MOCK_STATE_ACC;
+  else wm->state &= ~MOCK_STATE_ACC;
+}
+
+int wiiuse_read_data(struct wiimote_t* wm, byte* buffer, unsigned int offset, unsigned short len) {
+  if(!wm || !MOCK_IS_CONNECTED(wm) || !buffer) return 0;
+  memset(buffer, 0, len);
+  wm->mock.pending = WIIUSE_READ_DATA;
+  return 1;
+}
+
+int wiiuse_write_data(struct wiimote_t* wm, unsigned int addr, byte* data, byte len) {
+  if(!wm || !MOCK_IS_CONNECTED(wm) || !data) return 0;
+  return 1;
+}
+
+void wiiuse_status(struct wiimote_t* wm) {
+  if(!wm || !MOCK_IS_CONNECTED(wm)) return;
+  wm->mock.pending = WIIUSE_STATUS;
+}
+
+struct wiimote_t* wiiuse_get_by_id(struct wiimote_t** wm, int wiimotes, int unid) {
+  int i;
+  for(i = 0; i < wiimotes; i++)
+    if(wm[i]->unid == unid) return wm[i];
+  return NULL;
+}
+
+int wiiuse_set_flags(struct wiimote_t* wm, int enable, int disable) {
+  if(!wm) return 0;
+  wm->flags |= enable;
+  wm->flags &= ~disable;
+  return wm->flags;
+}
+
+float wiiuse_set_smooth_alpha(struct wiimote_t* wm, float alpha) {
+  float old;
+  if(!wm) return 0.0f;
+  old = wm->accel_calib.st_alpha;
+  wm->accel_calib.st_alpha = alpha;
+  return old;
+}
+
+void wiiuse_set_bluetooth_stack(struct wiimote_t** wm, int wiimotes, enum win_bt_stack_t type) {
+}
+
+void wiiuse_set_orient_threshold(struct wiimote_t* wm, float threshold) {
+  if(wm) wm->orient_threshold = threshold;
+}
+
+void wiiuse_resync(struct wiimote_t* wm) {
+}
+
+void wiiuse_set_timeout(struct wiimote_t** wm, int wiimotes, byte normal_timeout, byte exp_timeout) {
+}
+
+void wiiuse_set_accel_threshold(struct wiimote_t* wm, int threshold) {
+  if(wm) wm->accel_threshold = threshold;
+}
+
+void wiiuse_set_ir(struct wiimote_t* wm, int status) {
+  if(!wm) return;
+  if(status) {
+    wm->state |= MOCK_STATE_IR;
+    if(!(wm->state & MOCK_STATE_IR_SENS_ALL)) wm->state |= MOCK_STATE_IR_SENS_LVL1 << 2;
+  }
+  else wm->state &= ~MOCK_STATE_IR;
+}
+
+void wiiuse_set_ir_vres(struct wiimote_t* wm, unsigned int x, unsigned int y) {
+  if(!wm) return;
+  wm->ir.vres[0] = x - 1;
+  wm->ir.vres[1] = y - 1;
+}
+
+void wiiuse_set_ir_position(struct wiimote_t* wm, enum ir_position_t pos) {
+  if(wm) wm->ir.pos = pos;
+}
+
+void wiiuse_set_aspect_ratio(struct wiimote_t* wm, enum aspect_t aspect) {
+  if(wm) wm->ir.aspect = aspect;
+}
+
+void wiiuse_set_ir_sensitivity(struct wiimote_t* wm, int level) {
+  if(!wm) return;
+  if(level > 5) level = 5;
+  if(level < 1) level = 1;
+  wm->state &= ~MOCK_STATE_IR_SENS_ALL;
+  wm->state |= MOCK_STATE_IR_SENS_LVL1 << (level - 1);
+}
+
+void wiiuse_set_nunchuk_orient_threshold(struct wiimote_t* wm, float threshold) {
+  if(wm) wm->exp.nunchuk.orient_threshold = threshold;
+}
+
+void wiiuse_set_nunchuk_accel_threshold(struct wiimote_t* wm, int threshold) {
+  if(wm) wm->exp.nunchuk.accel_threshold = threshold;
+}
+
+void wiiuse_set_speaker(struct wiimote_t* wm, int status) {
+  if(!wm || !MOCK_IS_CONNECTED(wm)) return;
+  if(status) wm->state |= MOCK_STATE_SPEAKER;
+  else wm->state &= ~(MOCK_STATE_SPEAKER | MOCK_STATE_SPEAKER_MUTE);
+}
+
+void wiiuse_mute_speaker(struct wiimote_t* wm, int status) {
+  if(!wm || !(wm->state & MOCK_STATE_SPEAKER)) return;
+  if(status) wm->state |= MOCK_STATE_SPEAKER_MUTE;
+  else wm->state &= ~MOCK_STATE_SPEAKER_MUTE;
+}
+
+void wiiuse_play_sound(struct wiimote_t* wm, byte* data, int len) {
+  if(!wm || !data || len <= 0 || !(wm->state & MOCK_STATE_SPEAKER)) return;
+  wm->mock.sound_bytes += (unsigned long) len;
+}
+
+byte* wiiuse_convert_wav(const char* path, int divisor) {
+  return NULL;
+}
@@ -23,6 +23,9 @@
 
 #include "wii4r.h"
 
+//wiimote of a nunchuk, resolved once by init_nunchuk
+static ID id_wiimote;
+
 /*
  *  call-seq:
  *	nunchuk.pressed?(button)	-> true or false
@@ -99,6 +102,66 @@ static VALUE rb_nun_rel(VALUE self, VALUE arg) {
     return Qfalse;
 }
 
+/*
+ * call-seq:
+ *	nunchuk.buttons	-> int
+ *
+ * Returns the bitmask of the buttons being pressed on <i>self</i> (N_BUTTON_* constants, or'ed).
+ *
+ */
+
+static VALUE rb_nun_buttons(VALUE self) {
+  nunchuk_t *nun;
+  Data_Get_Struct(self, nunchuk_t, nun);
+  if(!nun) return Qnil;
+  return INT2NUM(nun->btns);
+}
+
+/*
+ * call-seq:
+ *	nunchuk.buttons_pressed	-> int
+ *
+ * Returns the bitmask of the buttons just pressed on <i>self</i>, the ones for which just_pressed? is true.
+ *
+ */
+
+static VALUE rb_nun_buttons_pressed(VALUE self) {
+  nunchuk_t *nun;
+  Data_Get_Struct(self, nunchuk_t, nun);
+  if(!nun) return Qnil;
+  return INT2NUM(nun->btns & ~(nun->btns_held));
+}
+
+/*
+ * call-seq:
+ *	nunchuk.buttons_held	-> int
+ *
+ * Returns the bitmask of the buttons being held on <i>self</i>.
+ *
+ */
+
+static VALUE rb_nun_buttons_held(VALUE self) {
+  nunchuk_t *nun;
+  Data_Get_Struct(self, nunchuk_t, nun);
+  if(!nun) return Qnil;
+  return INT2NUM(nun->btns_held);
+}
+
+/*
+ * call-seq:
+ *	nunchuk.buttons_released	-> int
+ *
+ * Returns the bitmask of the buttons just released on <i>self</i>.
+ *
+ */
+
+static VALUE rb_nun_buttons_released(VALUE self) {
+  nunchuk_t *nun;
+  Data_Get_Struct(self, nunchuk_t, nun);
+  if(!nun) return Qnil;
+  return INT2NUM(nun->btns_released);
+}
+
 /*
  * call-seq:
  *	nunchuk.pitch	-> float
@@ -169,42 +232,46 @@ static VALUE rb_nun_aroll(VALUE self) {
 
 /*
  * call-seq:
- *	nunchuk.acceleration	-> array
+ *	nunchuk.acceleration		-> array
+ *	nunchuk.acceleration(buf)	-> buf
  *
  * Returns an array containing the three components of acceleration [x, y, z] of <i>self</i>.
+ * If <i>buf</i> is given, it is overwritten with [x, y, z] and no new array is created.
  *
  */
 
-static VALUE rb_nun_accel(VALUE self) {
+static VALUE rb_nun_accel(int argc, VALUE * argv, VALUE self) {
   nunchuk_t *nun;
+  VALUE buf = wii_into(argc, argv);
+  VALUE xyz[3];
   Data_Get_Struct(self, nunchuk_t, nun);
-  VALUE ary = rb_ary_new();
-  if(nun) {
-    rb_ary_push(ary, INT2NUM(nun->accel.x));
-    rb_ary_push(ary, INT2NUM(nun->accel.y));
-    rb_ary_push(ary, INT2NUM(nun->accel.z));
-  }
-  return ary;
+  if(!nun) return wii_fill(buf, 0, xyz);
+  xyz[0] = INT2NUM(nun->accel.x);
+  xyz[1] = INT2NUM(nun->accel.y);
+  xyz[2] = INT2NUM(nun->accel.z);
+  return wii_fill(buf, 3, xyz);
 }
 
 /*
  * call-seq:
- *	nunchuk.gravity_force	-> array
+ *	nunchuk.gravity_force			-> array
+ *	nunchuk.gravity_force(buf)	-> buf
  *
  * Returns an array containing the three components of gravity force [x, y, z] of <i>self</i>.
+ * If <i>buf</i> is given, it is overwritten with [x, y, z] and no new array is created.
  *
  */
  
-static VALUE rb_nun_gforce(VALUE self) {
+static VALUE rb_nun_gforce(int argc, VALUE * argv, VALUE self) {
   nunchuk_t *nun;
+  VALUE buf = wii_into(argc, argv);
+  VALUE xyz[3];
   Data_Get_Struct(self, nunchuk_t, nun);
-  VALUE ary = rb_ary_new();
-  if(nun) {
-    rb_ary_push(ary, INT2NUM(nun->gforce.x));
-    rb_ary_push(ary, INT2NUM(nun->gforce.y));
-    rb_ary_push(ary, INT2NUM(nun->gforce.z));
-  }
-  return ary;
+  if(!nun) return wii_fill(buf, 0, xyz);
+  xyz[0] = rb_float_new(nun->gforce.x);
+  xyz[1] = rb_float_new(nun->gforce.y);
+  xyz[2] = rb_float_new(nun->gforce.z);
+  return wii_fill(buf, 3, xyz);
 }
 
 /*
@@ -281,6 +348,20 @@ static VALUE rb_nun_jmag(VALUE self) {
   return rb_float_new(nun->js.mag);
 }
 
+/*
+ * call-seq:
+ *	nunchuk.window_stats(target)		-> hash or nil
+ *	nunchuk.window_stats(target, ms: ms)	-> hash or nil
+ *
+ * Returns the statistics of the <i>target</i> (:accel or :gforce) of <i>self</i> over the last <i>ms</i> milliseconds,
+ * from the history of its wiimote (see <code>Wiimote#history=</code> and <code>Wiimote#window_stats</code>).
+ *
+ */
+
+static VALUE rb_nun_window_stats(int argc, VALUE * argv, VALUE self) {
+  return wm_window_stats(rb_attr_get(self, id_wiimote), 1, argc, argv);
+}
+
 /*
  * Provides a set of methods for accessing Nunchuk properties and members.
  *	- button events (pressed, just pressed, released, held)
@@ -291,20 +372,26 @@ static VALUE rb_nun_jmag(VALUE self) {
  */
 
 void init_nunchuk() {
+  id_wiimote = rb_intern("@wiimote");
   nun_class = rb_define_class_under(wii_class, "Nunchuk", rb_cObject);
   
   rb_define_method(nun_class, "pressed?", rb_nun_pressed, 1);
   rb_define_method(nun_class, "just_pressed?", rb_nun_jpressed, 1);
   rb_define_method(nun_class, "held?", rb_nun_held, 1);
   rb_define_method(nun_class, "released?", rb_nun_rel, 1);
+  rb_define_method(nun_class, "buttons", rb_nun_buttons, 0);
+  rb_define_method(nun_class, "buttons_pressed", rb_nun_buttons_pressed, 0);
+  rb_define_method(nun_class, "buttons_held", rb_nun_buttons_held, 0);
+  rb_define_method(nun_class, "buttons_released", rb_nun_buttons_released, 0);
   rb_define_method(nun_class, "roll", rb_nun_roll, 0);
   rb_define_method(nun_class, "absolute_roll", rb_nun_aroll, 0);
   rb_define_method(nun_class, "pitch", rb_nun_pitch, 0);
   rb_define_method(nun_class, "absolute_pitch", rb_nun_apitch, 0);
-  rb_define_method(nun_class, "acceleration", rb_nun_accel, 0);
-  rb_define_method(nun_class, "gravity_force", rb_nun_gforce, 0);
+  rb_define_method(nun_class, "acceleration", rb_nun_accel, -1);
+  rb_define_method(nun_class, "gravity_force", rb_nun_gforce, -1);
   rb_define_method(nun_class, "orient_threshold", rb_nun_othreshold, 0);
   rb_define_method(nun_class, "accel_thresold", rb_nun_athreshold, 0);
   rb_define_method(nun_class, "joystick_angle", rb_nun_jangle, 0);
   rb_define_method(nun_class, "joystick_magnitude", rb_nun_jmag, 0);
+  rb_define_method(nun_class, "window_stats", rb_nun_window_stats, -1);
 }
@@ -0,0 +1,220 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+
+//WII4R_NO_SIMD (extconf.rb --disable-simd) keeps the scalar code only
+#ifdef WII4R_NO_SIMD
+#undef __AVX2__
+#undef __SSE2__
+#endif
+
+#if defined(__AVX2__)
+#include<immintrin.h>
+#elif defined(__SSE2__)
+#include<emmintrin.h>
+#endif
+
+//conversion of the samples read for the speaker to mono 16 bit, and sums for the resampler.
+//The vector paths are little endian only, as the x86 they are compiled for
+
+const char * pcm_simd(void) {
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE2__)
+  return "sse2";
+#else
+  return "none";
+#endif
+}
+
+int pcm_sample_size(int format) {
+  switch(format) {
+    case PCM_U8: return 1;
+    case PCM_S16: return 2;
+    case PCM_S24: return 3;
+    default: return 4;
+  }
+}
+
+//one sample to 16 bit
+static int pcm_sample(const byte *b, int format) {
+  union { uint32_t u; float f; } v;
+  float f;
+  switch(format) {
+    case PCM_U8: return (b[0] - 128) * 256;
+    case PCM_S16: return (int16_t) (b[0] | (b[1] << 8));
+    case PCM_S24: return (int16_t) (b[1] | (b[2] << 8));
+    case PCM_S32: return (int16_t) (b[2] | (b[3] << 8));
+    default:
+      v.u = (uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24);
+      f = v.f * 32768.0f;
+      if(!(f > -32768.0f)) return -32768;
+      if(f > 32767.0f) return 32767;
+      return (int) f;
+  }
+}
+
+static void pcm_scalar(int16_t *dst, const byte *src, long frames, int channels, int format) {
+  int size = pcm_sample_size(format);
+  long i;
+  if(channels == 1) {
+    for(i = 0; i < frames; i++, src += size)
+      dst[i] = (int16_t) pcm_sample(src, format);
+  }
+  else {
+    for(i = 0; i < frames; i++, src += 2 * size)
+      dst[i] = (int16_t) ((pcm_sample(src, format) + pcm_sample(src + size, format)) >> 1);
+  }
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+
+//8 frames of 16 bit stereo to mono: (l + r) >> 1
+static inline __m128i pcm_mix8(__m128i a, __m128i b) {
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i lo = _mm_srai_epi32(_mm_madd_epi16(a, ones), 1);
+  __m128i hi = _mm_srai_epi32(_mm_madd_epi16(b, ones), 1);
+  return _mm_packs_epi32(lo, hi);
+}
+
+//4 float samples to 32 bit integers in the 16 bit range
+static inline __m128i pcm_float4(const byte *src, __m128 scale) {
+  __m128 f = _mm_mul_ps(_mm_loadu_ps((const float *) src), scale);
+  f = _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+  return _mm_cvttps_epi32(f);
+}
+
+//16 samples of "format" to 16 bit
+static inline void pcm_load16(__m128i *a, __m128i *b, const byte *src, int format) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  __m128i v;
+  switch(format) {
+    case PCM_U8:
+      v = _mm_loadu_si128((const __m128i *) src);
+      *a = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(v, zero), bias), 8);
+      *b = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(v, zero), bias), 8);
+      break;
+    case PCM_S16:
+      *a = _mm_loadu_si128((const __m128i *) src);
+      *b = _mm_loadu_si128((const __m128i *) (src + 16));
+      break;
+    case PCM_S32:
+      *a = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i *) src), 16),
+                           _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (src + 16)), 16));
+      *b = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i *) (src + 32)), 16),
+                           _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (src + 48)), 16));
+      break;
+    default:
+      //PCM_F32, clamped as pcm_sample does (NaN included) and truncated
+      *a = _mm_packs_epi32(pcm_float4(src, scale), pcm_float4(src + 16, scale));
+      *b = _mm_packs_epi32(pcm_float4(src + 32, scale), pcm_float4(src + 48, scale));
+      break;
+  }
+}
+
+#endif
+
+void pcm_to_mono(int16_t *dst, const byte *src, long frames, int channels, int format) {
+#if defined(__SSE2__) || defined(__AVX2__)
+  int size = pcm_sample_size(format);
+  long i = 0;
+  __m128i a, b, c, d;
+  if(format != PCM_S24) {
+    if(channels == 1) {
+      for(; i + 16 <= frames; i += 16) {
+        pcm_load16(&a, &b, src + i * size, format);
+        _mm_storeu_si128((__m128i *) (dst + i), a);
+        _mm_storeu_si128((__m128i *) (dst + i + 8), b);
+      }
+    }
+    else {
+#if defined(__AVX2__)
+      if(format == PCM_S16) {
+        const __m256i ones = _mm256_set1_epi16(1);
+        for(; i + 16 <= frames; i += 16) {
+          __m256i lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (src + 4 * i)), ones), 1);
+          __m256i hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (src + 4 * i + 32)), ones), 1);
+          //packs works on 128 bit lanes: put the frames back in order
+          _mm256_storeu_si256((__m256i *) (dst + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+        }
+      }
+#endif
+      for(; i + 16 <= frames; i += 16) {
+        pcm_load16(&a, &b, src + 2 * i * size, format);
+        pcm_load16(&c, &d, src + (2 * i + 16) * size, format);
+        _mm_storeu_si128((__m128i *) (dst + i), pcm_mix8(a, b));
+        _mm_storeu_si128((__m128i *) (dst + i + 8), pcm_mix8(c, d));
+      }
+    }
+  }
+  pcm_scalar(dst + i, src + i * channels * size, frames - i, channels, format);
+#else
+  pcm_scalar(dst, src, frames, channels, format);
+#endif
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+
+static inline int32_t pcm_hsum(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+  return _mm_cvtsi128_si32(v);
+}
+
+#endif
+
+int64_t pcm_sum(const int16_t *x, long n) {
+  int64_t sum = 0;
+  long i = 0;
+#if defined(__AVX2__)
+  long end;
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc;
+  //a 32 bit lane gets 2 samples at a time: blocks of 32768 samples can't overflow it
+  while(n - i >= 16) {
+    end = i + ((n - i > 32768 ? 32768 : n - i) & ~15L);
+    acc = _mm256_setzero_si256();
+    for(; i < end; i += 16)
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (x + i)), ones));
+    sum += pcm_hsum(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+  }
+#elif defined(__SSE2__)
+  long end;
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i acc;
+  while(n - i >= 8) {
+    end = i + ((n - i > 32768 ? 32768 : n - i) & ~7L);
+    acc = _mm_setzero_si128();
+    for(; i < end; i += 8)
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (x + i)), ones));
+    sum += pcm_hsum(acc);
+  }
+#endif
+  for(; i < n; i++) sum += x[i];
+  return sum;
+}
@@ -0,0 +1,344 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+#include "wii4r.h"
+#include<string.h>
+#include<time.h>
+
+//sleep of the poller thread after a poll without events, in ns: wiiuse_poll returns at once when no wiimote is connected
+#define POLLER_IDLE_WAIT	1000000L
+
+//WiimoteManager::EVENT_FORMAT describes exactly 128 bytes
+typedef char wii_event_size_check[sizeof(wii_event) == 128 ? 1 : -1];
+
+uint64_t wii_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec * 1000000000ULL + (uint64_t) t.tv_nsec;
+}
+
+void wii_event_fill(wii_event *ev, wiimote *wm, int slot, uint64_t ts) {
+  int i;
+  memset(ev, 0, sizeof(wii_event));
+  ev->ts = ts;
+  ev->slot = (uint8_t) slot;
+  ev->type = (uint8_t) wm->event;
+  ev->exp = (uint8_t) wm->exp.type;
+  if(WIIUSE_USING_ACC(wm)) ev->flags |= WII_EV_ACC;
+  if(WIIUSE_USING_IR(wm)) ev->flags |= WII_EV_IR;
+  if(wm->exp.type != EXP_NONE) ev->flags |= WII_EV_EXP;
+
+  ev->btns = wm->btns;
+  ev->btns_held = wm->btns_held;
+  ev->btns_released = wm->btns_released;
+  ev->accel[0] = wm->accel.x;
+  ev->accel[1] = wm->accel.y;
+  ev->accel[2] = wm->accel.z;
+  ev->gforce[0] = wm->gforce.x;
+  ev->gforce[1] = wm->gforce.y;
+  ev->gforce[2] = wm->gforce.z;
+  ev->orient[0] = wm->orient.roll;
+  ev->orient[1] = wm->orient.pitch;
+  ev->orient[2] = wm->orient.yaw;
+
+  ev->ir[0] = (int16_t) wm->ir.x;
+  ev->ir[1] = (int16_t) wm->ir.y;
+  ev->ir_abs[0] = (int16_t) wm->ir.ax;
+  ev->ir_abs[1] = (int16_t) wm->ir.ay;
+  ev->ir_z = wm->ir.z;
+  for(i = 0; i < 4; i++) {
+    if(wm->ir.dot[i].visible) ev->dots |= (1 << i);
+    ev->dot[2 * i] = (uint16_t) wm->ir.dot[i].x;
+    ev->dot[2 * i + 1] = (uint16_t) wm->ir.dot[i].y;
+  }
+
+  switch(wm->exp.type) {
+    case EXP_NUNCHUK:
+      ev->exp_btns = wm->exp.nunchuk.btns;
+      ev->exp_btns_held = wm->exp.nunchuk.btns_held;
+      ev->exp_btns_released = wm->exp.nunchuk.btns_released;
+      ev->exp_accel[0] = wm->exp.nunchuk.accel.x;
+      ev->exp_accel[1] = wm->exp.nunchuk.accel.y;
+      ev->exp_accel[2] = wm->exp.nunchuk.accel.z;
+      ev->exp_gforce[0] = wm->exp.nunchuk.gforce.x;
+      ev->exp_gforce[1] = wm->exp.nunchuk.gforce.y;
+      ev->exp_gforce[2] = wm->exp.nunchuk.gforce.z;
+      ev->exp_orient[0] = wm->exp.nunchuk.orient.roll;
+      ev->exp_orient[1] = wm->exp.nunchuk.orient.pitch;
+      ev->js[0] = wm->exp.nunchuk.js.ang;
+      ev->js[1] = wm->exp.nunchuk.js.mag;
+      break;
+    case EXP_CLASSIC:
+      ev->exp_btns = (uint16_t) wm->exp.classic.btns;
+      ev->exp_btns_held = (uint16_t) wm->exp.classic.btns_held;
+      ev->exp_btns_released = (uint16_t) wm->exp.classic.btns_released;
+      ev->js[0] = wm->exp.classic.ljs.ang;
+      ev->js[1] = wm->exp.classic.ljs.mag;
+      ev->js[2] = wm->exp.classic.rjs.ang;
+      ev->js[3] = wm->exp.classic.rjs.mag;
+      ev->analog[0] = wm->exp.classic.l_shoulder;
+      ev->analog[1] = wm->exp.classic.r_shoulder;
+      break;
+    case EXP_GUITAR_HERO_3:
+      ev->exp_btns = (uint16_t) wm->exp.gh3.btns;
+      ev->exp_btns_held = (uint16_t) wm->exp.gh3.btns_held;
+      ev->exp_btns_released = (uint16_t) wm->exp.gh3.btns_released;
+      ev->js[0] = wm->exp.gh3.js.ang;
+      ev->js[1] = wm->exp.gh3.js.mag;
+      ev->analog[0] = wm->exp.gh3.whammy_bar;
+      break;
+  }
+}
+
+//state bits of a wiimote structure restored by wii_event_apply
+#define WII_STATE_ACC		0x020
+#define WII_STATE_EXP		0x040
+#define WII_STATE_IR		0x080
+
+void wii_event_apply(wiimote *wm, const wii_event *ev) {
+  int i;
+  wm->event = (WIIUSE_EVENT_TYPE) ev->type;
+  wm->state &= ~(WII_STATE_ACC | WII_STATE_EXP | WII_STATE_IR);
+  if(ev->flags & WII_EV_ACC) wm->state |= WII_STATE_ACC;
+  if(ev->flags & WII_EV_IR) wm->state |= WII_STATE_IR;
+  if(ev->flags & WII_EV_EXP) wm->state |= WII_STATE_EXP;
+
+  wm->btns = ev->btns;
+  wm->btns_held = ev->btns_held;
+  wm->btns_released = ev->btns_released;
+  wm->accel.x = ev->accel[0];
+  wm->accel.y = ev->accel[1];
+  wm->accel.z = ev->accel[2];
+  wm->gforce.x = ev->gforce[0];
+  wm->gforce.y = ev->gforce[1];
+  wm->gforce.z = ev->gforce[2];
+  wm->orient.roll = wm->orient.a_roll = ev->orient[0];
+  wm->orient.pitch = wm->orient.a_pitch = ev->orient[1];
+  wm->orient.yaw = ev->orient[2];
+
+  wm->ir.x = ev->ir[0];
+  wm->ir.y = ev->ir[1];
+  wm->ir.ax = ev->ir_abs[0];
+  wm->ir.ay = ev->ir_abs[1];
+  wm->ir.z = ev->ir_z;
+  wm->ir.num_dots = 0;
+  for(i = 0; i < 4; i++) {
+    wm->ir.dot[i].visible = (ev->dots >> i) & 1;
+    wm->ir.dot[i].x = ev->dot[2 * i];
+    wm->ir.dot[i].y = ev->dot[2 * i + 1];
+    wm->ir.num_dots += wm->ir.dot[i].visible;
+  }
+
+  wm->exp.type = ev->exp;
+  switch(ev->exp) {
+    case EXP_NUNCHUK:
+      wm->exp.nunchuk.btns = (byte) ev->exp_btns;
+      wm->exp.nunchuk.btns_held = (byte) ev->exp_btns_held;
+      wm->exp.nunchuk.btns_released = (byte) ev->exp_btns_released;
+      wm->exp.nunchuk.accel.x = ev->exp_accel[0];
+      wm->exp.nunchuk.accel.y = ev->exp_accel[1];
+      wm->exp.nunchuk.accel.z = ev->exp_accel[2];
+      wm->exp.nunchuk.gforce.x = ev->exp_gforce[0];
+      wm->exp.nunchuk.gforce.y = ev->exp_gforce[1];
+      wm->exp.nunchuk.gforce.z = ev->exp_gforce[2];
+      wm->exp.nunchuk.orient.roll = wm->exp.nunchuk.orient.a_roll = ev->exp_orient[0];
+      wm->exp.nunchuk.orient.pitch = wm->exp.nunchuk.orient.a_pitch = ev->exp_orient[1];
+      wm->exp.nunchuk.js.ang = ev->js[0];
+      wm->exp.nunchuk.js.mag = ev->js[1];
+      break;
+    case EXP_CLASSIC:
+      wm->exp.classic.btns = (short) ev->exp_btns;
+      wm->exp.classic.btns_held = (short) ev->exp_btns_held;
+      wm->exp.classic.btns_released = (short) ev->exp_btns_released;
+      wm->exp.classic.ljs.ang = ev->js[0];
+      wm->exp.classic.ljs.mag = ev->js[1];
+      wm->exp.classic.rjs.ang = ev->js[2];
+      wm->exp.classic.rjs.mag = ev->js[3];
+      wm->exp.classic.l_shoulder = ev->analog[0];
+      wm->exp.classic.r_shoulder = ev->analog[1];
+      break;
+    case EXP_GUITAR_HERO_3:
+      wm->exp.gh3.btns = (short) ev->exp_btns;
+      wm->exp.gh3.btns_held = (short) ev->exp_btns_held;
+      wm->exp.gh3.btns_released = (short) ev->exp_btns_released;
+      wm->exp.gh3.js.ang = ev->js[0];
+      wm->exp.gh3.js.mag = ev->js[1];
+      wm->exp.gh3.whammy_bar = ev->analog[0];
+      break;
+  }
+}
+
+void latency_add(latency_hist *hist, uint64_t ns) {
+  uint64_t us = ns / 1000;
+  int bucket = us ? 64 - __builtin_clzll(us) : 0;
+  if(bucket >= WII_LATENCY_BUCKETS) bucket = WII_LATENCY_BUCKETS - 1;
+  __atomic_store_n(&(hist->buckets[bucket]), hist->buckets[bucket] + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&(hist->sum), hist->sum + ns, __ATOMIC_RELAXED);
+  if(ns > hist->max) __atomic_store_n(&(hist->max), ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&(hist->count), hist->count + 1, __ATOMIC_RELEASE);
+}
+
+int wii_poll(connman *conn) {
+  int events;
+  //the effects and speaker threads call wiiuse on the same wiimotes
+  pthread_mutex_lock(&(conn->io_lock));
+  if(conn->source) events = conn->source->poll(conn);
+  else events = wiiuse_poll(conn->wms, conn->n);
+  pthread_mutex_unlock(&(conn->io_lock));
+  return events;
+}
+
+//conn->state is guarded by a sequence counter: a reader retries while it is odd or changed under its copy
+void state_refresh(connman *conn, uint64_t ts) {
+  uint64_t decoded;
+  int i;
+  __atomic_add_fetch(&conn->state_seq, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for(i = 0; i < conn->n; i++) {
+    if(conn->wms[i]->event != WIIUSE_NONE)
+      wii_event_fill(&(conn->state[i]), conn->wms[i], i, ts);
+  }
+  __atomic_add_fetch(&conn->state_seq, 1, __ATOMIC_RELEASE);
+  decoded = wii_now();
+  for(i = 0; i < conn->n; i++) {
+    if(conn->wms[i]->event != WIIUSE_NONE)
+      latency_add(&(conn->latency[i].decode), decoded - ts);
+  }
+  if(__atomic_load_n(&conn->capture, __ATOMIC_RELAXED)) capture_write(conn);
+}
+
+void state_read(connman *conn, wii_event *dst) {
+  uint32_t before, after;
+  do {
+    before = __atomic_load_n(&conn->state_seq, __ATOMIC_ACQUIRE);
+    memcpy(dst, conn->state, conn->n * sizeof(wii_event));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&conn->state_seq, __ATOMIC_RELAXED);
+  } while((before & 1) || before != after);
+}
+
+void state_read_slot(connman *conn, int slot, wii_event *dst) {
+  uint32_t before, after;
+  do {
+    before = __atomic_load_n(&conn->state_seq, __ATOMIC_ACQUIRE);
+    *dst = conn->state[slot];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&conn->state_seq, __ATOMIC_RELAXED);
+  } while((before & 1) || before != after);
+}
+
+int ring_push(event_ring *ring, const wii_event *ev) {
+  uint32_t head = ring->head;
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if(head - tail > ring->mask) {
+    __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  ring->buf[head & ring->mask] = *ev;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int ring_pop(event_ring *ring, wii_event *ev) {
+  uint32_t tail = ring->tail;
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if(head == tail) return 0;
+  *ev = ring->buf[tail & ring->mask];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+//body of the poller thread: reads the reports and queues one event per wiimote that caused one
+static void * poller_loop(void * ptr) {
+  connman *conn = (connman *) ptr;
+  struct timespec t;
+  int i;
+
+  t.tv_sec = 0;
+  t.tv_nsec = POLLER_IDLE_WAIT;
+  while(__atomic_load_n(&conn->poller_running, __ATOMIC_ACQUIRE) == POLLER_RUNNING) {
+    if(!wii_poll(conn)) {
+      //out of the io_lock, leaving it to the effects and the speakers
+      nanosleep(&t, NULL);
+      continue;
+    }
+    state_refresh(conn, wii_now());
+    for(i = 0; i < conn->n; i++) {
+      if(conn->wms[i]->event != WIIUSE_NONE)
+        ring_push(&(conn->rings[i]), &(conn->state[i]));
+    }
+  }
+  return NULL;
+}
+
+int poller_start(connman *conn, int size) {
+  uint32_t rsize = 2;
+  int i;
+
+  if(conn->poller_running || !(conn->wms)) return 0;
+  while(rsize < (uint32_t) size && rsize < (1U << 20)) rsize <<= 1;
+
+  conn->rings = calloc(conn->n, sizeof(event_ring));
+  if(!(conn->rings)) return 0;
+  for(i = 0; i < conn->n; i++) {
+    conn->rings[i].buf = malloc(rsize * sizeof(wii_event));
+    conn->rings[i].mask = rsize - 1;
+    if(!(conn->rings[i].buf)) {
+      poller_stop(conn);
+      return 0;
+    }
+  }
+
+  conn->poller_running = POLLER_RUNNING;
+  if(pthread_create(&(conn->poller), NULL, poller_loop, conn)) {
+    conn->poller_running = POLLER_STOPPED;
+    poller_stop(conn);
+    return 0;
+  }
+  return 1;
+}
+
+int poller_claim(connman *conn) {
+  int running = POLLER_RUNNING;
+  return __atomic_compare_exchange_n(&conn->poller_running, &running, POLLER_STOPPING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+void poller_join(connman *conn) {
+  pthread_join(conn->poller, NULL);
+}
+
+void poller_free(connman *conn) {
+  int i;
+  if(conn->rings) {
+    for(i = 0; i < conn->n; i++)
+      free(conn->rings[i].buf);
+    free(conn->rings);
+    conn->rings = NULL;
+  }
+  __atomic_store_n(&conn->poller_running, POLLER_STOPPED, __ATOMIC_RELEASE);
+}
+
+void poller_stop(connman *conn) {
+  if(poller_claim(conn)) poller_join(conn);
+  poller_free(conn);
+}
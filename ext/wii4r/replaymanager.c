@@ -0,0 +1,366 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+#include<time.h>
+
+//longest sleep of a replay poll waiting for the next record, in ns
+#define REPLAY_MAX_WAIT		50000000ULL
+
+//sleep of a replay poll at the end of the capture, in ns
+#define REPLAY_EOF_WAIT		1000000ULL
+
+static VALUE sym_speed;
+
+//source of a ReplayManager: the records of a capture file
+typedef struct _replay {
+  wii_source source;		//must be the first member
+  FILE *fp;
+  double speed;			//1.0 plays at the original timing, 0 as fast as possible
+  wii_event next;		//first record not yet replayed
+  int has_next;
+  uint64_t first_ts;		//timestamp of the first record of the capture
+  uint64_t start;		//monotonic time the first record was replayed at, 0 before
+  unsigned long size;		//number of records in the capture
+  unsigned long replayed;	//records replayed so far
+  wii_event *first;		//first record of each slot
+  unsigned char *seen;		//1 if the slot has at least one record
+} replay;
+
+static void replay_sleep(uint64_t ns) {
+  struct timespec t;
+  t.tv_sec = ns / 1000000000ULL;
+  t.tv_nsec = ns % 1000000000ULL;
+  nanosleep(&t, NULL);
+}
+
+static int replay_read(replay *r, wii_event *ev) {
+  return fread(ev, sizeof(wii_event), 1, r->fp) == 1;
+}
+
+//goes back to the first record of the capture
+static void replay_rewind(replay *r) {
+  fseek(r->fp, sizeof(capture_header), SEEK_SET);
+  r->has_next = replay_read(r, &(r->next));
+  r->start = 0;
+  r->replayed = 0;
+}
+
+//applies the next batch of records (the events of one poll of the recording manager), waiting for its time if needed
+static int replay_poll(connman *conn) {
+  replay *r = (replay *) conn->source;
+  uint64_t ts, due, now;
+  int i, events = 0;
+
+  if(!(r->has_next)) {
+    replay_sleep(REPLAY_EOF_WAIT);
+    return 0;
+  }
+  if(r->speed > 0) {
+    now = wii_now();
+    if(!(r->start)) r->start = now;
+    due = r->start + (uint64_t) ((r->next.ts - r->first_ts) / r->speed);
+    if(due > now) {
+      replay_sleep(due - now > REPLAY_MAX_WAIT ? REPLAY_MAX_WAIT : due - now);
+      if(wii_now() < due) return 0;
+    }
+  }
+
+  for(i = 0; i < conn->n; i++) conn->wms[i]->event = WIIUSE_NONE;
+  ts = r->next.ts;
+  do {
+    if(r->next.slot < conn->n) {
+      wii_event_apply(conn->wms[r->next.slot], &(r->next));
+      events++;
+    }
+    r->replayed++;
+    r->has_next = replay_read(r, &(r->next));
+  } while(r->has_next && r->next.ts == ts);
+  return events;
+}
+
+static void replay_cleanup(connman *conn) {
+  replay *r = (replay *) conn->source;
+  int i;
+  if(r->fp) fclose(r->fp);
+  r->fp = NULL;
+  r->has_next = 0;
+  free(r->first);
+  free(r->seen);
+  r->first = NULL;
+  r->seen = NULL;
+  if(!(conn->wms)) return;
+  for(i = 0; i < conn->n; i++) free(conn->wms[i]);
+  free(conn->wms);
+}
+
+static replay * get_replay(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn || !(conn->source) || !(conn->wms)) rb_raise(gen_exp_class, "ReplayManager already cleaned up");
+  return (replay *) conn->source;
+}
+
+//reads the header of the capture "path" and scans its records, "capacity" is set to the one of the recording manager
+static replay * replay_open(VALUE path, int *capacity) {
+  capture_header header;
+  replay *r;
+  wii_event ev;
+  FILE *fp = fopen(StringValueCStr(path), "rb");
+  if(!fp) rb_sys_fail(StringValueCStr(path));
+  if(fread(&header, sizeof(capture_header), 1, fp) != 1 || memcmp(header.magic, WII4R_CAPTURE_MAGIC, sizeof(header.magic))) {
+    fclose(fp);
+    rb_raise(gen_exp_class, "%s is not a capture file", StringValueCStr(path));
+  }
+  if(header.version != WII4R_CAPTURE_VERSION || header.record_size != sizeof(wii_event) || header.capacity < 1) {
+    fclose(fp);
+    rb_raise(gen_exp_class, "%s was recorded by an incompatible version or machine", StringValueCStr(path));
+  }
+
+  r = calloc(1, sizeof(replay));
+  if(r) {
+    r->first = calloc(header.capacity, sizeof(wii_event));
+    r->seen = calloc(header.capacity, 1);
+  }
+  if(!r || !(r->first) || !(r->seen)) {
+    if(r) { free(r->first); free(r->seen); }
+    free(r);
+    fclose(fp);
+    rb_raise(gen_exp_class, "not enough memory");
+  }
+  *capacity = header.capacity;
+  r->source.poll = replay_poll;
+  r->source.cleanup = replay_cleanup;
+  r->fp = fp;
+  r->speed = 1.0;
+
+  while(replay_read(r, &ev)) {
+    if(!(r->size)) r->first_ts = ev.ts;
+    r->size++;
+    if(ev.slot < header.capacity && !(r->seen[ev.slot])) {
+      r->seen[ev.slot] = 1;
+      r->first[ev.slot] = ev;
+    }
+  }
+  return r;
+}
+
+static VALUE rb_rm_new(int argc, VALUE * argv, VALUE self) {
+  connman *conn;
+  replay *r;
+  int capacity, i;
+  VALUE path, opts, speed = Qnil, obj;
+  rb_scan_args(argc, argv, "11", &path, &opts);
+  FilePathValue(path);
+  if(TYPE(opts) == T_HASH) speed = rb_hash_aref(opts, sym_speed);
+  if(!NIL_P(speed) && NUM2DBL(speed) < 0) rb_raise(rb_eArgError, "speed must be positive or 0");
+
+  r = replay_open(path, &capacity);
+  obj = cm_alloc(self, capacity, (wii_source *) r);
+  Data_Get_Struct(obj, connman, conn);
+  conn->wms = calloc(capacity, sizeof(wiimote *));
+  if(!(conn->wms)) rb_raise(gen_exp_class, "not enough memory");
+  for(i = 0; i < capacity; i++) {
+    conn->wms[i] = calloc(1, sizeof(wiimote));
+    if(!(conn->wms[i])) rb_raise(gen_exp_class, "not enough memory");
+    conn->wms[i]->unid = i + 1;
+  }
+  if(!NIL_P(speed)) r->speed = NUM2DBL(speed);
+  replay_rewind(r);
+  rb_obj_call_init(obj, argc, argv);
+  return obj;
+}
+
+/*
+ *  call-seq:
+ *	ReplayManager.new(path)			-> manager
+ *	ReplayManager.new(path, speed: x)	-> manager
+ *
+ *  Returns a new ReplayManager playing the capture file <i>path</i>, written by <code>WiimoteManager#record</code>.
+ *  The capacity of the manager is the one of the recording manager.
+ *  With <i>speed</i> 1 (the default) the events are polled at their original timing, with 2 twice as fast
+ *  and so on; with <i>speed</i> 0 they are polled as fast as possible.
+ *
+ */
+
+static VALUE rb_rm_init(int argc, VALUE * argv, VALUE self) {
+  return rb_call_super(0, 0);
+}
+
+/*
+ *  call-seq:
+ *	manager.found	-> int
+ *
+ *  Returns the number of wiimotes of the capture not already connected.
+ *
+ */
+
+static VALUE rb_rm_found(VALUE self) {
+  replay *r = get_replay(self);
+  connman *conn;
+  int i, found = 0;
+  Data_Get_Struct(self, connman, conn);
+  for(i = 0; i < conn->n; i++)
+    if(r->seen[i] && NIL_P(conn->slots[i])) found++;
+  return INT2NUM(found);
+}
+
+/*
+ *  call-seq:
+ *	manager.connect	-> int
+ *
+ *  Creates a Wiimote for every wiimote of the capture, in its original slot, and returns the number of new wiimotes.
+ *  Every Wiimote starts in the state of its first record.
+ *
+ */
+
+static VALUE rb_rm_connect(VALUE self) {
+  replay *r = get_replay(self);
+  connman *conn;
+  int i, connected = 0;
+  Data_Get_Struct(self, connman, conn);
+  if(conn->polling || conn->poller_running) rb_raise(gen_exp_class, "ReplayManager is polling, cannot do connect");
+  for(i = 0; i < conn->n; i++) {
+    if(!(r->seen[i]) || !NIL_P(conn->slots[i])) continue;
+    wii_event_apply(conn->wms[i], &(r->first[i]));
+    conn->wms[i]->event = WIIUSE_NONE;
+    cm_attach(self, i);
+    connected++;
+  }
+  return INT2NUM(connected);
+}
+
+/*
+ *  call-seq:
+ *	manager.size	-> int
+ *
+ *  Returns the number of events in the capture.
+ *
+ */
+
+static VALUE rb_rm_size(VALUE self) {
+  return ULONG2NUM(get_replay(self)->size);
+}
+
+/*
+ *  call-seq:
+ *	manager.replayed	-> int
+ *
+ *  Returns the number of events already polled.
+ *
+ */
+
+static VALUE rb_rm_replayed(VALUE self) {
+  return ULONG2NUM(get_replay(self)->replayed);
+}
+
+/*
+ *  call-seq:
+ *	manager.eof?	-> true or false
+ *
+ *  Returns true if all the events of the capture have been polled.
+ *
+ */
+
+static VALUE rb_rm_eof(VALUE self) {
+  return get_replay(self)->has_next ? Qfalse : Qtrue;
+}
+
+/*
+ *  call-seq:
+ *	manager.rewind	-> nil
+ *
+ *  Restarts the replay from the first event of the capture.
+ *
+ */
+
+static VALUE rb_rm_rewind(VALUE self) {
+  replay *r = get_replay(self);
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(conn->polling || conn->poller_running) rb_raise(gen_exp_class, "ReplayManager is polling, cannot do rewind");
+  replay_rewind(r);
+  return Qnil;
+}
+
+/*
+ *  call-seq:
+ *	manager.speed	-> float
+ *
+ *  Returns the speed of the replay, 0 if the events are polled as fast as possible.
+ *
+ */
+
+static VALUE rb_rm_speed(VALUE self) {
+  return rb_float_new(get_replay(self)->speed);
+}
+
+/*
+ *  call-seq:
+ *	manager.speed = x	-> x
+ *
+ *  Sets the speed of the replay (see <code>new</code>) from the next event.
+ *
+ */
+
+static VALUE rb_rm_set_speed(VALUE self, VALUE arg) {
+  replay *r = get_replay(self);
+  connman *conn;
+  double speed = NUM2DBL(arg);
+  Data_Get_Struct(self, connman, conn);
+  if(speed < 0) rb_raise(rb_eArgError, "speed must be positive or 0");
+  if(conn->polling || conn->poller_running) rb_raise(gen_exp_class, "ReplayManager is polling, cannot change speed");
+  if(r->has_next && r->start) r->start = wii_now() - (uint64_t) ((r->next.ts - r->first_ts) / (speed > 0 ? speed : 1.0));
+  r->speed = speed;
+  return arg;
+}
+
+/*
+ * A WiimoteManager playing back a capture file written by <code>WiimoteManager#record</code>, with no bluetooth
+ * stack nor physical wiimotes. The recorded events go through the same code as the live ones: <code>poll</code>,
+ * <code>drain</code>, background polling and all the Wiimote accessors work as with the recording manager.
+ * With <code>speed: 0</code> the capture is a deterministic load generator.
+ *
+ *	wm = ReplayManager.new("session.cap", speed: 0)
+ *	wm.connect
+ *	wm.poll { |(wiimote, event)| ... } until wm.eof?
+ *
+ */
+
+void init_replaymanager(void) {
+  sym_speed = ID2SYM(rb_intern("speed"));
+
+  replay_class = rb_define_class_under(wii_mod, "ReplayManager", cm_class);
+  rb_define_singleton_method(replay_class, "new", rb_rm_new, -1);
+  rb_define_method(replay_class, "initialize", rb_rm_init, -1);
+  rb_define_method(replay_class, "found", rb_rm_found, 0);
+  rb_define_method(replay_class, "connect", rb_rm_connect, 0);
+  rb_define_method(replay_class, "size", rb_rm_size, 0);
+  rb_define_method(replay_class, "replayed", rb_rm_replayed, 0);
+  rb_define_method(replay_class, "eof?", rb_rm_eof, 0);
+  rb_define_method(replay_class, "rewind", rb_rm_rewind, 0);
+  rb_define_method(replay_class, "speed", rb_rm_speed, 0);
+  rb_define_method(replay_class, "speed=", rb_rm_set_speed, 1);
+}
@@ -0,0 +1,79 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<math.h>
+
+//smoothing factor of a low pass filter with cutoff frequency "cutoff" (Hz) for a sample after "dt" seconds
+static float smooth_alpha(float cutoff, float dt) {
+  float tau = 1.0f / (2 * (float) M_PI * cutoff);
+  return 1.0f / (1.0f + tau / dt);
+}
+
+//adds the sample "v" of "n" axes, arrived at "ts", to "f"
+static void smooth_add(smooth_filter *f, const float *v, int n, uint64_t ts) {
+  float dt, dx, a, cutoff;
+  int i;
+  if(!(f->ts) || ts <= f->ts) {
+    //the first sample, or one at the same time, starts the filter
+    for(i = 0; i < n; i++) {
+      f->x[i] = v[i];
+      f->dx[i] = 0;
+    }
+    f->ts = ts;
+    return;
+  }
+  dt = (float) (ts - f->ts) / 1e9f;
+  f->ts = ts;
+  for(i = 0; i < n; i++) {
+    if(f->kind == SMOOTH_EMA) f->x[i] += f->param[i][0] * (v[i] - f->x[i]);
+    else {
+      //the cutoff rises with the speed: little lag on fast moves, little jitter when still
+      dx = (v[i] - f->x[i]) / dt;
+      f->dx[i] += smooth_alpha(f->param[i][2], dt) * (dx - f->dx[i]);
+      cutoff = f->param[i][0] + f->param[i][1] * fabsf(f->dx[i]);
+      a = smooth_alpha(cutoff, dt);
+      f->x[i] += a * (v[i] - f->x[i]);
+    }
+  }
+}
+
+void smooth_update(smooth_state *s, const wii_event *ev) {
+  float v[3];
+  int i;
+  if(ev->type != WIIUSE_EVENT) return;
+  if(s->position.kind) {
+    //without ir sources the cursor is lost: the next one starts again from where it is seen
+    if((ev->flags & WII_EV_IR) && ev->dots) {
+      v[0] = ev->ir[0];
+      v[1] = ev->ir[1];
+      smooth_add(&(s->position), v, 2, ev->ts);
+    }
+    else s->position.ts = 0;
+  }
+  if(s->accel.kind && (ev->flags & WII_EV_ACC)) {
+    for(i = 0; i < 3; i++) v[i] = ev->accel[i];
+    smooth_add(&(s->accel), v, 3, ev->ts);
+  }
+}
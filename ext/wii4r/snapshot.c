@@ -0,0 +1,363 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+#include "wii4r.h"
+
+VALUE snapshot_new(connman *conn, int slot) {
+  wii_event *ev;
+  VALUE obj = Data_Make_Struct(snap_class, wii_event, NULL, free, ev);
+  //the wiimote structure may be written by the poller or a poll without the GVL, the last report is read from
+  //conn->state through its seqlock. A wiimote which never reported is read from its structure, only while
+  //nothing is polling
+  state_read_slot(conn, slot, ev);
+  if(!(ev->ts) && !(conn->polling) && !(conn->poller_running))
+    wii_event_fill(ev, conn->wms[slot], slot, wii_now());
+  ev->slot = (uint8_t) slot;
+  return rb_obj_freeze(obj);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.slot	-> int
+ *
+ *  Returns the slot of the wiimote in its WiimoteManager.
+ *
+ */
+
+static VALUE rb_snap_slot(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  return INT2NUM(ev->slot);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.timestamp	-> int
+ *
+ *  Returns the monotonic time (nanoseconds) at which the report of <i>self</i> arrived.
+ *
+ */
+
+static VALUE rb_snap_ts(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  return ULL2NUM(ev->ts);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.pressed?(button)	-> true or false
+ *
+ *  Returns true if <i>button</i> was being pressed.
+ *
+ */
+
+static VALUE rb_snap_pressed(VALUE self, VALUE arg) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  Check_Type(arg, T_FIXNUM);
+  if(IS_PRESSED(ev, NUM2INT(arg))) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	snapshot.just_pressed?(button)	-> true or false
+ *
+ *  Returns true if <i>button</i> was just pressed.
+ *
+ */
+
+static VALUE rb_snap_jpressed(VALUE self, VALUE arg) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  Check_Type(arg, T_FIXNUM);
+  if(IS_JUST_PRESSED(ev, NUM2INT(arg))) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	snapshot.held?(button)	-> true or false
+ *
+ *  Returns true if <i>button</i> was being held.
+ *
+ */
+
+static VALUE rb_snap_held(VALUE self, VALUE arg) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  Check_Type(arg, T_FIXNUM);
+  if(IS_HELD(ev, NUM2INT(arg))) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	snapshot.released?(button)	-> true or false
+ *
+ *  Returns true if <i>button</i> was just released.
+ *
+ */
+
+static VALUE rb_snap_released(VALUE self, VALUE arg) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  Check_Type(arg, T_FIXNUM);
+  if(IS_RELEASED(ev, NUM2INT(arg))) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	snapshot.acceleration	-> array
+ *
+ *  Returns the three components of acceleration [x, y, z].
+ *
+ */
+
+static VALUE rb_snap_accel(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  return rb_ary_new3(3, INT2FIX(ev->accel[0]), INT2FIX(ev->accel[1]), INT2FIX(ev->accel[2]));
+}
+
+/*
+ *  call-seq:
+ *	snapshot.gravity_force	-> array
+ *
+ *  Returns the three components of gravity force [x, y, z].
+ *
+ */
+
+static VALUE rb_snap_gforce(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  return rb_ary_new3(3, rb_float_new(ev->gforce[0]), rb_float_new(ev->gforce[1]), rb_float_new(ev->gforce[2]));
+}
+
+/*
+ *  call-seq:
+ *	snapshot.roll	-> float
+ *
+ *  Returns the rotation around Y axis, nil if motion sensing was disabled.
+ *
+ */
+
+static VALUE rb_snap_roll(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(!(ev->flags & WII_EV_ACC)) return Qnil;
+  return rb_float_new(ev->orient[0]);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.pitch	-> float
+ *
+ *  Returns the rotation around X axis, nil if motion sensing was disabled.
+ *
+ */
+
+static VALUE rb_snap_pitch(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(!(ev->flags & WII_EV_ACC)) return Qnil;
+  return rb_float_new(ev->orient[1]);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.yaw	-> float
+ *
+ *  Returns the rotation around Z axis, nil if motion sensing was disabled.
+ *
+ */
+
+static VALUE rb_snap_yaw(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(!(ev->flags & WII_EV_ACC)) return Qnil;
+  return rb_float_new(ev->orient[2]);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.position	-> array
+ *
+ *  Returns the ir cursor position [x, y], nil if ir tracking was disabled.
+ *
+ */
+
+static VALUE rb_snap_pos(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(!(ev->flags & WII_EV_IR)) return Qnil;
+  return rb_ary_new3(2, INT2FIX(ev->ir[0]), INT2FIX(ev->ir[1]));
+}
+
+/*
+ *  call-seq:
+ *	snapshot.absolute_position	-> array
+ *
+ *  Returns the absolute ir cursor position [x, y].
+ *
+ */
+
+static VALUE rb_snap_apos(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  return rb_ary_new3(2, INT2FIX(ev->ir_abs[0]), INT2FIX(ev->ir_abs[1]));
+}
+
+/*
+ *  call-seq:
+ *	snapshot.distance	-> float
+ *
+ *  Returns the distance from the ir sources, nil if ir tracking was disabled.
+ *
+ */
+
+static VALUE rb_snap_distance(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(!(ev->flags & WII_EV_IR)) return Qnil;
+  return rb_float_new(ev->ir_z);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.ir_sources	-> array
+ *
+ *  Returns the position [x, y] of all the visible ir sources, nil if ir tracking was disabled.
+ *
+ */
+
+static VALUE rb_snap_ir_sources(VALUE self) {
+  wii_event *ev;
+  VALUE ary;
+  int i;
+  Data_Get_Struct(self, wii_event, ev);
+  if(!(ev->flags & WII_EV_IR)) return Qnil;
+  ary = rb_ary_new();
+  for(i = 0; i < 4; i++) {
+    if(ev->dots & (1 << i))
+      rb_ary_push(ary, rb_ary_new3(2, INT2FIX(ev->dot[2 * i]), INT2FIX(ev->dot[2 * i + 1])));
+  }
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *	snapshot.expansion	-> int
+ *
+ *  Returns the expansion attached to the wiimote (EXP_NONE, EXP_NUNCHUK, EXP_CLASSIC or EXP_GUITAR).
+ *
+ */
+
+static VALUE rb_snap_exp(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  return INT2FIX(ev->exp);
+}
+
+/*
+ *  call-seq:
+ *	snapshot.expansion_pressed?(button)	-> true or false
+ *
+ *  Returns true if <i>button</i> of the expansion was being pressed.
+ *
+ */
+
+static VALUE rb_snap_exp_pressed(VALUE self, VALUE arg) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  Check_Type(arg, T_FIXNUM);
+  if((ev->exp_btns & NUM2INT(arg)) == NUM2INT(arg)) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	snapshot.joystick	-> array
+ *
+ *  Returns [angle, magnitude] of the expansion joystick (the left one of the classic controller),
+ *  nil if no expansion was attached.
+ *
+ */
+
+static VALUE rb_snap_js(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(ev->exp == EXP_NONE) return Qnil;
+  return rb_ary_new3(2, rb_float_new(ev->js[0]), rb_float_new(ev->js[1]));
+}
+
+/*
+ *  call-seq:
+ *	snapshot.nunchuk_acceleration	-> array
+ *
+ *  Returns the three components of acceleration [x, y, z] of the nunchuk, nil if no nunchuk was attached.
+ *
+ */
+
+static VALUE rb_snap_nun_accel(VALUE self) {
+  wii_event *ev;
+  Data_Get_Struct(self, wii_event, ev);
+  if(ev->exp != EXP_NUNCHUK) return Qnil;
+  return rb_ary_new3(3, INT2FIX(ev->exp_accel[0]), INT2FIX(ev->exp_accel[1]), INT2FIX(ev->exp_accel[2]));
+}
+
+/*
+ * A frozen copy of the state of a Wiimote (and its expansion), taken with <code>Wiimote#snapshot</code>.
+ * All the values come from the same report, they are converted to ruby objects only when read.
+ *
+ *	s = wiimote.snapshot
+ *	puts "#{s.roll} #{s.pitch}" if s.pressed?(BUTTON_A)
+ *
+ */
+
+void init_snapshot(void) {
+  snap_class = rb_define_class_under(wii_class, "Snapshot", rb_cObject);
+  rb_undef_alloc_func(snap_class);
+
+  rb_define_method(snap_class, "slot", rb_snap_slot, 0);
+  rb_define_method(snap_class, "timestamp", rb_snap_ts, 0);
+  rb_define_method(snap_class, "pressed?", rb_snap_pressed, 1);
+  rb_define_method(snap_class, "just_pressed?", rb_snap_jpressed, 1);
+  rb_define_method(snap_class, "held?", rb_snap_held, 1);
+  rb_define_method(snap_class, "released?", rb_snap_released, 1);
+  rb_define_method(snap_class, "acceleration", rb_snap_accel, 0);
+  rb_define_method(snap_class, "gravity_force", rb_snap_gforce, 0);
+  rb_define_method(snap_class, "roll", rb_snap_roll, 0);
+  rb_define_method(snap_class, "pitch", rb_snap_pitch, 0);
+  rb_define_method(snap_class, "yaw", rb_snap_yaw, 0);
+  rb_define_method(snap_class, "position", rb_snap_pos, 0);
+  rb_define_method(snap_class, "absolute_position", rb_snap_apos, 0);
+  rb_define_method(snap_class, "distance", rb_snap_distance, 0);
+  rb_define_method(snap_class, "ir_sources", rb_snap_ir_sources, 0);
+  rb_define_method(snap_class, "expansion", rb_snap_exp, 0);
+  rb_define_method(snap_class, "expansion_pressed?", rb_snap_exp_pressed, 1);
+  rb_define_method(snap_class, "joystick", rb_snap_js, 0);
+  rb_define_method(snap_class, "nunchuk_acceleration", rb_snap_nun_accel, 0);
+}
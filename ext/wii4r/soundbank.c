@@ -0,0 +1,338 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+
+//a clip of a bank and its name
+typedef struct _bank_entry {
+  ID name;
+  speaker_clip *clip;
+} bank_entry;
+
+//struct to describe the SoundBank class
+typedef struct _sound_bank {
+  bank_entry *entries;
+  int n;
+  int size;
+} sound_bank;
+
+//ids, resolved once by init_sound_bank
+static ID id_read;
+
+//reader of the samples of a ruby string
+typedef struct _bank_string {
+  const byte *ptr;
+  long left;
+} bank_string;
+
+static void free_sound_bank(void * ptr) {
+  sound_bank *bank = (sound_bank *) ptr;
+  int i;
+  for(i = 0; i < bank->n; i++)
+    speaker_clip_release(bank->entries[i].clip);
+  free(bank->entries);
+  free(bank);
+}
+
+static VALUE rb_bank_alloc(VALUE klass) {
+  sound_bank *bank;
+  return Data_Make_Struct(klass, sound_bank, NULL, free_sound_bank, bank);
+}
+
+//reads all of "io" into a String before any clip is allocated: an io which raises cannot leak a half built clip
+static VALUE bank_slurp(VALUE io) {
+  VALUE data = rb_funcall(io, id_read, 0);
+  if(NIL_P(data)) data = rb_str_new(NULL, 0);
+  StringValue(data);
+  return data;
+}
+
+static size_t bank_read_string(void *ctx, void *dst, size_t len) {
+  bank_string *str = (bank_string *) ctx;
+  if((long) len > str->left) len = str->left;
+  memcpy(dst, str->ptr, len);
+  str->ptr += len;
+  str->left -= (long) len;
+  return len;
+}
+
+static int bank_find(sound_bank *bank, ID name) {
+  int i;
+  for(i = 0; i < bank->n; i++)
+    if(bank->entries[i].name == name) return i;
+  return -1;
+}
+
+//adds "clip" to "bank" as "name", replacing the clip with the same name
+static void bank_add(sound_bank *bank, ID name, speaker_clip *clip) {
+  bank_entry *entries;
+  int i = bank_find(bank, name);
+  if(i >= 0) {
+    speaker_clip_release(bank->entries[i].clip);
+    bank->entries[i].clip = clip;
+    return;
+  }
+  if(bank->n == bank->size) {
+    entries = realloc(bank->entries, (bank->size ? 2 * bank->size : 8) * sizeof(bank_entry));
+    if(!entries) {
+      speaker_clip_release(clip);
+      rb_raise(gen_exp_class, "not enough memory");
+    }
+    bank->entries = entries;
+    bank->size = bank->size ? 2 * bank->size : 8;
+  }
+  bank->entries[bank->n].name = name;
+  bank->entries[bank->n].clip = clip;
+  bank->n++;
+}
+
+speaker_clip * sound_bank_clip(VALUE obj, VALUE name) {
+  sound_bank *bank;
+  int i;
+  if(!rb_obj_is_kind_of(obj, bank_class)) rb_raise(rb_eTypeError, "not a SoundBank");
+  Data_Get_Struct(obj, sound_bank, bank);
+  i = bank_find(bank, rb_to_id(name));
+  return i < 0 ? NULL : bank->entries[i].clip;
+}
+
+/*
+ *  call-seq:
+ *	bank.load(name, wav_file_path)	-> bank
+ *	bank.load(name, io)		-> bank
+ *
+ *  Reads a PCM WAV (8, 16, 24 or 32 bit, or 32 bit float, mono or stereo, at 4 or more frames per second) from a file
+ *  or from <i>io</i> and keeps it
+ *  in <i>self</i> as <i>name</i>, converted to the format of the wiimote speaker.
+ *  A sound with the same name is replaced.
+ *
+ *	bank.load(:hit, "sounds/hit.wav")
+ *
+ */
+
+static VALUE rb_bank_load(VALUE self, VALUE name, VALUE file) {
+  sound_bank *bank;
+  speaker_clip *clip;
+  bank_string str;
+  FILE *fp;
+  VALUE data;
+  int rate, channels, format;
+  long len;
+  ID id = rb_to_id(name);
+  Data_Get_Struct(self, sound_bank, bank);
+
+  if(rb_respond_to(file, id_read)) {
+    data = bank_slurp(file);
+    str.ptr = (const byte *) RSTRING_PTR(data);
+    str.left = RSTRING_LEN(data);
+    if(!wav_read_header(bank_read_string, &str, &rate, &channels, &format, &len))
+      rb_raise(gen_exp_class, "not a PCM WAV");
+    clip = speaker_clip_new(rate, channels, format, bank_read_string, &str, -1);
+    RB_GC_GUARD(data);
+  }
+  else {
+    Check_Type(file, T_STRING);
+    fp = fopen(StringValueCStr(file), "rb");
+    if(!fp) rb_raise(gen_exp_class, "cannot open %s", StringValueCStr(file));
+    if(!wav_read_header(wii_read_file, fp, &rate, &channels, &format, &len)) {
+      fclose(fp);
+      rb_raise(gen_exp_class, "%s is not a PCM WAV", StringValueCStr(file));
+    }
+    clip = speaker_clip_new(rate, channels, format, wii_read_file, fp, len);
+    fclose(fp);
+  }
+  if(!clip) rb_raise(gen_exp_class, "not enough memory");
+  bank_add(bank, id, clip);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *	bank.load_pcm(name, data)			-> bank
+ *	bank.load_pcm(name, data, rate)			-> bank
+ *	bank.load_pcm(name, data, rate, channels)	-> bank
+ *	bank.load_pcm(name, data, rate, channels, bits)	-> bank
+ *
+ *  Keeps in <i>self</i> as <i>name</i> the raw little endian PCM samples of <i>data</i> (a String or an io),
+ *  <i>channels</i> (1 or 2, default 1) interleaved at <i>rate</i> frames per second (default 8000, at least 4), in
+ *  <i>bits</i> as <code>Wiimote#play_pcm</code>. A sound with the same name is replaced.
+ *
+ */
+
+static VALUE rb_bank_load_pcm(int argc, VALUE * argv, VALUE self) {
+  sound_bank *bank;
+  speaker_clip *clip;
+  bank_string str;
+  VALUE name, data, vrate, vchannels, vbits;
+  int rate, channels, format;
+  ID id;
+  Data_Get_Struct(self, sound_bank, bank);
+  rb_scan_args(argc, argv, "23", &name, &data, &vrate, &vchannels, &vbits);
+  id = rb_to_id(name);
+  rate = NIL_P(vrate) ? 8000 : NUM2INT(vrate);
+  channels = NIL_P(vchannels) ? 1 : NUM2INT(vchannels);
+  format = wii_pcm_format(vbits);
+  if(rate < SPEAKER_MIN_RATE) rb_raise(rb_eArgError, "rate must be at least %d", SPEAKER_MIN_RATE);
+  if(channels < 1 || channels > 2) rb_raise(rb_eArgError, "channels must be 1 or 2");
+
+  if(rb_respond_to(data, id_read)) data = bank_slurp(data);
+  else StringValue(data);
+  str.ptr = (const byte *) RSTRING_PTR(data);
+  str.left = RSTRING_LEN(data);
+  clip = speaker_clip_new(rate, channels, format, bank_read_string, &str, str.left);
+  RB_GC_GUARD(data);
+  if(!clip) rb_raise(gen_exp_class, "not enough memory");
+  bank_add(bank, id, clip);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *	bank.include?(name)	-> true or false
+ *
+ *  Returns true if <i>self</i> has a sound named <i>name</i>.
+ *
+ */
+
+static VALUE rb_bank_include(VALUE self, VALUE name) {
+  sound_bank *bank;
+  Data_Get_Struct(self, sound_bank, bank);
+  if(bank_find(bank, rb_to_id(name)) >= 0) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	bank.names	-> array
+ *
+ *  Returns the names of the sounds of <i>self</i>, in the order they were loaded.
+ *
+ */
+
+static VALUE rb_bank_names(VALUE self) {
+  sound_bank *bank;
+  VALUE ary;
+  int i;
+  Data_Get_Struct(self, sound_bank, bank);
+  ary = rb_ary_new2(bank->n);
+  for(i = 0; i < bank->n; i++)
+    rb_ary_push(ary, ID2SYM(bank->entries[i].name));
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *	bank.size	-> int
+ *
+ *  Returns the number of sounds of <i>self</i>.
+ *
+ */
+
+static VALUE rb_bank_size(VALUE self) {
+  sound_bank *bank;
+  Data_Get_Struct(self, sound_bank, bank);
+  return INT2NUM(bank->n);
+}
+
+/*
+ *  call-seq:
+ *	bank.duration(name)	-> float or nil
+ *
+ *  Returns the length (seconds) of the sound named <i>name</i>, nil if there is none.
+ *
+ */
+
+static VALUE rb_bank_duration(VALUE self, VALUE name) {
+  sound_bank *bank;
+  int i;
+  Data_Get_Struct(self, sound_bank, bank);
+  i = bank_find(bank, rb_to_id(name));
+  if(i < 0) return Qnil;
+  return rb_float_new((double) speaker_clip_reports(bank->entries[i].clip) * SPEAKER_SAMPLES / SPEAKER_RATE);
+}
+
+/*
+ *  call-seq:
+ *	bank.bytesize	-> int
+ *
+ *  Returns the memory (bytes) taken by the sounds of <i>self</i>.
+ *
+ */
+
+static VALUE rb_bank_bytesize(VALUE self) {
+  sound_bank *bank;
+  long size = 0;
+  int i;
+  Data_Get_Struct(self, sound_bank, bank);
+  for(i = 0; i < bank->n; i++)
+    size += speaker_clip_reports(bank->entries[i].clip) * SPEAKER_REPORT;
+  return LONG2NUM(size);
+}
+
+/*
+ *  call-seq:
+ *	bank.delete(name)	-> true or false
+ *
+ *  Removes the sound named <i>name</i> from <i>self</i> (a wiimote playing it plays it to the end),
+ *  returns false if there was none.
+ *
+ */
+
+static VALUE rb_bank_delete(VALUE self, VALUE name) {
+  sound_bank *bank;
+  int i;
+  Data_Get_Struct(self, sound_bank, bank);
+  i = bank_find(bank, rb_to_id(name));
+  if(i < 0) return Qfalse;
+  speaker_clip_release(bank->entries[i].clip);
+  memmove(bank->entries + i, bank->entries + i + 1, (bank->n - i - 1) * sizeof(bank_entry));
+  bank->n--;
+  return Qtrue;
+}
+
+/*
+ * A set of sounds converted once, when loaded, to the format of the wiimote speaker and kept in memory.
+ * A wiimote plays them by name, without reading or converting anything: see <code>Wiimote#sound_bank=</code>.
+ *
+ *	bank = Wii::SoundBank.new
+ *	bank.load(:hit, "sounds/hit.wav").load(:miss, "sounds/miss.wav")
+ *	wiimote.sound_bank = bank
+ *	wiimote.play(:hit)
+ *
+ */
+
+void init_sound_bank(void) {
+  id_read = rb_intern("read");
+  bank_class = rb_define_class_under(wii_mod, "SoundBank", rb_cObject);
+  rb_define_alloc_func(bank_class, rb_bank_alloc);
+
+  rb_define_method(bank_class, "load", rb_bank_load, 2);
+  rb_define_method(bank_class, "load_pcm", rb_bank_load_pcm, -1);
+  rb_define_method(bank_class, "include?", rb_bank_include, 1);
+  rb_define_method(bank_class, "names", rb_bank_names, 0);
+  rb_define_method(bank_class, "size", rb_bank_size, 0);
+  rb_define_method(bank_class, "duration", rb_bank_duration, 1);
+  rb_define_method(bank_class, "bytesize", rb_bank_bytesize, 0);
+  rb_define_method(bank_class, "delete", rb_bank_delete, 1);
+}
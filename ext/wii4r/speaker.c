@@ -0,0 +1,587 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+
+#include "wii4r.h"
+#include<string.h>
+#include<errno.h>
+#include<time.h>
+
+//resampled samples waiting to be encoded
+#define SPEAKER_PENDING		1024
+
+//bytes read at once from the file or the memory of a stream
+#define SPEAKER_CHUNK		4096
+
+//frames converted at once to mono 16 bit
+#define SPEAKER_BLOCK		512
+
+//nanoseconds between two reports
+#define SPEAKER_INTERVAL	(SPEAKER_SAMPLES * 1000000000ULL / SPEAKER_RATE)
+
+struct _speaker_clip {
+  int refs;			//protected by speakers_lock
+  long nreports;
+  byte (*reports)[SPEAKER_REPORT];
+};
+
+struct _speaker_stream {
+  wiimote *wm;
+  pthread_mutex_t *io;		//io_lock of the manager of "wm", NULL if none
+  int rate;
+  int channels;
+  int format;			//PCM_*
+
+  //source of the samples, none if they are written with speaker_write
+  FILE *file;
+  byte *data;
+  speaker_clip *clip;
+  long len;			//bytes left to read, -1 = up to the end of "file"
+  long pos;			//next byte of "data", next report of "clip"
+  byte partial[8];		//a frame split between two writes
+  int npartial;
+  int closed;			//no more samples to read
+
+  //resampler: box filter, every frame counts SPEAKER_RATE ticks and a sample is made every "rate" ticks
+  int64_t sum;
+  int ticks;
+
+  //encoder
+  int16_t pending[SPEAKER_PENDING];
+  int head;
+  int npending;
+  int predictor;
+  int step;
+
+  //double buffering: buf[front] is being played, buf[!front] is filled and "ready" when complete
+  byte buf[2][SPEAKER_BUFFER][SPEAKER_REPORT];
+  int count[2];
+  int front;
+  int played;			//reports of buf[front] sent
+  int ready;
+
+  int stop;
+  int done;			//the thread will no longer use "wm"
+  int interrupted;
+  int refs;
+  unsigned long reports;
+  unsigned long underruns;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct _speaker_stream *next;
+};
+
+static pthread_mutex_t speakers_lock = PTHREAD_MUTEX_INITIALIZER;
+static speaker_stream *speakers = NULL;
+
+static const int yamaha_scale[8] = { 230, 230, 230, 230, 307, 409, 512, 614 };
+
+static int le16(const byte *b) {
+  return (int16_t) (b[0] | (b[1] << 8));
+}
+
+static long le32(const byte *b) {
+  return (long) ((uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24));
+}
+
+//skips "len" bytes of a WAV, returns 0 if it ends before
+static int wav_skip(speaker_read_fn read, void *ctx, long len) {
+  byte tmp[256];
+  size_t n;
+  while(len > 0) {
+    n = read(ctx, tmp, len < (long) sizeof(tmp) ? (size_t) len : sizeof(tmp));
+    if(!n) return 0;
+    len -= (long) n;
+  }
+  return 1;
+}
+
+int wav_read_header(speaker_read_fn read, void *ctx, int *rate, int *channels, int *format, long *len) {
+  byte h[40];
+  long size;
+  int fmt = 0, tag, bits, n;
+  if(read(ctx, h, 12) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) return 0;
+  for(;;) {
+    if(read(ctx, h, 8) != 8) return 0;
+    size = le32(h + 4);
+    if(!memcmp(h, "fmt ", 4)) {
+      n = size < 40 ? (int) size : 40;
+      if(size < 16 || read(ctx, h, n) != (size_t) n) return 0;
+      tag = (uint16_t) le16(h);
+      bits = le16(h + 14);
+      //WAVE_FORMAT_EXTENSIBLE: the format is in the first 2 bytes of the subformat
+      if(tag == 0xFFFE) tag = n == 40 ? (uint16_t) le16(h + 24) : 0;
+      if(tag == 1 && bits == 8) *format = PCM_U8;
+      else if(tag == 1 && bits == 16) *format = PCM_S16;
+      else if(tag == 1 && bits == 24) *format = PCM_S24;
+      else if(tag == 1 && bits == 32) *format = PCM_S32;
+      else if(tag == 3 && bits == 32) *format = PCM_F32;
+      else return 0;
+      *channels = le16(h + 2);
+      *rate = (int) le32(h + 4);
+      if(*channels < 1 || *channels > 2 || *rate < SPEAKER_MIN_RATE) return 0;
+      fmt = 1;
+      if(!wav_skip(read, ctx, size - n + (size & 1))) return 0;
+    }
+    else if(!memcmp(h, "data", 4)) {
+      *len = size;
+      return fmt;
+    }
+    else if(!wav_skip(read, ctx, size + (size & 1))) return 0;
+  }
+}
+
+//resamples "n" mono samples to the pending samples. Box filter: a sample is the mean of the input
+//over its period, the inputs in the middle of the period are summed at once
+static void speaker_resample(speaker_stream *s, const int16_t *x, long n) {
+  long i = 0, full;
+  int left;
+  while(i < n) {
+    left = s->rate - s->ticks;
+    full = left / SPEAKER_RATE;
+    if(full >= n - i) {
+      s->sum += pcm_sum(x + i, n - i) * SPEAKER_RATE;
+      s->ticks += (int) (n - i) * SPEAKER_RATE;
+      return;
+    }
+    if(full) {
+      s->sum += pcm_sum(x + i, full) * SPEAKER_RATE;
+      i += full;
+      left -= (int) full * SPEAKER_RATE;
+    }
+    //x[i] ends this period and begins the next ones
+    s->pending[s->npending++] = (int16_t) ((s->sum + (int64_t) x[i] * left) / s->rate);
+    for(left = SPEAKER_RATE - left; left >= s->rate; left -= s->rate)
+      s->pending[s->npending++] = x[i];
+    s->sum = (int64_t) x[i] * left;
+    s->ticks = left;
+    i++;
+  }
+}
+
+//resamples the frames of "data" to the pending samples, as many as fit, returns the bytes used
+static long speaker_convert(speaker_stream *s, const byte *data, long len) {
+  int16_t mono[SPEAKER_BLOCK];
+  int fsize = pcm_sample_size(s->format) * s->channels;
+  long used = 0, frames, n;
+
+  if(s->head) {
+    memmove(s->pending, s->pending + s->head, (s->npending - s->head) * sizeof(int16_t));
+    s->npending -= s->head;
+    s->head = 0;
+  }
+  //room for the samples made from "frames", and for the padding of the last report
+  frames = (long) (SPEAKER_PENDING - s->npending - SPEAKER_SAMPLES - 1) * s->rate / SPEAKER_RATE;
+  if(frames > 0 && s->npartial && len + s->npartial >= fsize) {
+    used = fsize - s->npartial;
+    memcpy(s->partial + s->npartial, data, used);
+    s->npartial = 0;
+    pcm_to_mono(mono, s->partial, 1, s->channels, s->format);
+    speaker_resample(s, mono, 1);
+    frames--;
+  }
+  while(frames > 0 && len - used >= fsize) {
+    n = (len - used) / fsize;
+    if(n > frames) n = frames;
+    if(n > SPEAKER_BLOCK) n = SPEAKER_BLOCK;
+    pcm_to_mono(mono, data + used, n, s->channels, s->format);
+    speaker_resample(s, mono, n);
+    used += n * fsize;
+    frames -= n;
+  }
+  //keep the bytes of an incomplete frame
+  if(frames > 0 && used < len) {
+    memcpy(s->partial + s->npartial, data + used, len - used);
+    s->npartial += (int) (len - used);
+    used = len;
+  }
+  return used;
+}
+
+//encodes SPEAKER_SAMPLES pending samples to "report", 4 bit Yamaha ADPCM with the first sample in the high nibble
+static void speaker_adpcm(speaker_stream *s, byte *report) {
+  const int16_t *x = s->pending + s->head;
+  int i, delta, nibble, diff, a;
+  for(i = 0; i < SPEAKER_SAMPLES; i++) {
+    delta = x[i] - s->predictor;
+    //min(7, |delta| * 4 / step), without a division
+    a = (delta < 0 ? -delta : delta) * 4;
+    nibble = 0;
+    if(a >= 4 * s->step) {
+      nibble = 4;
+      a -= 4 * s->step;
+    }
+    if(a >= 2 * s->step) {
+      nibble += 2;
+      a -= 2 * s->step;
+    }
+    if(a >= s->step) nibble++;
+    diff = (s->step * (2 * nibble + 1)) >> 3;
+    if(delta < 0) {
+      nibble |= 8;
+      diff = -diff;
+    }
+    s->predictor += diff;
+    if(s->predictor > 32767) s->predictor = 32767;
+    else if(s->predictor < -32768) s->predictor = -32768;
+    s->step = (s->step * yamaha_scale[nibble & 7]) >> 8;
+    if(s->step < 127) s->step = 127;
+    else if(s->step > 24576) s->step = 24576;
+    if(i & 1) report[i >> 1] |= nibble;
+    else report[i >> 1] = nibble << 4;
+  }
+  s->head += SPEAKER_SAMPLES;
+}
+
+//moves the pending samples to the back buffer, call with s->lock held
+static void speaker_encode(speaker_stream *s) {
+  int back = !(s->front);
+  if(s->closed && (s->npending - s->head) % SPEAKER_SAMPLES) {
+    //pad the last report with silence
+    memset(s->pending + s->npending, 0, (SPEAKER_SAMPLES - (s->npending - s->head) % SPEAKER_SAMPLES) * sizeof(int16_t));
+    s->npending += SPEAKER_SAMPLES - (s->npending - s->head) % SPEAKER_SAMPLES;
+  }
+  while(!(s->ready) && s->npending - s->head >= SPEAKER_SAMPLES) {
+    speaker_adpcm(s, s->buf[back][s->count[back]]);
+    if(++(s->count[back]) == SPEAKER_BUFFER) s->ready = 1;
+  }
+  if(s->closed && s->npending == s->head && s->count[back]) s->ready = 1;
+}
+
+//copies the reports of the clip of "s" to the back buffer, call with s->lock held
+static void speaker_produce_clip(speaker_stream *s) {
+  int back = !(s->front);
+  while(!(s->ready) && !(s->closed)) {
+    if(s->pos == s->clip->nreports) s->closed = 1;
+    else {
+      memcpy(s->buf[back][s->count[back]], s->clip->reports[s->pos++], SPEAKER_REPORT);
+      if(++(s->count[back]) == SPEAKER_BUFFER) s->ready = 1;
+    }
+  }
+  if(s->closed && s->count[back]) s->ready = 1;
+}
+
+//fills the back buffer from the file, the memory or the clip of "s", call with s->lock held
+static void speaker_produce(speaker_stream *s) {
+  byte chunk[SPEAKER_CHUNK];
+  long n, used;
+  if(s->clip) {
+    speaker_produce_clip(s);
+    return;
+  }
+  speaker_encode(s);
+  while(!(s->ready) && !(s->closed)) {
+    n = SPEAKER_CHUNK;
+    if(s->len >= 0 && n > s->len) n = s->len;
+    if(s->file) {
+      n = (long) fread(chunk, 1, n, s->file);
+      used = n > 0 ? speaker_convert(s, chunk, n) : 0;
+      if(used < n) fseek(s->file, used - n, SEEK_CUR);
+    }
+    else used = n > 0 ? speaker_convert(s, s->data + s->pos, n) : 0;
+    if(n <= 0) s->closed = 1;
+    s->pos += used;
+    if(s->len >= 0) s->len -= used;
+    speaker_encode(s);
+  }
+}
+
+//body of the thread of a stream: sends a report every SPEAKER_INTERVAL, swapping the buffers when one is played
+static void * speaker_loop(void * ptr) {
+  speaker_stream *s = (speaker_stream *) ptr;
+  byte report[SPEAKER_REPORT];
+  uint64_t due = 0, now;
+  struct timespec t;
+  int underrun = 1;
+  int reader = s->file || s->data || s->clip;
+
+  pthread_mutex_lock(&(s->lock));
+  while(!(s->stop)) {
+    if(s->played == s->count[s->front]) {
+      if(reader) speaker_produce(s);
+      else speaker_encode(s);
+      //while playing, a buffer being written is played even if not full
+      if(s->ready || (!underrun && s->count[!(s->front)])) {
+        s->count[s->front] = 0;
+        s->played = 0;
+        s->front = !(s->front);
+        s->ready = 0;
+        if(reader) speaker_produce(s);
+        else pthread_cond_broadcast(&(s->cond));
+        if(underrun) due = wii_now();
+        underrun = 0;
+        continue;
+      }
+      if(s->closed && s->npending == s->head) break;
+      //the writer is late
+      if(!underrun && s->reports) s->underruns++;
+      underrun = 1;
+      pthread_cond_wait(&(s->cond), &(s->lock));
+      continue;
+    }
+
+    t.tv_sec = due / 1000000000ULL;
+    t.tv_nsec = due % 1000000000ULL;
+    if(wii_now() < due && pthread_cond_timedwait(&(s->cond), &(s->lock), &t) != ETIMEDOUT) continue;
+    memcpy(report, s->buf[s->front][s->played++], SPEAKER_REPORT);
+    pthread_mutex_unlock(&(s->lock));
+    //the poller may be in wiiuse_poll on the same wiimote
+    if(s->io) pthread_mutex_lock(s->io);
+    wiiuse_play_sound(s->wm, report, SPEAKER_REPORT);
+    if(s->io) pthread_mutex_unlock(s->io);
+    pthread_mutex_lock(&(s->lock));
+    s->reports++;
+    //after a stall, start again from now instead of sending the late reports in a burst
+    now = wii_now();
+    due += SPEAKER_INTERVAL;
+    if(due + SPEAKER_INTERVAL < now) due = now;
+  }
+  s->done = 1;
+  pthread_cond_broadcast(&(s->cond));
+  pthread_mutex_unlock(&(s->lock));
+  speaker_release(s);
+  return NULL;
+}
+
+speaker_stream * speaker_new(wiimote *wm, int rate, int channels, int format, FILE *file, byte *data, long len) {
+  pthread_condattr_t attr;
+  speaker_stream *s;
+  if(rate < SPEAKER_MIN_RATE || channels < 1 || channels > 2 || format < PCM_U8 || format > PCM_F32) return NULL;
+  s = calloc(1, sizeof(speaker_stream));
+  if(!s) return NULL;
+  s->wm = wm;
+  s->rate = rate;
+  s->channels = channels;
+  s->format = format;
+  s->file = file;
+  s->data = data;
+  s->len = len;
+  s->step = 127;
+  s->refs = 1;
+  pthread_mutex_init(&(s->lock), NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&(s->cond), &attr);
+  pthread_condattr_destroy(&attr);
+  return s;
+}
+
+speaker_stream * speaker_new_clip(wiimote *wm, speaker_clip *clip) {
+  speaker_stream *s = speaker_new(wm, SPEAKER_RATE, 1, PCM_S16, NULL, NULL, 0);
+  if(!s) return NULL;
+  pthread_mutex_lock(&speakers_lock);
+  clip->refs++;
+  pthread_mutex_unlock(&speakers_lock);
+  s->clip = clip;
+  return s;
+}
+
+//appends the back buffer of "s" to "clip", returns 0 on failure
+static int speaker_clip_add(speaker_clip *clip, speaker_stream *s, long *size) {
+  int back = !(s->front);
+  byte (*reports)[SPEAKER_REPORT];
+  if(clip->nreports + s->count[back] > *size) {
+    *size = *size ? 2 * *size : 4 * SPEAKER_BUFFER;
+    reports = realloc(clip->reports, *size * SPEAKER_REPORT);
+    if(!reports) return 0;
+    clip->reports = reports;
+  }
+  memcpy(clip->reports[clip->nreports], s->buf[back], s->count[back] * SPEAKER_REPORT);
+  clip->nreports += s->count[back];
+  s->count[back] = 0;
+  s->ready = 0;
+  return 1;
+}
+
+speaker_clip * speaker_clip_new(int rate, int channels, int format, speaker_read_fn read, void *ctx, long len) {
+  byte chunk[SPEAKER_CHUNK];
+  speaker_stream *s;
+  speaker_clip *clip;
+  long n, used, size = 0;
+  int ok = 1;
+
+  clip = calloc(1, sizeof(speaker_clip));
+  s = speaker_new(NULL, rate, channels, format, NULL, NULL, len);
+  if(!clip || !s) ok = 0;
+  else clip->refs = 1;
+  //the stream only encodes: a full back buffer is moved to the clip
+  while(ok && !(s->closed)) {
+    n = SPEAKER_CHUNK;
+    if(s->len >= 0 && n > s->len) n = s->len;
+    n = n > 0 ? (long) read(ctx, chunk, n) : 0;
+    if(n <= 0) s->closed = 1;
+    if(s->len >= 0) s->len -= n;
+    for(used = 0; ok && (used < n || s->closed); ) {
+      used += speaker_convert(s, chunk + used, n - used);
+      speaker_encode(s);
+      if(s->ready) ok = speaker_clip_add(clip, s, &size);
+      else if(used == n) break;
+    }
+  }
+  if(s) speaker_release(s);
+  if(!ok) {
+    if(clip) free(clip->reports);
+    free(clip);
+    return NULL;
+  }
+  return clip;
+}
+
+long speaker_clip_reports(speaker_clip *clip) {
+  return clip->nreports;
+}
+
+void speaker_clip_release(speaker_clip *clip) {
+  int refs;
+  pthread_mutex_lock(&speakers_lock);
+  refs = --(clip->refs);
+  pthread_mutex_unlock(&speakers_lock);
+  if(refs) return;
+  free(clip->reports);
+  free(clip);
+}
+
+void speaker_release(speaker_stream *s) {
+  int refs;
+  pthread_mutex_lock(&(s->lock));
+  refs = --(s->refs);
+  pthread_mutex_unlock(&(s->lock));
+  if(refs) return;
+  if(s->file) fclose(s->file);
+  free(s->data);
+  if(s->clip) speaker_clip_release(s->clip);
+  pthread_cond_destroy(&(s->cond));
+  pthread_mutex_destroy(&(s->lock));
+  free(s);
+}
+
+//stops "s" and waits for its thread to leave the wiimote, returns 0 if it had already finished
+static int speaker_halt(speaker_stream *s) {
+  int playing;
+  pthread_mutex_lock(&(s->lock));
+  playing = !(s->done);
+  s->stop = 1;
+  pthread_cond_broadcast(&(s->cond));
+  while(!(s->done)) pthread_cond_wait(&(s->cond), &(s->lock));
+  pthread_mutex_unlock(&(s->lock));
+  speaker_release(s);
+  return playing;
+}
+
+//unlinks the stream of "wm", call with speakers_lock held
+static speaker_stream * speaker_unlink(wiimote *wm) {
+  speaker_stream *s, *prev;
+  for(prev = NULL, s = speakers; s; prev = s, s = s->next) {
+    if(s->wm == wm) {
+      if(prev) prev->next = s->next;
+      else speakers = s->next;
+      return s;
+    }
+  }
+  return NULL;
+}
+
+int speaker_start(speaker_stream *s, pthread_mutex_t *io) {
+  pthread_t thread;
+  speaker_stop(s->wm);
+  s->io = io;
+  //a reference for the thread and one for the list of streams
+  s->refs += 2;
+  if(pthread_create(&thread, NULL, speaker_loop, s)) {
+    s->refs -= 2;
+    return 0;
+  }
+  pthread_detach(thread);
+  pthread_mutex_lock(&speakers_lock);
+  s->next = speakers;
+  speakers = s;
+  pthread_mutex_unlock(&speakers_lock);
+  return 1;
+}
+
+long speaker_write(speaker_stream *s, const byte *data, long len) {
+  long used = 0;
+  pthread_mutex_lock(&(s->lock));
+  if(!len) s->closed = 1;
+  for(;;) {
+    speaker_encode(s);
+    if(s->ready) pthread_cond_broadcast(&(s->cond));
+    if(s->stop) {
+      used = -1;
+      break;
+    }
+    if(used == len) break;
+    if(s->interrupted) {
+      s->interrupted = 0;
+      break;
+    }
+    //wait for the back buffer to be played
+    if(s->ready) pthread_cond_wait(&(s->cond), &(s->lock));
+    else used += speaker_convert(s, data + used, len - used);
+  }
+  if(s->closed) pthread_cond_broadcast(&(s->cond));
+  pthread_mutex_unlock(&(s->lock));
+  return used;
+}
+
+void speaker_interrupt(void *ptr) {
+  speaker_stream *s = (speaker_stream *) ptr;
+  pthread_mutex_lock(&(s->lock));
+  s->interrupted = 1;
+  pthread_cond_broadcast(&(s->cond));
+  pthread_mutex_unlock(&(s->lock));
+}
+
+int speaker_stop(wiimote *wm) {
+  speaker_stream *s;
+  pthread_mutex_lock(&speakers_lock);
+  s = speaker_unlink(wm);
+  pthread_mutex_unlock(&speakers_lock);
+  if(!s) return 0;
+  return speaker_halt(s);
+}
+
+int speaker_status(wiimote *wm, unsigned long *reports, unsigned long *underruns) {
+  speaker_stream *s;
+  int playing = -1;
+  pthread_mutex_lock(&speakers_lock);
+  for(s = speakers; s; s = s->next) {
+    if(s->wm == wm) {
+      pthread_mutex_lock(&(s->lock));
+      playing = !(s->done);
+      if(reports) *reports = s->reports;
+      if(underruns) *underruns = s->underruns;
+      pthread_mutex_unlock(&(s->lock));
+      break;
+    }
+  }
+  pthread_mutex_unlock(&speakers_lock);
+  return playing;
+}
+
+void speakers_stop_all(wiimote **wms, int n) {
+  int i;
+  for(i = 0; i < n; i++)
+    if(wms[i]) speaker_stop(wms[i]);
+}
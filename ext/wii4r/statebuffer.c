@@ -0,0 +1,188 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+#include "wii4r.h"
+#include<string.h>
+#include<ruby/encoding.h>
+
+//struct to describe the StateBuffer class
+typedef struct _state_buffer {
+  VALUE manager;		//WiimoteManager owning the records
+  connman *conn;
+  ssize_t shape[1];		//memory view: number of records
+  ssize_t strides[1];		//memory view: size of a record
+} state_buffer;
+
+static void mark_state_buffer(void * ptr) {
+  state_buffer *sb = (state_buffer *) ptr;
+  rb_gc_mark(sb->manager);
+}
+
+VALUE state_buffer_new(VALUE manager) {
+  state_buffer *sb;
+  connman *conn;
+  Data_Get_Struct(manager, connman, conn);
+  VALUE obj = Data_Make_Struct(state_class, state_buffer, mark_state_buffer, free, sb);
+  sb->manager = manager;
+  sb->conn = conn;
+  sb->shape[0] = conn->n;
+  sb->strides[0] = sizeof(wii_event);
+  return obj;
+}
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+
+//exports the records of the manager as a read only 1-dimensional view of EVENT_FORMAT items
+static bool state_mv_get(VALUE obj, rb_memory_view_t *view, int flags) {
+  state_buffer *sb;
+  Data_Get_Struct(obj, state_buffer, sb);
+  if(flags & RUBY_MEMORY_VIEW_WRITABLE) return false;
+  rb_memory_view_init_as_byte_array(view, obj, sb->conn->state, sb->conn->n * sizeof(wii_event), true);
+  view->format = "QC4S6C7xf6s2S8f12s2";
+  view->item_size = sizeof(wii_event);
+  view->shape = sb->shape;
+  view->strides = sb->strides;
+  return true;
+}
+
+static bool state_mv_release(VALUE obj, rb_memory_view_t *view) {
+  return true;
+}
+
+static bool state_mv_available(VALUE obj) {
+  return true;
+}
+
+static const rb_memory_view_entry_t state_mv_entry = {
+  state_mv_get,
+  state_mv_release,
+  state_mv_available
+};
+
+#endif
+
+/*
+ *  call-seq:
+ *	buffer.size	-> int
+ *
+ *  Returns the number of records of <i>self</i>, one per slot of the manager (see <code>WiimoteManager#capacity</code>).
+ *
+ */
+
+static VALUE rb_sb_size(VALUE self) {
+  state_buffer *sb;
+  Data_Get_Struct(self, state_buffer, sb);
+  return INT2NUM(sb->conn->n);
+}
+
+/*
+ *  call-seq:
+ *	buffer.bytesize	-> int
+ *
+ *  Returns the size in bytes of <i>self</i>.
+ *
+ */
+
+static VALUE rb_sb_bytesize(VALUE self) {
+  state_buffer *sb;
+  Data_Get_Struct(self, state_buffer, sb);
+  return LONG2NUM((long) sb->conn->n * (long) sizeof(wii_event));
+}
+
+/*
+ *  call-seq:
+ *	buffer.generation	-> int
+ *
+ *  Returns a counter increased every time the records of <i>self</i> are refreshed by a poll.
+ *
+ */
+
+static VALUE rb_sb_generation(VALUE self) {
+  state_buffer *sb;
+  Data_Get_Struct(self, state_buffer, sb);
+  return UINT2NUM(__atomic_load_n(&(sb->conn->state_seq), __ATOMIC_ACQUIRE) >> 1);
+}
+
+/*
+ *  call-seq:
+ *	buffer.read		-> string
+ *	buffer.read(str)	-> str
+ *
+ *  Returns a binary String with a copy of all the records of <i>self</i>, taken between two polls.
+ *  If <i>str</i> is given its contents are replaced, so that no object is created.
+ *
+ *	buf = String.new
+ *	loop {
+ *		wm.poll { }
+ *		wm.state_buffer.read(buf)
+ *	}
+ */
+
+static VALUE rb_sb_read(int argc, VALUE * argv, VALUE self) {
+  state_buffer *sb;
+  VALUE str;
+  long len;
+  rb_scan_args(argc, argv, "01", &str);
+  Data_Get_Struct(self, state_buffer, sb);
+  len = (long) sb->conn->n * (long) sizeof(wii_event);
+  if(NIL_P(str)) str = rb_str_new(NULL, len);
+  else {
+    StringValue(str);
+    rb_str_modify(str);
+    rb_str_resize(str, len);
+    rb_enc_associate(str, rb_ascii8bit_encoding());
+  }
+  state_read(sb->conn, (wii_event *) RSTRING_PTR(str));
+  return str;
+}
+
+/*
+ * The last state of every wiimote of a WiimoteManager, stored in native memory as <code>size</code> contiguous
+ * records and refreshed by the manager on every poll (also by the background poller, see <code>WiimoteManager#start_polling</code>).
+ * Record <i>i</i> is the state of the wiimote in slot <i>i</i>, with the layout described by
+ * <code>WiimoteManager::EVENT_FORMAT</code> (see <code>WiimoteManager#drain</code>); slots that never reported are zeroed.
+ *
+ * On rubies with MemoryView support the records are exported as a read only view of <code>size</code> items,
+ * so a C extension or a numeric library can read them in place, without creating any ruby object.
+ * The view is updated while it is held: while the background poller runs prefer <code>read</code>,
+ * which always returns records from a single poll.
+ *
+ *	state = wm.state_buffer
+ *	wm.poll { }
+ *	state.read.unpack(WiimoteManager::EVENT_FORMAT)
+ *
+ */
+
+void init_state_buffer(void) {
+  state_class = rb_define_class_under(cm_class, "StateBuffer", rb_cObject);
+  rb_undef_alloc_func(state_class);
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  rb_memory_view_register(state_class, &state_mv_entry);
+#endif
+
+  rb_define_method(state_class, "size", rb_sb_size, 0);
+  rb_define_method(state_class, "bytesize", rb_sb_bytesize, 0);
+  rb_define_method(state_class, "generation", rb_sb_generation, 0);
+  rb_define_method(state_class, "read", rb_sb_read, -1);
+}
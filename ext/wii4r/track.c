@@ -0,0 +1,142 @@
+/*
+############################################################################
+#                                                                          #
+#    Copyright (C) 2009 by KzMz KzMz@modusbibendi.org                      #
+#    Copyright (C) 2009 by BuZz Gambino.Giorgio@gmail.com                  #
+#                                                                          #
+#    This program is free software; you can redistribute it and/or modify  #
+#    it under the terms of the GNU General Public License as published by  #
+#    the Free Software Foundation; either version 2 of the License, or     #
+#    (at your option) any later version.                                   #
+#                                                                          #
+#    This program is distributed in the hope that it will be useful,       #
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+#    GNU General Public License for more details.                          #
+#                                                                          #
+#    You should have received a copy of the GNU General Public License     #
+#    along with this program; if not, write to the                         #
+#    Free Software Foundation, Inc.,                                       #
+#    59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             #
+############################################################################
+*/
+
+
+
+#include "wii4r.h"
+#include<string.h>
+
+//search of the cheapest assignment of the visible dots to the tracks
+typedef struct _track_search {
+  float dot[4][2];		//visible dots
+  int dot_idx[4];		//their index in the report
+  int ndots;
+  float pred[TRACK_MAX][2];	//predicted position of each track
+  int ntracks;
+  int cur[4];			//track of each dot being tried, -1 = a new track
+  int best[4];
+  float best_cost;
+} track_search;
+
+//seconds from "ts" to the report "ev", 0 if "ev" is not later
+static float track_dt(const wii_event *ev, uint64_t ts) {
+  return ev->ts > ts ? (float) ((ev->ts - ts) * 1e-9) : 0;
+}
+
+//squared distance between "a" and "b"
+static float track_dist2(const float *a, const float *b) {
+  float dx = a[0] - b[0], dy = a[1] - b[1];
+  return dx * dx + dy * dy;
+}
+
+//tries every assignment of the dots from "d" on to the tracks not in "used": a dot costs its squared distance
+//from the prediction of its track, or TRACK_GATE^2 if it starts a new one. There are at most 4 dots and 4 tracks
+static void track_assign(track_search *s, int d, unsigned used, float cost) {
+  float c;
+  int t;
+  if(cost >= s->best_cost) return;
+  if(d == s->ndots) {
+    s->best_cost = cost;
+    memcpy(s->best, s->cur, sizeof(s->best));
+    return;
+  }
+  for(t = 0; t < s->ntracks; t++) {
+    if(used & (1u << t)) continue;
+    c = track_dist2(s->dot[d], s->pred[t]);
+    if(c >= TRACK_GATE * TRACK_GATE) continue;
+    s->cur[d] = t;
+    track_assign(s, d + 1, used | (1u << t), cost + c);
+  }
+  s->cur[d] = -1;
+  track_assign(s, d + 1, used, cost + TRACK_GATE * TRACK_GATE);
+}
+
+void track_reset(track_state *tr, int enabled) {
+  uint32_t next_id = tr->next_id;
+  memset(tr, 0, sizeof(track_state));
+  tr->enabled = enabled;
+  tr->next_id = next_id ? next_id : 1;
+}
+
+void track_update(track_state *tr, const wii_event *ev) {
+  track_search s;
+  ir_track *t;
+  float dt, vx, vy;
+  int i, n;
+  if(!(tr->enabled) || ev->type != WIIUSE_EVENT) return;
+  if(!(ev->flags & WII_EV_IR)) {
+    tr->ntracks = 0;
+    return;
+  }
+
+  //the tracks unseen for too long are dropped, the others predicted at the time of the report
+  for(i = 0, n = 0; i < tr->ntracks; i++) {
+    if(ev->ts > tr->tracks[i].ts + TRACK_TIMEOUT) continue;
+    tr->tracks[n++] = tr->tracks[i];
+  }
+  tr->ntracks = n;
+  s.ntracks = n;
+  for(i = 0; i < n; i++) {
+    t = &(tr->tracks[i]);
+    dt = track_dt(ev, t->ts);
+    s.pred[i][0] = t->x + t->vx * dt;
+    s.pred[i][1] = t->y + t->vy * dt;
+  }
+  s.ndots = 0;
+  for(i = 0; i < 4; i++) {
+    if(!(ev->dots & (1 << i))) continue;
+    s.dot[s.ndots][0] = ev->dot[2 * i];
+    s.dot[s.ndots][1] = ev->dot[2 * i + 1];
+    s.dot_idx[s.ndots++] = i;
+  }
+  s.best_cost = 1e30f;
+  track_assign(&s, 0, 0, 0);
+
+  for(i = 0; i < TRACK_MAX; i++) tr->tracks[i].dot = -1;
+  for(i = 0; i < s.ndots; i++) {
+    if(s.best[i] < 0) {
+      //a new source, if there is room for it
+      if(tr->ntracks == TRACK_MAX) continue;
+      t = &(tr->tracks[tr->ntracks++]);
+      t->id = tr->next_id++;
+      t->vx = t->vy = 0;
+      t->age = 0;
+    }
+    else {
+      t = &(tr->tracks[s.best[i]]);
+      dt = track_dt(ev, t->ts);
+      if(dt > 0) {
+        vx = (s.dot[i][0] - t->x) / dt;
+        vy = (s.dot[i][1] - t->y) / dt;
+        //the first velocity is taken as is, the next ones are averaged to damp the jitter of the camera
+        t->vx = t->age > 1 ? 0.5f * (t->vx + vx) : vx;
+        t->vy = t->age > 1 ? 0.5f * (t->vy + vy) : vy;
+      }
+    }
+    t->x = s.dot[i][0];
+    t->y = s.dot[i][1];
+    t->ts = ev->ts;
+    t->dot = (int8_t) s.dot_idx[i];
+    t->age++;
+  }
+}
@@ -22,6 +22,7 @@
 */
 
 #include "wii4r.h"
+#include<string.h>
 
 //Wii module
 VALUE wii_mod =   Qnil;
@@ -41,9 +42,42 @@ VALUE gh3_class = Qnil;
 //Nunchuk class
 VALUE nun_class = Qnil;
 
+//Snapshot class
+VALUE snap_class = Qnil;
+VALUE state_class = Qnil;
+VALUE replay_class = Qnil;
+
+//SoundBank class
+VALUE bank_class = Qnil;
+
+//GestureSet class
+VALUE gesture_class = Qnil;
+
 //Wii4RGenericException class
 VALUE gen_exp_class = Qnil;
 
+//key of the buffer passed to the getters
+static VALUE sym_into = Qnil;
+
+//method reading an io and bits of float samples, resolved once by Init_wii4r
+static ID id_read;
+static VALUE sym_float = Qnil;
+
+#if !defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL) && defined(HAVE_RB_THREAD_BLOCKING_REGION)
+//a void * function called through rb_thread_blocking_region
+typedef struct _blocking_call {
+  void * (*func)(void *);
+  void * data;
+  void * ret;
+} blocking_call;
+
+static VALUE wii_blocking_call(void * ptr) {
+  blocking_call * call = (blocking_call *) ptr;
+  call->ret = call->func(call->data);
+  return Qnil;
+}
+#endif
+
 //define Wiimote class
 extern void init_wiimote(void);
 
@@ -59,6 +93,74 @@ extern void init_gh3(void);
 //define Nunchuk class
 extern void init_nunchuk(void);
 
+//define Snapshot class
+extern void init_snapshot(void);
+extern void init_state_buffer(void);
+extern void init_replaymanager(void);
+
+//define SoundBank class
+extern void init_sound_bank(void);
+
+//define GestureSet class
+extern void init_gesture_set(void);
+
+VALUE wii_into(int argc, VALUE * argv) {
+  VALUE buf;
+  rb_scan_args(argc, argv, "01", &buf);
+  if(TYPE(buf) == T_HASH) buf = rb_hash_aref(buf, sym_into);
+  if(NIL_P(buf)) return Qnil;
+  Check_Type(buf, T_ARRAY);
+  rb_ary_modify(buf);
+  return buf;
+}
+
+size_t wii_read_file(void *ctx, void *dst, size_t len) {
+  return fread(dst, 1, len, (FILE *) ctx);
+}
+
+size_t wii_read_io(void *ctx, void *dst, size_t len) {
+  VALUE str = rb_funcall(*(VALUE *) ctx, id_read, 1, LONG2NUM((long) len));
+  if(NIL_P(str)) return 0;
+  StringValue(str);
+  if((size_t) RSTRING_LEN(str) < len) len = RSTRING_LEN(str);
+  memcpy(dst, RSTRING_PTR(str), len);
+  return len;
+}
+
+int wii_pcm_format(VALUE bits) {
+  if(NIL_P(bits)) return PCM_S16;
+  if(bits == sym_float) return PCM_F32;
+  switch(NUM2INT(bits)) {
+    case 8: return PCM_U8;
+    case 16: return PCM_S16;
+    case 24: return PCM_S24;
+    case 32: return PCM_S32;
+  }
+  rb_raise(rb_eArgError, "bits must be 8, 16, 24, 32 or :float");
+  return 0;
+}
+
+VALUE wii_fill(VALUE buf, int n, const VALUE * vals) {
+  int i;
+  if(NIL_P(buf)) return rb_ary_new4(n, vals);
+  for(i = 0; i < n; i++)
+    rb_ary_store(buf, i, vals[i]);
+  if(RARRAY_LEN(buf) > n) rb_ary_resize(buf, n);
+  return buf;
+}
+
+void * wii_without_gvl(void * (*func)(void *), void * data, void (*ubf)(void *), void * ubf_data) {
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+  return rb_thread_call_without_gvl(func, data, ubf, ubf_data);
+#elif defined(HAVE_RB_THREAD_BLOCKING_REGION)
+  blocking_call call = { func, data, NULL };
+  rb_thread_blocking_region(wii_blocking_call, &call, ubf, ubf_data);
+  return call.ret;
+#else
+  return func(data);
+#endif
+}
+
 void init_exceptions(void) {
   gen_exp_class = rb_define_class("Wii4RuntimeException", rb_eRuntimeError);
 }
@@ -93,6 +195,7 @@ void init_exceptions(void) {
  *	- EXP_NUNCHUK
  *	- EXP_CLASSIC
  *	- EXP_GUITAR
+ *	- EXP_BUTTONS_SHIFT (position of the expansion buttons in <code>Wiimote#all_buttons</code>)
  *
  *  Aspect Ratio Constants:
  *	- ASPECT_4_3
@@ -101,12 +204,43 @@ void init_exceptions(void) {
  *  Sensor Bar Position Constants:
  *	- ABOVE
  *	- BELOW
+ *
+ *  Event Codes (see WiimoteManager#drain):
+ *	- EVENT_NONE
+ *	- EVENT_GENERIC
+ *	- EVENT_STATUS
+ *	- EVENT_CONNECT
+ *	- EVENT_DISCONNECT
+ *	- EVENT_UNEXPECTED_DISCONNECT
+ *	- EVENT_READ_DATA
+ *	- EVENT_NUNCHUK_INSERTED
+ *	- EVENT_NUNCHUK_REMOVED
+ *	- EVENT_CLASSIC_INSERTED
+ *	- EVENT_CLASSIC_REMOVED
+ *	- EVENT_GUITAR_INSERTED
+ *	- EVENT_GUITAR_REMOVED
+ *
+ *  MOCK is true when the extension was built with <code>--enable-mock-wiiuse</code>:
+ *  the wiimotes are simulated and no bluetooth stack is used.
+ *
+ *  SIMD is the vector instruction set the sound conversion was built for: "avx2"
+ *  (with <code>--enable-avx2</code>), "sse2" or "none" (with <code>--disable-simd</code> or on other processors).
  */
 
 void Init_wii4r() {
+  sym_into = ID2SYM(rb_intern("into"));
+  id_read = rb_intern("read");
+  sym_float = ID2SYM(rb_intern("float"));
+  
   wii_mod = rb_define_module("Wii");
-  rb_define_const(wii_mod, "MAX_WIIMOTES", INT2NUM(4));
-  rb_define_const(wii_mod, "TIMEOUT", INT2NUM(5));
+  rb_define_const(wii_mod, "MAX_WIIMOTES", INT2NUM(WII4R_MAX_WIIMOTES));
+  rb_define_const(wii_mod, "TIMEOUT", INT2NUM(WII4R_TIMEOUT));
+#ifdef WII4R_MOCK
+  rb_define_const(wii_mod, "MOCK", Qtrue);
+#else
+  rb_define_const(wii_mod, "MOCK", Qfalse);
+#endif
+  rb_define_const(wii_mod, "SIMD", rb_obj_freeze(rb_str_new2(pcm_simd())));
   
   //Wiimote led consts
   rb_define_const(wii_mod, "LED_NONE", INT2NUM(WIIMOTE_LED_NONE));
@@ -169,18 +303,39 @@ void Init_wii4r() {
   rb_define_const(wii_mod, "EXP_NUNCHUK", INT2NUM(EXP_NUNCHUK));
   rb_define_const(wii_mod, "EXP_CLASSIC", INT2NUM(EXP_CLASSIC));
   rb_define_const(wii_mod, "EXP_GUITAR", INT2NUM(EXP_GUITAR_HERO_3));
+  rb_define_const(wii_mod, "EXP_BUTTONS_SHIFT", INT2NUM(WII_EXP_BUTTONS_SHIFT));
   
   //Aspect ratio and sensor bar position constants
   rb_define_const(wii_mod, "ASPECT_4_3", INT2NUM(WIIUSE_ASPECT_4_3));
   rb_define_const(wii_mod, "ASPECT_16_9", INT2NUM(WIIUSE_ASPECT_16_9));
   rb_define_const(wii_mod, "ABOVE", INT2NUM(WIIUSE_IR_ABOVE));
   rb_define_const(wii_mod, "BELOW", INT2NUM(WIIUSE_IR_BELOW));
+  
+  //Event codes
+  rb_define_const(wii_mod, "EVENT_NONE", INT2NUM(WIIUSE_NONE));
+  rb_define_const(wii_mod, "EVENT_GENERIC", INT2NUM(WIIUSE_EVENT));
+  rb_define_const(wii_mod, "EVENT_STATUS", INT2NUM(WIIUSE_STATUS));
+  rb_define_const(wii_mod, "EVENT_CONNECT", INT2NUM(WIIUSE_CONNECT));
+  rb_define_const(wii_mod, "EVENT_DISCONNECT", INT2NUM(WIIUSE_DISCONNECT));
+  rb_define_const(wii_mod, "EVENT_UNEXPECTED_DISCONNECT", INT2NUM(WIIUSE_UNEXPECTED_DISCONNECT));
+  rb_define_const(wii_mod, "EVENT_READ_DATA", INT2NUM(WIIUSE_READ_DATA));
+  rb_define_const(wii_mod, "EVENT_NUNCHUK_INSERTED", INT2NUM(WIIUSE_NUNCHUK_INSERTED));
+  rb_define_const(wii_mod, "EVENT_NUNCHUK_REMOVED", INT2NUM(WIIUSE_NUNCHUK_REMOVED));
+  rb_define_const(wii_mod, "EVENT_CLASSIC_INSERTED", INT2NUM(WIIUSE_CLASSIC_CTRL_INSERTED));
+  rb_define_const(wii_mod, "EVENT_CLASSIC_REMOVED", INT2NUM(WIIUSE_CLASSIC_CTRL_REMOVED));
+  rb_define_const(wii_mod, "EVENT_GUITAR_INSERTED", INT2NUM(WIIUSE_GUITAR_HERO_3_CTRL_INSERTED));
+  rb_define_const(wii_mod, "EVENT_GUITAR_REMOVED", INT2NUM(WIIUSE_GUITAR_HERO_3_CTRL_REMOVED));
 
   init_wiimotemanager();
+  init_replaymanager();
   init_wiimote();
   init_nunchuk();
   init_gh3();
   init_cc();
+  init_snapshot();
+  init_state_buffer();
+  init_sound_bank();
+  init_gesture_set();
   init_exceptions();
 }
 
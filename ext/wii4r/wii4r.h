@@ -26,17 +26,37 @@
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<stdint.h>
+#include<pthread.h>
 #include<wiiuse.h>
 #include<ruby.h>
 
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+  #include<ruby/thread.h>
+#endif
+
+#ifdef HAVE_RUBY_MEMORY_VIEW_H
+  #include<ruby/memory_view.h>
+#endif
+
 #ifndef WIIMOTE_IS_CONNECTED
   #define WIIMOTE_IS_CONNECTED(wm)		(WIIMOTE_IS_SET(wm, 0x0008))
 #endif
 
+#ifndef WIIMOTE_STATE_RUMBLE
+  #define WIIMOTE_STATE_RUMBLE			0x0010
+#endif
+
 #ifndef WIIMOTE_IS_SET
   #define WIIMOTE_IS_SET(wm, s)			((wm->state & (s)) == (s))
 #endif
 
+//default number of wiimotes of a WiimoteManager (Wii::MAX_WIIMOTES)
+#define WII4R_MAX_WIIMOTES	4
+
+//seconds spent searching for wiimotes (Wii::TIMEOUT)
+#define WII4R_TIMEOUT		5
+
 //Wii module 
 extern VALUE wii_mod;
 
@@ -55,6 +75,21 @@ extern VALUE cc_class;
 //GH3Controller class
 extern VALUE gh3_class;
 
+//Snapshot class
+extern VALUE snap_class;
+
+//StateBuffer class
+extern VALUE state_class;
+
+//ReplayManager class
+extern VALUE replay_class;
+
+//SoundBank class
+extern VALUE bank_class;
+
+//GestureSet class
+extern VALUE gesture_class;
+
 //Wii4RGenericException class
 extern VALUE gen_exp_class;
 
@@ -65,10 +100,527 @@ extern void free_wiimote(void * wm);
 //return true if the wiimote "wm" is connected, false otherwise
 extern int wm_connected(wiimote *wm);
 
+//return the ir cursor position [x, y] of "wm", nil if ir tracking is disabled
+extern VALUE wm_position(wiimote *wm);
+
+//position of the expansion buttons in Wiimote#all_buttons
+#define WII_EXP_BUTTONS_SHIFT	16
+
+//flags of a wii_event
+#define WII_EV_ACC		0x01	//motion sensing enabled
+#define WII_EV_IR		0x02	//ir tracking enabled
+#define WII_EV_EXP		0x04	//expansion attached
+
+//compact copy of the state of a wiimote when an event is read, 128 bytes with no padding
+typedef struct _wii_event {
+  uint64_t ts;			//monotonic arrival time (ns)
+  uint8_t slot;			//index of the wiimote in connman->wms
+  uint8_t type;			//WIIUSE_EVENT_TYPE
+  uint8_t exp;			//expansion type (EXP_*)
+  uint8_t flags;		//WII_EV_* flags
+  uint16_t btns;
+  uint16_t btns_held;
+  uint16_t btns_released;
+  uint16_t exp_btns;
+  uint16_t exp_btns_held;
+  uint16_t exp_btns_released;
+  uint8_t accel[3];
+  uint8_t exp_accel[3];		//nunchuk acceleration
+  uint8_t dots;			//bitmask of the visible ir dots
+  uint8_t reserved;
+  float gforce[3];
+  float orient[3];		//roll, pitch, yaw
+  int16_t ir[2];		//ir cursor
+  uint16_t dot[8];		//x, y of the 4 ir dots
+  float ir_z;
+  float exp_gforce[3];		//nunchuk gravity force
+  float exp_orient[2];		//nunchuk roll, pitch
+  float js[4];			//joystick angle, magnitude (right joystick of the classic controller)
+  float analog[2];		//classic shoulders / guitar whammy bar
+  int16_t ir_abs[2];		//absolute ir cursor
+} wii_event;
+
+//states of connman->poller_running
+#define POLLER_STOPPED		0
+#define POLLER_RUNNING		1	//the poller thread must keep going
+#define POLLER_STOPPING		2	//claimed by a thread which is joining it
+
+//bounded single producer / single consumer queue of wii_events
+typedef struct _event_ring {
+  wii_event *buf;
+  uint32_t mask;		//size - 1, size is a power of 2
+  uint32_t head;		//next write, owned by the producer
+  uint32_t tail;		//next read, owned by the consumer
+  uint32_t dropped;		//events lost because the ring was full
+} event_ring;
+
+//number of buckets of a latency_hist
+#define WII_LATENCY_BUCKETS	32
+
+//latencies in fixed power of 2 buckets: bucket 0 counts the ones under 1 us, bucket i the ones under 2^i us
+typedef struct _latency_hist {
+  uint64_t count;
+  uint64_t sum;			//ns
+  uint64_t max;			//ns
+  uint64_t buckets[WII_LATENCY_BUCKETS];
+} latency_hist;
+
+//latencies of the events of a wiimote, measured from their arrival (wii_event.ts, when wiiuse_poll returned)
+typedef struct _wii_latency {
+  latency_hist decode;		//until the event is copied in conn->state
+  latency_hist dispatch;	//until the event is yielded to (or drained by) ruby
+} wii_latency;
+
+//a subscription of WiimoteManager#subscribe: an event reaches ruby if it matches any subscription
+typedef struct _wii_filter {
+  int id;
+  int slot;			//slot of the wiimote, -1 = any
+  uint32_t events;		//bitmask of 1 << WIIUSE_EVENT_TYPE
+  uint16_t buttons;		//generic events match if one of these is pressed or released, 0 = not checked
+  int accel_delta;		//generic events match if an axis moved this much, 0 = not checked
+} wii_filter;
+
+//gestures are resampled to GESTURE_POINTS accelerations in fixed point, GESTURE_ONE_G = 1 g
+#define GESTURE_POINTS		32
+#define GESTURE_ONE_G		32
+
+//longest motion segmented (reports), the motion is matched when it is reached
+#define GESTURE_MAX_SAMPLES	256
+
+typedef struct _gesture_set gesture_set;
+
+//gesture engine of a wiimote, fed with every report by WiimoteManager#poll and #drain
+typedef struct _gesture_state {
+  gesture_set *set;		//templates matched, NULL = disabled
+  int8_t seg[GESTURE_MAX_SAMPLES][3];	//acceleration of the motion being segmented
+  int len;			//samples in "seg", 0 = no motion
+  int quiet;			//consecutive samples at rest at the end of "seg"
+  ID recording;			//name the next motion is recorded as, 0 = matching
+  ID last;			//last gesture recognised, 0 = none
+  float last_score;
+  uint64_t last_ts;
+} gesture_state;
+
+//orientation filter of a wiimote, fed with every report by WiimoteManager#poll and #drain
+typedef struct _fusion_state {
+  float tau;			//time constant (s), 0 = disabled
+  float q[4];			//orientation quaternion w, x, y, z
+  uint64_t ts;			//arrival time of the last report, 0 = none yet
+} fusion_state;
+
+//kinds of smoothing filter
+#define SMOOTH_NONE		0
+#define SMOOTH_EMA		1	//exponential moving average, parameter alpha
+#define SMOOTH_ONE_EURO		2	//One Euro filter, parameters min_cutoff, beta, d_cutoff
+
+//a smoothing filter of up to 3 axes, each with its own parameters
+typedef struct _smooth_filter {
+  int kind;
+  float param[3][3];		//parameters of each axis
+  float x[3];			//filtered values
+  float dx[3];			//filtered derivatives (One Euro)
+  uint64_t ts;			//arrival time of the last sample, 0 = none yet
+} smooth_filter;
+
+//smoothing of a wiimote, fed with every report by WiimoteManager#poll and #drain
+typedef struct _smooth_state {
+  smooth_filter position;	//ir cursor
+  smooth_filter accel;		//raw acceleration
+} smooth_state;
+
+//what a history_sample holds
+#define HISTORY_HAS_ACC		0x01
+#define HISTORY_HAS_IR		0x02	//an ir source was visible
+#define HISTORY_HAS_EXP		0x04	//a nunchuk was attached
+
+//a report kept in the history of a wiimote
+typedef struct _history_sample {
+  uint64_t ts;			//arrival time
+  uint8_t flags;		//HISTORY_HAS_* flags
+  uint8_t accel[3];
+  uint8_t exp_accel[3];		//nunchuk acceleration
+  int16_t ir[2];		//ir cursor
+  float gforce[3];
+  float exp_gforce[3];		//nunchuk gravity force
+} history_sample;
+
+//last reports of a wiimote, fed with every report by WiimoteManager#poll and #drain
+typedef struct _history_state {
+  history_sample *buf;
+  uint32_t size;		//capacity, 0 = disabled
+  uint32_t head;		//next write
+  uint32_t count;		//samples kept
+} history_state;
+
+//values a window of the history is computed on
+#define HISTORY_ACCEL		0
+#define HISTORY_GFORCE		1
+#define HISTORY_POSITION	2	//ir cursor, 2 axes
+#define HISTORY_EXP_ACCEL	3
+#define HISTORY_EXP_GFORCE	4
+
+//statistics of a window of the history, per axis
+typedef struct _history_stats {
+  int count;			//samples in the window
+  int axes;
+  double min[3];
+  double max[3];
+  double mean[3];
+  double var[3];		//population variance
+} history_stats;
+
+//most ir sources tracked, as many as the camera reports
+#define TRACK_MAX		4
+//farthest (ir camera pixels) a source can be from the prediction of its track to keep its id
+#define TRACK_GATE		96.0f
+//time (ns) a track is kept while its source is not visible
+#define TRACK_TIMEOUT		100000000ULL
+
+//an ir source followed across the reports
+typedef struct _ir_track {
+  uint32_t id;			//stable id, never reused by the same wiimote
+  float x, y;			//last position
+  float vx, vy;			//velocity (pixels per second)
+  uint64_t ts;			//arrival time of the last report the source was visible in
+  uint32_t age;			//reports the source was visible in
+  int8_t dot;			//index of the source in the last report, -1 if it was not visible
+} ir_track;
+
+//ir sources of a wiimote, tracked on every report by WiimoteManager#poll and #drain
+typedef struct _track_state {
+  int enabled;
+  ir_track tracks[TRACK_MAX];	//oldest first
+  int ntracks;
+  uint32_t next_id;
+} track_state;
+
+//screen calibration of the ir cursor of a wiimote, applied on every report by WiimoteManager#poll and #drain
+typedef struct _calib_state {
+  int enabled;
+  double h[9];			//homography from the ir cursor to the screen, row major
+  float pos[2];			//calibrated position of the last report
+  int valid;			//0 if no ir source was visible in the last report
+} calib_state;
+
+struct _connman;
+
+//where the reports of a WiimoteManager come from, NULL in connman->source for real wiimotes
+typedef struct _wii_source {
+  int (*poll)(struct _connman *conn);		//reads the next reports into conn->wms like wiiuse_poll, runs without the GVL
+  void (*cleanup)(struct _connman *conn);	//frees conn->wms like wiiuse_cleanup and the source data, conn->wms may be NULL
+} wii_source;
+
+//first bytes of a capture file written by WiimoteManager#record, followed by the wii_event records
+typedef struct _capture_header {
+  char magic[8];		//WII4R_CAPTURE_MAGIC
+  uint16_t version;		//WII4R_CAPTURE_VERSION, in native byte order like the records
+  uint16_t record_size;		//sizeof(wii_event)
+  uint16_t capacity;		//capacity of the recording WiimoteManager
+  uint16_t reserved;
+} capture_header;
+
+#define WII4R_CAPTURE_MAGIC	"WII4RCAP"
+#define WII4R_CAPTURE_VERSION	1
+
 //struct to describe the WiimoteManager class
 typedef struct _connman {
   wiimote **wms;		//array of ptrs to wiimote structures
   int n;			//max number of wiimotes connected
+  VALUE *slots;			//Wiimote object of each wiimote structure, Qnil if not connected
+  int polling;			//1 while wiiuse_poll is running outside the GVL
+  event_ring *rings;		//one ring per wiimote, filled by the poller thread
+  pthread_t poller;		//background thread running wiiuse_poll
+  volatile int poller_running;	//POLLER_* state of the poller thread
+  wii_event *state;		//last state of each wiimote, refreshed by every poll
+  uint32_t state_seq;		//odd while "state" is being written, +2 on every refresh
+  FILE *capture;		//file written by record, NULL if not recording
+  unsigned long captured;	//records written in "capture"
+  pthread_mutex_t capture_lock;	//guards "capture" against the poller thread
+  pthread_mutex_t io_lock;	//serialises the wiiuse calls on "wms": polls, effects and speaker threads
+  wii_source *source;		//NULL for bluetooth wiimotes
+  wii_latency *latency;		//latencies of each slot
+  wii_filter *filters;		//subscriptions, all the events reach ruby if there are none
+  int nfilters;
+  int filter_id;		//id of the last subscription
+  uint8_t (*filter_accel)[3];	//acceleration of the last event of each slot that reached ruby
+  unsigned long filtered;	//events discarded by the subscriptions
+  gesture_state *gestures;	//gesture engine of each slot, NULL until a wiimote gets a GestureSet
+  fusion_state *fusion;		//orientation filter of each slot, NULL until a wiimote enables it
+  smooth_state *smooth;		//smoothing of each slot, NULL until a wiimote enables it
+  history_state *history;	//history of each slot, NULL until a wiimote enables it
+  track_state *tracks;		//ir tracking of each slot, NULL until a wiimote enables it
+  calib_state *calib;		//screen calibration of each slot, NULL until a wiimote is calibrated
 } connman;
 
+//monotonic clock in nanoseconds
+extern uint64_t wii_now(void);
+
+//copies the state of "wm" (slot "slot") into "ev"
+extern void wii_event_fill(wii_event *ev, wiimote *wm, int slot, uint64_t ts);
+
+//copies the event "ev" back into the wiimote structure "wm", the reverse of wii_event_fill
+extern void wii_event_apply(wiimote *wm, const wii_event *ev);
+
+//adds the latency "ns" to "hist", there must be only one writer per histogram
+extern void latency_add(latency_hist *hist, uint64_t ns);
+
+//reads the pending reports of the wiimotes of "conn" from their source, returns the number of events
+extern int wii_poll(connman *conn);
+
+//starts writing the events of "conn" in a new capture file "path", returns 0 and sets errno on failure
+extern int capture_open(connman *conn, const char *path);
+
+//appends the events of the last poll of "conn" to its capture file, called by state_refresh
+extern void capture_write(connman *conn);
+
+//closes the capture file of "conn", returns the number of events written
+extern unsigned long capture_close(connman *conn);
+
+//return a new WiimoteManager (or subclass "klass") for "max" wiimotes, with no wiimote structures.
+//"source" (NULL for bluetooth wiimotes) is owned by the manager right away, also if this raises
+extern VALUE cm_alloc(VALUE klass, int max, wii_source *source);
+
+//wraps the wiimote in slot "slot" of "manager" in a new Wiimote object and adds it to the manager
+extern VALUE cm_attach(VALUE manager, int slot);
+
+//return the connman managing the Wiimote object "wiimote" and its slot in "slot", NULL if it is not managed
+extern connman * cm_of(VALUE wiimote, int *slot);
+
+//return the io_lock of the manager of the Wiimote object "wiimote", NULL if it is not managed
+extern pthread_mutex_t * cm_io_lock(VALUE wiimote);
+
+//copies the state of the wiimotes of "conn" which caused an event into conn->state,
+//call right after wiiuse_poll from the thread which polled
+extern void state_refresh(connman *conn, uint64_t ts);
+
+//copies conn->state into "dst" (conn->n records), consistent even while the poller is writing
+extern void state_read(connman *conn, wii_event *dst);
+
+//copies conn->state[slot] into "dst", consistent even while the poller is writing
+extern void state_read_slot(connman *conn, int slot, wii_event *dst);
+
+//return a frozen Snapshot of the last report of the wiimote in slot "slot" of "conn"
+extern VALUE snapshot_new(connman *conn, int slot);
+
+//return the StateBuffer of the WiimoteManager "manager"
+extern VALUE state_buffer_new(VALUE manager);
+
+//adds a copy of "filter" to the subscriptions of "conn", returns its id or 0 if there is not enough memory
+extern int filter_add(connman *conn, const wii_filter *filter);
+
+//removes the subscription "id" of "conn", returns 0 if there was none
+extern int filter_remove(connman *conn, int id);
+
+//returns 1 if "ev" matches a subscription of "conn" (or there are none), 0 counting it as filtered otherwise
+extern int filter_pass(connman *conn, const wii_event *ev);
+
+//pushes "ev" in "ring", returns 0 (and counts a dropped event) if the ring is full
+extern int ring_push(event_ring *ring, const wii_event *ev);
+
+//pops the oldest event of "ring" in "ev", returns 0 if the ring is empty
+extern int ring_pop(event_ring *ring, wii_event *ev);
+
+//starts the background poller of "conn" with rings of "size" events (rounded to a power of 2)
+extern int poller_start(connman *conn, int size);
+
+//claims the running poller of "conn" to stop it (it stops reading the reports), returns 0 if it is not running
+//or another thread already claimed it. Only the thread which claimed it joins it and frees it
+extern int poller_claim(connman *conn);
+
+//waits for the poller claimed by poller_claim to end, call without the GVL
+extern void poller_join(connman *conn);
+
+//frees the rings of the stopped poller of "conn" and marks it stopped, call with the GVL
+extern void poller_free(connman *conn);
+
+//stops the background poller of "conn" and frees its rings, only when no other thread can use them (finalizer)
+extern void poller_stop(connman *conn);
+
+//type of the synthetic event of a recognised gesture, for the subscriptions (see WiimoteManager#subscribe)
+#define WII_EVENT_GESTURE	31
+
+//the templates of the GestureSet "obj"
+extern gesture_set * gesture_set_get(VALUE obj);
+
+//resets "g" and makes it match the templates of "set" (NULL disables it)
+extern void gesture_attach(gesture_state *g, gesture_set *set);
+
+//feeds the report "ev" to "g", returns the name of the gesture recognised at the end of a motion
+//(and its score in "score") or 0. A motion recorded with "g->recording" is added to the set
+extern ID gesture_update(gesture_state *g, const wii_event *ev, float *score);
+
+//resets "f" to filter the orientation with the time constant "tau" (s), 0 disables it
+extern void fusion_reset(fusion_state *f, float tau);
+
+//feeds the report "ev" to "f": the tilt follows the accelerometer while it measures about 1 g,
+//the yaw follows the ir yaw while at least two ir sources are visible
+extern void fusion_update(fusion_state *f, const wii_event *ev);
+
+//roll, pitch and yaw (degrees) of the orientation of "f" in "angles"
+extern void fusion_angles(const fusion_state *f, float *angles);
+
+//feeds the report "ev" to the smoothing filters of "s"
+extern void smooth_update(smooth_state *s, const wii_event *ev);
+
+//makes "h" keep the last "size" reports (0 disables it), dropping the ones it has. Returns 0 if there is not enough memory
+extern int history_resize(history_state *h, int size);
+
+//adds the report "ev" to "h", overwriting the oldest one when it is full
+extern void history_push(history_state *h, const wii_event *ev);
+
+//computes in "st" the statistics of the values "kind" of the samples of "h" arrived since "since", returns their number
+extern int history_window(const history_state *h, int kind, uint64_t since, history_stats *st);
+
+//forgets the tracks of "tr" (the ids are not reused) and enables or disables it
+extern void track_reset(track_state *tr, int enabled);
+
+//matches the visible ir sources of "ev" to the tracks of "tr" predicted at the time of "ev", with the assignment
+//that minimizes the sum of the squared distances; the sources farther than TRACK_GATE start new tracks
+extern void track_update(track_state *tr, const wii_event *ev);
+
+//computes in "h" the homography mapping the "n" (at least 4) points "src" (x, y pairs) to "dst", least squares
+//if there are more than 4. Returns 0 if the points are degenerate (e.g. 3 of 4 on a line)
+extern int homography_solve(const double *src, const double *dst, int n, double *h);
+
+//maps (x, y) with the homography "h" into "out", returns 0 if the point maps to infinity
+extern int homography_apply(const double *h, double x, double y, double *out);
+
+//maps the ir cursor of the report "ev" into the calibrated position of "c"
+extern void calib_update(calib_state *c, const wii_event *ev);
+
+//window_stats(kind, ms: ms) of the history of the Wiimote "wiimote", of its nunchuk if "exp".
+//Implements Wiimote#window_stats and Nunchuk#window_stats
+extern VALUE wm_window_stats(VALUE wiimote, int exp, int argc, VALUE * argv);
+
+//kinds of effect
+#define EFFECT_RUMBLE		0
+#define EFFECT_LEDS		1
+
+//a step of an effect: "value" (rumble on / off or leds) is kept for "ms" milliseconds
+typedef struct _effect_step {
+  uint32_t ms;
+  int value;
+} effect_step;
+
+//plays the "nsteps" steps of an effect "kind" on "wm", "repeat" times (0 = until cancelled) and then
+//sets "last". An effect of the same kind already running on "wm" is replaced. The wiiuse calls are made
+//holding "io" (the io_lock of the manager of "wm", NULL if it has none). Returns 0 on failure
+extern int effect_start(wiimote *wm, pthread_mutex_t *io, int kind, const effect_step *steps, int nsteps, int repeat, int last);
+
+//stops the effect "kind" of "wm", setting its last value if "restore", returns 0 if there was none
+extern int effect_cancel(wiimote *wm, int kind, int restore);
+
+//stops all the effects of the "n" wiimotes "wms", before they are freed
+extern void effects_cancel_all(wiimote **wms, int n);
+
+//the speaker plays 4 bit Yamaha ADPCM at SPEAKER_RATE samples per second,
+//SPEAKER_REPORT bytes (2 samples each) are sent in a report
+#define SPEAKER_RATE		3000
+#define SPEAKER_REPORT		20
+#define SPEAKER_SAMPLES		(SPEAKER_REPORT * 2)
+
+//lowest rate of the samples played: a frame at a lower rate would make more samples than a stream holds
+#define SPEAKER_MIN_RATE	4
+
+//reports in each of the two buffers of a stream, played while the other one is filled
+#define SPEAKER_BUFFER		32
+
+//formats of the samples played: unsigned 8 bit, signed 16, 24 and 32 bit, 32 bit float, little endian
+#define PCM_U8			1
+#define PCM_S16			2
+#define PCM_S24			3
+#define PCM_S32			4
+#define PCM_F32			5
+
+//bytes of a sample in "format"
+extern int pcm_sample_size(int format);
+
+//converts "frames" frames of "channels" (1 or 2) interleaved samples in "format" to mono 16 bit
+extern void pcm_to_mono(int16_t *dst, const byte *src, long frames, int channels, int format);
+
+//returns the sum of the "n" samples of "x"
+extern int64_t pcm_sum(const int16_t *x, long n);
+
+//returns the vector instructions pcm.c was compiled for: "avx2", "sse2" or "none"
+extern const char * pcm_simd(void);
+
+//a sound played on a wiimote, see speaker.c
+typedef struct _speaker_stream speaker_stream;
+
+//a sound encoded once to be played many times
+typedef struct _speaker_clip speaker_clip;
+
+//reads at most "len" bytes into "dst", returns the number of bytes read (0 at the end)
+typedef size_t (*speaker_read_fn)(void *ctx, void *dst, size_t len);
+
+//reads the header of a PCM WAV up to its samples, returns 0 if it is not valid, not in a PCM_* format or
+//below SPEAKER_MIN_RATE. "len" is set to the size of the samples
+extern int wav_read_header(speaker_read_fn read, void *ctx, int *rate, int *channels, int *format, long *len);
+
+//a new stream of samples in "format", "channels" interleaved at "rate" frames per second.
+//Its samples are read from "file" (at most "len" bytes, -1 = up to the end), from the "len" bytes
+//of "data" (taken by the stream) or, when both are NULL, written with speaker_write.
+//Returns NULL on failure
+extern speaker_stream * speaker_new(wiimote *wm, int rate, int channels, int format, FILE *file, byte *data, long len);
+
+//encodes the samples read with "read" from "ctx" (at most "len" bytes, -1 = up to the end),
+//returns NULL on failure
+extern speaker_clip * speaker_clip_new(int rate, int channels, int format, speaker_read_fn read, void *ctx, long len);
+
+//returns the number of reports of "clip"
+extern long speaker_clip_reports(speaker_clip *clip);
+
+//drops a reference to "clip", freeing it if it is no longer used
+extern void speaker_clip_release(speaker_clip *clip);
+
+//a new stream of the reports of "clip", returns NULL on failure
+extern speaker_stream * speaker_new_clip(wiimote *wm, speaker_clip *clip);
+
+//starts playing "s" on its wiimote (replacing the sound it was playing) from a new thread which sends the
+//reports holding "io" (the io_lock of the manager of the wiimote, NULL if it has none), returns 0 on failure.
+//The caller keeps its reference, to be dropped with speaker_release
+extern int speaker_start(speaker_stream *s, pthread_mutex_t *io);
+
+//writes "len" bytes of samples to "s", waiting while its buffers are full. "len" 0 ends the sound
+//(the samples written are still played). Returns the bytes written (less than "len" if interrupted)
+//or -1 if "s" has been stopped
+extern long speaker_write(speaker_stream *s, const byte *data, long len);
+
+//wakes up a speaker_write waiting on "s"
+extern void speaker_interrupt(void *s);
+
+//drops the reference to "s" returned by speaker_new, freeing it if it is no longer used
+extern void speaker_release(speaker_stream *s);
+
+//stops the sound played on "wm", returns 0 if there was none
+extern int speaker_stop(wiimote *wm);
+
+//returns 1 if "wm" is playing a sound, setting the reports sent and the underruns
+//of the last sound played (when "reports" and "underruns" are not NULL), -1 if it played none
+extern int speaker_status(wiimote *wm, unsigned long *reports, unsigned long *underruns);
+
+//stops the sounds of the "n" wiimotes "wms", before they are freed
+extern void speakers_stop_all(wiimote **wms, int n);
+
+//speaker_read_fn reading a FILE * or a ruby io (a VALUE *)
+extern size_t wii_read_file(void *ctx, void *dst, size_t len);
+extern size_t wii_read_io(void *ctx, void *dst, size_t len);
+
+//returns the PCM_* format of "bits": 8, 16, 24, 32 or :float (nil = 16)
+extern int wii_pcm_format(VALUE bits);
+
+//returns the clip named "name" in the SoundBank "bank", NULL if there is none.
+//It is valid until the bank is changed: take a reference with speaker_new_clip
+extern speaker_clip * sound_bank_clip(VALUE bank, VALUE name);
+
+//return the buffer passed to a getter as "getter(buf)" or "getter(into: buf)", Qnil if none
+extern VALUE wii_into(int argc, VALUE * argv);
+
+//return "buf" overwritten with the "n" values in "vals", or a new array if "buf" is nil
+extern VALUE wii_fill(VALUE buf, int n, const VALUE * vals);
+
+//runs "func(data)" without holding the GVL (when the ruby version allows it),
+//"ubf(data)" is called if the thread is interrupted while "func" is running
+extern void * wii_without_gvl(void * (*func)(void *), void * data, void (*ubf)(void *), void * ubf_data);
+
 #endif //WII4R_H
@@ -22,14 +22,35 @@
 */
 
 #include "wii4r.h"
+#include<string.h>
+
+//ids and status keys, resolved once by init_wiimote
+static ID id_exp, id_motion_sensing, id_ir, id_speaker, id_sound_source, id_sound_bank, id_read, id_gestures, id_wiimote;
+static VALUE sym_id, sym_battery, sym_speaker, sym_ir, sym_led, sym_attachment, sym_blink, sym_chase, sym_reports, sym_underruns;
+static VALUE sym_roll, sym_pitch, sym_yaw, sym_quaternion;
+static VALUE sym_position, sym_acceleration, sym_ema, sym_one_euro, sym_alpha, sym_min_cutoff, sym_beta, sym_d_cutoff;
+static VALUE sym_accel, sym_gforce, sym_ms, sym_count, sym_min, sym_max, sym_mean, sym_variance;
 
 //handles the disconnection of wiimote
 void free_wiimote(void * wm) {
-  wiiuse_disconnect((wiimote *) wm);
+  if(wm) wiiuse_disconnect((wiimote *) wm);
 }
 
 void set_expansion(VALUE self, VALUE exp_obj) {
-  rb_iv_set(self, "@exp", exp_obj);
+  rb_ivar_set(self, id_exp, exp_obj);
+  if(!NIL_P(exp_obj)) rb_ivar_set(exp_obj, id_wiimote, self);
+}
+
+//locks the io_lock of the manager of "self" for a wiiuse call, the poller may be in wiiuse_poll on the same
+//wiimote. Returns the lock to pass to wm_io_unlock, NULL if "self" has no manager
+static pthread_mutex_t * wm_io_lock(VALUE self) {
+  pthread_mutex_t *io = cm_io_lock(self);
+  if(io) pthread_mutex_lock(io);
+  return io;
+}
+
+static void wm_io_unlock(pthread_mutex_t *io) {
+  if(io) pthread_mutex_unlock(io);
 }
 
 static VALUE rb_wm_new(VALUE self) {
@@ -40,23 +61,21 @@ static VALUE rb_wm_new(VALUE self) {
 }
 
 static VALUE rb_wm_init(VALUE self) {
-  rb_iv_set(self, "@rumble", Qfalse);
-  rb_iv_set(self, "@smoothed", rb_hash_new());
   wiimote *wm;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   if(!WIIUSE_USING_ACC(wm))
-    rb_iv_set(self, "@motion_sensing", Qfalse);
+    rb_ivar_set(self, id_motion_sensing, Qfalse);
   else 
-    rb_iv_set(self, "@motion_sensing", Qtrue);
+    rb_ivar_set(self, id_motion_sensing, Qtrue);
   if(!WIIUSE_USING_IR(wm)) 
-    rb_iv_set(self, "@ir", Qfalse);
+    rb_ivar_set(self, id_ir, Qfalse);
   else
-    rb_iv_set(self, "@ir", Qtrue);
+    rb_ivar_set(self, id_ir, Qtrue);
   if(!WIIUSE_USING_SPEAKER(wm))
-    rb_iv_set(self, "@speaker", Qfalse);
+    rb_ivar_set(self, id_speaker, Qfalse);
   else
-    rb_iv_set(self, "@speaker", Qtrue);
+    rb_ivar_set(self, id_speaker, Qtrue);
   return self;
 }
 
@@ -69,8 +88,10 @@ static VALUE rb_wm_init(VALUE self) {
  */
 
 static VALUE rb_wm_get_rumble(VALUE self) {
-  VALUE rumble = rb_iv_get(self, "@rumble");
-  return rumble;
+  wiimote * wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qfalse;
+  return WIIMOTE_IS_SET(wm, WIIMOTE_STATE_RUMBLE) ? Qtrue : Qfalse;
 }
 
 /*
@@ -78,11 +99,13 @@ static VALUE rb_wm_get_rumble(VALUE self) {
  *	wiimote.rumble = true or false		-> nil
  *
  *  Set the rumble property of <i>self</i> to true or false and makes the device rumble or stop.
+ *  A timed rumble started by <code>rumble!</code> is cancelled.
  *
  */
 
 static VALUE rb_wm_set_rumble(VALUE self, VALUE arg) {
   wiimote * wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   
@@ -98,64 +121,56 @@ static VALUE rb_wm_set_rumble(VALUE self, VALUE arg) {
       rb_raise(rb_eTypeError, "Invalid Argument");
       break;
   }
+  effect_cancel(wm, EFFECT_RUMBLE, 0);
+  io = wm_io_lock(self);
   wiiuse_rumble(wm, rumble);
-  rb_iv_set(self, "@rumble", arg);
+  wm_io_unlock(io);
   return arg;
 }
 
 /*
  *  call-seq:
- *	wiimote.rumble!			 -> nil
- *	wiimote.rumble!(duration)	 -> nil
- *	wiimote.rumble!(duration, times) -> nil
+ *	wiimote.rumble!				-> nil
+ *	wiimote.rumble!(duration)		-> nil
+ *	wiimote.rumble!(duration, times)	-> nil
+ *	wiimote.rumble!(duration, times, pause)	-> nil
  *
  *  The first form puts <i>self</i> in rumbling state.
  *  The second one puts <i>self</i> in rumbling state for <i>duration</i> seconds.
- *  The last one puts <i>self</i> in rumbling state for <i>duration</i> seconds for <i>times</i> times, separated by 1 sec of pause.
+ *  The others put <i>self</i> in rumbling state for <i>duration</i> seconds for <i>times</i> times,
+ *  separated by <i>pause</i> seconds (default 1).
+ *  The timed forms return immediately: the rumble is played by a native thread, with millisecond precision,
+ *  while the wiimotes keep being polled. It can be cancelled with <code>stop!</code>.
  *
+ *	wmote.rumble!(0.2, 3, 0.1)
  */
 
-
 static VALUE rb_wm_rumble(int argc, VALUE * argv, VALUE self) {
   wiimote * wm;
+  pthread_mutex_t *io;
+  VALUE duration, times, pause;
+  effect_step steps[2];
+  int repeat;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
-  
-  wiiuse_rumble(wm, 1);
-  rb_iv_set(self, "@rumble", Qtrue);
-  if(argc == 1) {
-    switch(TYPE(argv[0])) {
-      case T_FIXNUM:
-        //fork o thread?
-        sleep(NUM2INT(argv[0]));
-        wiiuse_rumble(wm, 0);
-        rb_iv_set(self, "@rumble", Qfalse);
-        break;
-      case T_ARRAY:
-      default:
-        rb_raise(rb_eTypeError, "Invalid Argument");
-        break;
-    }
-  }
-  else if(argc == 2) {
-    if(TYPE(argv[0]) == T_FIXNUM && TYPE(argv[1]) == T_FIXNUM) {
-      int i = NUM2INT(argv[1]);
-      int stime = NUM2INT(argv[0]);
-      while(i > 1) {
-        sleep(stime);
-        wiiuse_rumble(wm, 0);
-        sleep(1);
-        wiiuse_rumble(wm, 1);
-        i--;
-      }
-      sleep(stime);
-      wiiuse_rumble(wm, 0);
-      rb_iv_set(self, "@rumble", Qfalse);
-    }
-  }
-  else {
-    rb_raise(rb_eTypeError, "Invalid Argument");
+  rb_scan_args(argc, argv, "03", &duration, &times, &pause);
+
+  if(NIL_P(duration)) {
+    effect_cancel(wm, EFFECT_RUMBLE, 0);
+    io = wm_io_lock(self);
+    wiiuse_rumble(wm, 1);
+    wm_io_unlock(io);
+    return Qnil;
   }
+  if(NUM2DBL(duration) <= 0) rb_raise(rb_eArgError, "duration must be positive");
+  repeat = NIL_P(times) ? 1 : NUM2INT(times);
+  if(repeat < 1) rb_raise(rb_eArgError, "times must be positive");
+  steps[0].ms = (uint32_t) (NUM2DBL(duration) * 1000);
+  steps[0].value = 1;
+  steps[1].ms = (uint32_t) ((NIL_P(pause) ? 1.0 : NUM2DBL(pause)) * 1000);
+  steps[1].value = 0;
+  if(!effect_start(wm, cm_io_lock(self), EFFECT_RUMBLE, steps, repeat > 1 ? 2 : 1, repeat, 0))
+    rb_raise(gen_exp_class, "cannot start the rumble");
   return Qnil;
 }
 
@@ -163,17 +178,20 @@ static VALUE rb_wm_rumble(int argc, VALUE * argv, VALUE self) {
  *  call-seq:
  *	wiimote.stop!		-> nil
  *
- *  Turns the rumbling state of <i>self</i> to false.
+ *  Turns the rumbling state of <i>self</i> to false, cancelling a timed rumble.
  *
  */
 
 static VALUE rb_wm_stop(VALUE self) {
   wiimote * wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   
+  effect_cancel(wm, EFFECT_RUMBLE, 0);
+  io = wm_io_lock(self);
   wiiuse_rumble(wm, 0);
-  rb_iv_set(self, "@rumble", Qfalse);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -188,14 +206,22 @@ static VALUE rb_wm_stop(VALUE self) {
  *
  *	#turns on led 2 and 3
  *	wmote.leds = LED_2 | LED_3 #=>(LED_2 | LED_3 value) 
+ *
+ *  A pattern started by <code>leds_pattern</code> is cancelled.
  */ 
 
 static VALUE rb_wm_leds(VALUE self, VALUE arg) {
   wiimote * wm;
+  pthread_mutex_t *io;
+  int leds;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   
-  wiiuse_set_leds(wm, NUM2INT(arg));
+  leds = NUM2INT(arg);
+  effect_cancel(wm, EFFECT_LEDS, 0);
+  io = wm_io_lock(self);
+  wiiuse_set_leds(wm, leds);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -203,15 +229,82 @@ static VALUE rb_wm_leds(VALUE self, VALUE arg) {
  *  call-seq:
  *	wiimote.turn_off_leds!		-> nil
  *
- *  Turns off all the leds of <i>self</i>.
+ *  Turns off all the leds of <i>self</i>, cancelling a pattern started by <code>leds_pattern</code>.
  *
  */
 
 static VALUE rb_wm_turnoff(VALUE self) {
   wiimote * wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
+  effect_cancel(wm, EFFECT_LEDS, 0);
+  io = wm_io_lock(self);
   wiiuse_set_leds(wm, WIIMOTE_LED_NONE);
+  wm_io_unlock(io);
+  return Qnil;
+}
+
+/*
+ *  call-seq:
+ *	wiimote.leds_pattern(pattern)			-> nil
+ *	wiimote.leds_pattern(pattern, interval)		-> nil
+ *	wiimote.leds_pattern(pattern, interval, times)	-> nil
+ *	wiimote.leds_pattern(nil)			-> nil
+ *
+ *  Plays <i>pattern</i> on the leds of <i>self</i>, changing them every <i>interval</i> seconds (default 0.25)
+ *  for <i>times</i> times (default 0, until cancelled), then turns on the leds that were on before.
+ *  <i>pattern</i> is :blink (the leds that are on, or all of them, blink), :chase (one led at a time, from 1 to 4)
+ *  or an array of leds values, played in order.
+ *  Returns immediately: the pattern is played by a native thread while the wiimotes keep being polled.
+ *  The last form cancels the pattern.
+ *
+ *	wmote.leds_pattern(:chase, 0.1)
+ *	wmote.leds_pattern([LED_1 | LED_4, LED_2 | LED_3], 0.5, 10)
+ */
+
+static VALUE rb_wm_leds_pattern(int argc, VALUE * argv, VALUE self) {
+  wiimote * wm;
+  VALUE pattern, interval, times;
+  effect_step *steps;
+  uint32_t ms;
+  int base, nsteps, repeat, i, started;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  rb_scan_args(argc, argv, "12", &pattern, &interval, &times);
+
+  effect_cancel(wm, EFFECT_LEDS, 1);
+  if(NIL_P(pattern)) return Qnil;
+
+  if(!NIL_P(interval) && NUM2DBL(interval) <= 0) rb_raise(rb_eArgError, "interval must be positive");
+  ms = (uint32_t) ((NIL_P(interval) ? 0.25 : NUM2DBL(interval)) * 1000);
+  repeat = NIL_P(times) ? 0 : NUM2INT(times);
+  if(repeat < 0) rb_raise(rb_eArgError, "times must be positive or 0");
+  base = wm->leds;
+
+  if(pattern == sym_blink) nsteps = 2;
+  else if(pattern == sym_chase) nsteps = 4;
+  else {
+    Check_Type(pattern, T_ARRAY);
+    nsteps = (int) RARRAY_LEN(pattern);
+    if(!nsteps || nsteps > 256) rb_raise(rb_eArgError, "a pattern has 1 to 256 values");
+    for(i = 0; i < nsteps; i++)
+      Check_Type(rb_ary_entry(pattern, i), T_FIXNUM);
+  }
+
+  steps = ALLOCA_N(effect_step, nsteps);
+  for(i = 0; i < nsteps; i++) {
+    steps[i].ms = ms;
+    if(pattern == sym_blink)
+      steps[i].value = i ? WIIMOTE_LED_NONE : (base ? base : WIIMOTE_LED_1 | WIIMOTE_LED_2 | WIIMOTE_LED_3 | WIIMOTE_LED_4);
+    else if(pattern == sym_chase)
+      steps[i].value = WIIMOTE_LED_1 << i;
+    else
+      steps[i].value = FIX2INT(rb_ary_entry(pattern, i));
+  }
+
+  started = effect_start(wm, cm_io_lock(self), EFFECT_LEDS, steps, nsteps, repeat, base);
+  if(!started) rb_raise(gen_exp_class, "cannot start the leds pattern");
   return Qnil;
 }
 
@@ -224,7 +317,7 @@ static VALUE rb_wm_turnoff(VALUE self) {
  */
 
 static VALUE rb_wm_get_ms(VALUE self) {
-  return rb_iv_get(self, "@motion_sensing");
+  return rb_ivar_get(self, id_motion_sensing);
 }
 
 /*
@@ -249,13 +342,16 @@ static VALUE rb_wm_set_ms(VALUE self, VALUE arg) {
       rb_raise(rb_eTypeError, "Invalid Argument");
   }
   
-  rb_iv_set(self, "@motion_sensing", arg);
+  rb_ivar_set(self, id_motion_sensing, arg);
   
   wiimote * wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   
+  io = wm_io_lock(self);
   wiiuse_motion_sensing(wm, motion_sensing);
+  wm_io_unlock(io);
   return arg;
 }
 
@@ -276,10 +372,13 @@ static VALUE rb_wm_set_ms(VALUE self, VALUE arg) {
 
 static VALUE rb_wm_status(VALUE self) {
   wiimote * wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   
+  io = wm_io_lock(self);
   wiiuse_status(wm);
+  wm_io_unlock(io);
   
   VALUE status_hash = rb_hash_new();
   VALUE speaker = Qnil;
@@ -300,11 +399,14 @@ static VALUE rb_wm_status(VALUE self) {
   	switch(wm->exp.type){
 		case EXP_NUNCHUK:		
 			expansion = rb_str_new2("Nunchuk");
+			break;
 		case EXP_CLASSIC:	
 			expansion = rb_str_new2("Classic Controller"); 
+			break;
 		case EXP_GUITAR_HERO_3:	
 			expansion = rb_str_new2("Guitar Hero Controller");
-		case EXP_NONE:	
+			break;
+		default:	
 			expansion = rb_str_new2("Nothing Inserted");
         }
 		
@@ -315,12 +417,12 @@ static VALUE rb_wm_status(VALUE self) {
   else if(WIIUSE_IS_LED_SET(wm, 4)) led = rb_str_new2("LED_4");
   else led = rb_str_new2("NONE");
   
-  rb_hash_aset(status_hash,ID2SYM(rb_intern("id")),INT2NUM(wm->unid));
-  rb_hash_aset(status_hash,ID2SYM(rb_intern("battery")),rb_float_new(wm->battery_level));
-  rb_hash_aset(status_hash,ID2SYM(rb_intern("speaker")),speaker);
-  rb_hash_aset(status_hash,ID2SYM(rb_intern("ir")),ir);
-  rb_hash_aset(status_hash,ID2SYM(rb_intern("led")), led);
-  rb_hash_aset(status_hash,ID2SYM(rb_intern("attachment")),expansion);
+  rb_hash_aset(status_hash,sym_id,INT2NUM(wm->unid));
+  rb_hash_aset(status_hash,sym_battery,rb_float_new(wm->battery_level));
+  rb_hash_aset(status_hash,sym_speaker,speaker);
+  rb_hash_aset(status_hash,sym_ir,ir);
+  rb_hash_aset(status_hash,sym_led, led);
+  rb_hash_aset(status_hash,sym_attachment,expansion);
   return status_hash;
 }
 
@@ -335,11 +437,14 @@ static VALUE rb_wm_status(VALUE self) {
 
 static VALUE rb_wm_disconnect(VALUE self) {
  wiimote *wm;
+ pthread_mutex_t *io;
  Data_Get_Struct(self, wiimote, wm);
  if(!wm) return Qnil;
  
  if(wm_connected(wm)) {
+	io = wm_io_lock(self);
 	wiiuse_disconnected(wm);
+	wm_io_unlock(io);
 	return Qtrue;
  }	 
  else return Qfalse; 	
@@ -446,6 +551,101 @@ static VALUE rb_wm_released(VALUE self, VALUE arg) {
   else return Qtrue;
 }
 
+/*
+ * call-seq:
+ *	wiimote.buttons	-> int
+ *
+ * Returns the bitmask of the buttons being pressed on <i>self</i> (BUTTON_* constants, or'ed).
+ *
+ *	fire! if wiimote.buttons & (BUTTON_A | BUTTON_B) != 0
+ *
+ */
+
+static VALUE rb_wm_buttons(VALUE self) {
+  wiimote *wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  return INT2NUM(wm->btns);
+}
+
+/*
+ * call-seq:
+ *	wiimote.buttons_pressed	-> int
+ *
+ * Returns the bitmask of the buttons just pressed on <i>self</i>, the ones for which just_pressed? is true.
+ *
+ */
+
+static VALUE rb_wm_buttons_pressed(VALUE self) {
+  wiimote *wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  return INT2NUM(wm->btns & ~(wm->btns_held));
+}
+
+/*
+ * call-seq:
+ *	wiimote.buttons_held	-> int
+ *
+ * Returns the bitmask of the buttons being held on <i>self</i>.
+ *
+ */
+
+static VALUE rb_wm_buttons_held(VALUE self) {
+  wiimote *wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  return INT2NUM(wm->btns_held);
+}
+
+/*
+ * call-seq:
+ *	wiimote.buttons_released	-> int
+ *
+ * Returns the bitmask of the buttons just released on <i>self</i>.
+ *
+ */
+
+static VALUE rb_wm_buttons_released(VALUE self) {
+  wiimote *wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  return INT2NUM(wm->btns_released);
+}
+
+/*
+ * call-seq:
+ *	wiimote.all_buttons	-> int
+ *
+ * Returns the bitmask of the buttons being pressed on <i>self</i> and on its expansion: the wiimote buttons
+ * in the low 16 bits, the expansion buttons shifted left by EXP_BUTTONS_SHIFT (16).
+ * Two masks can be compared to find the buttons pressed or released in between.
+ *
+ *	now = wiimote.all_buttons
+ *	pressed, released = now & ~before, before & ~now
+ *	jump! if pressed & (N_BUTTON_Z << EXP_BUTTONS_SHIFT) != 0
+ *
+ */
+
+static VALUE rb_wm_all_buttons(VALUE self) {
+  wiimote *wm;
+  unsigned long exp = 0;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  switch(wm->exp.type) {
+    case EXP_NUNCHUK:
+      exp = wm->exp.nunchuk.btns;
+      break;
+    case EXP_CLASSIC:
+      exp = (uint16_t) wm->exp.classic.btns;
+      break;
+    case EXP_GUITAR_HERO_3:
+      exp = (uint16_t) wm->exp.gh3.btns;
+      break;
+  }
+  return ULONG2NUM((exp << WII_EXP_BUTTONS_SHIFT) | wm->btns);
+}
+
 /*
  * call-seq:
  *	wiimote.yaw	-> float
@@ -539,7 +739,7 @@ static VALUE rb_wm_aroll(VALUE self) {
  */
 
 static VALUE rb_wm_ir(VALUE self) {
-  return rb_iv_get(self, "@ir");
+  return rb_ivar_get(self, id_ir);
 }
 
 /*
@@ -553,6 +753,7 @@ static VALUE rb_wm_ir(VALUE self) {
 
 static VALUE rb_wm_set_ir(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   int ir;
@@ -560,52 +761,73 @@ static VALUE rb_wm_set_ir(VALUE self, VALUE arg) {
   else if(arg == Qfalse) ir = 0;
   else rb_raise(gen_exp_class, "Invalid Argument");
 
+  io = wm_io_lock(self);
   if(WIIUSE_USING_IR(wm) && ir == 0) wiiuse_set_ir(wm, ir);
   else if(ir == 1) wiiuse_set_ir(wm, ir);
+  wm_io_unlock(io);
   
-  if(WIIUSE_USING_IR(wm)) rb_iv_set(self, "@ir", Qtrue);
-  else rb_iv_set(self, "@ir", Qfalse);
+  if(WIIUSE_USING_IR(wm)) rb_ivar_set(self, id_ir, Qtrue);
+  else rb_ivar_set(self, id_ir, Qfalse);
   return arg;
 }
 
 /*
  * call-seq:
- *	wiimote.ir_sources	-> array
+ *	wiimote.ir_sources		-> array
+ *	wiimote.ir_sources(buf)	-> buf
  *
  * Returns an array containing the position [x, y] of all the ir sources seen by <i>self</i>.
+ * If <i>buf</i> is given, its elements (and the [x, y] arrays it already contains) are overwritten and no new array is created.
  *
  */
 
-static VALUE rb_wm_ir_sources(VALUE self) {
+static VALUE rb_wm_ir_sources(int argc, VALUE * argv, VALUE self) {
   wiimote *wm;
+  VALUE buf = wii_into(argc, argv);
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   if(!WIIUSE_USING_IR(wm)) return Qnil;
-  VALUE ary = rb_ary_new();
+  VALUE ary = NIL_P(buf) ? rb_ary_new() : buf;
   int i = 0;
-  VALUE source;
+  long n = 0;
+  VALUE source, xy[2];
   for(; i < 4; i++) {
     if(wm->ir.dot[i].visible) {
-      source = rb_ary_new();
-      rb_ary_push(source, INT2NUM(wm->ir.dot[i].x));
-      rb_ary_push(source, INT2NUM(wm->ir.dot[i].y));
-      rb_ary_push(ary, source);
+      xy[0] = INT2NUM(wm->ir.dot[i].x);
+      xy[1] = INT2NUM(wm->ir.dot[i].y);
+      source = n < RARRAY_LEN(ary) ? rb_ary_entry(ary, n) : Qnil;
+      if(TYPE(source) != T_ARRAY || OBJ_FROZEN(source)) source = Qnil;
+      rb_ary_store(ary, n++, wii_fill(source, 2, xy));
     }
   }
+  if(RARRAY_LEN(ary) > n) rb_ary_resize(ary, n);
   return ary;
 }
 
 /*
  * call-seq:
- *	wiimote.position 	-> array
+ *	wiimote.position 		-> array
+ *	wiimote.position(buf)	-> buf
  *
  * Returns an array containing the position [x, y] of <i>self</i> (works only with ir tracking enabled and at least one ir source visible).
+ * If <i>buf</i> is given, it is overwritten with [x, y] and no new array is created.
  *
  */
 
-static VALUE rb_wm_ir_cursor(VALUE self) {
+static VALUE rb_wm_ir_cursor(int argc, VALUE * argv, VALUE self) {
   wiimote *wm;
+  VALUE buf = wii_into(argc, argv);
+  VALUE xy[2];
   Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  if(!WIIUSE_USING_IR(wm)) return Qnil;
+  xy[0] = INT2NUM(wm->ir.x);
+  xy[1] = INT2NUM(wm->ir.y);
+  return wii_fill(buf, 2, xy);
+}
+
+//position of "wm", shared with WiimoteManager#positions
+VALUE wm_position(wiimote *wm) {
   if(!wm) return Qnil;
   if(!WIIUSE_USING_IR(wm)) return Qnil;
   VALUE ary = rb_ary_new();
@@ -660,9 +882,14 @@ static VALUE rb_wm_sensitivity(VALUE self) {
 
 static VALUE rb_wm_set_sens(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  int level;
   Data_Get_Struct(self,wiimote,wm);
   if(!wm) return Qnil;
-  wiiuse_set_ir_sensitivity(wm,NUM2INT(arg));
+  level = NUM2INT(arg);
+  io = wm_io_lock(self);
+  wiiuse_set_ir_sensitivity(wm, level);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -692,10 +919,15 @@ static VALUE rb_wm_speaker(VALUE self) {
 
 static VALUE rb_wm_bl(VALUE self) {
   wiimote *wm;	
+  pthread_mutex_t *io;
+  float level;
   Data_Get_Struct(self,wiimote,wm);
   if(!wm) return Qnil;
+  io = wm_io_lock(self);
   wiiuse_status(wm);
-  return rb_float_new(wm->battery_level); 
+  level = wm->battery_level;
+  wm_io_unlock(io);
+  return rb_float_new(level);
 }
 
 /*
@@ -708,11 +940,16 @@ static VALUE rb_wm_bl(VALUE self) {
 
 static VALUE rb_wm_aratio(VALUE self) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  int aspect;
   Data_Get_Struct(self,wiimote,wm);
   if(!wm) return Qnil;
+  io = wm_io_lock(self);
   wiiuse_status(wm);
-  if (wm->ir.aspect == WIIUSE_ASPECT_4_3) return rb_str_new2("4:3"); 
-  else if (wm->ir.aspect == WIIUSE_ASPECT_16_9) return rb_str_new2("16:9");
+  aspect = wm->ir.aspect;
+  wm_io_unlock(io);
+  if (aspect == WIIUSE_ASPECT_4_3) return rb_str_new2("4:3"); 
+  else if (aspect == WIIUSE_ASPECT_16_9) return rb_str_new2("16:9");
   return Qnil;
 }
 
@@ -726,10 +963,15 @@ static VALUE rb_wm_aratio(VALUE self) {
 
 static VALUE rb_wm_set_aratio(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  int aspect;
   Data_Get_Struct(self,wiimote,wm);
   if(!wm) return Qnil;
   Check_Type(arg, T_FIXNUM);
-  wiiuse_set_aspect_ratio(wm,NUM2INT(arg));
+  aspect = NUM2INT(arg);
+  io = wm_io_lock(self);
+  wiiuse_set_aspect_ratio(wm, aspect);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -761,6 +1003,8 @@ static VALUE rb_wm_vres(VALUE self) {
 
 static VALUE rb_wm_set_vres(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  int x, y;
   Data_Get_Struct(self,wiimote,wm);
   if(!wm) return Qnil;
   Check_Type(arg, T_ARRAY);
@@ -773,7 +1017,11 @@ static VALUE rb_wm_set_vres(VALUE self, VALUE arg) {
 	v_ary[i] = rb_ary_aref(1, argv, arg);
 	Check_Type(v_ary[i], T_FIXNUM);
   }
-  wiiuse_set_ir_vres(wm, NUM2INT(v_ary[0]), NUM2INT(v_ary[1]));
+  x = NUM2INT(v_ary[0]);
+  y = NUM2INT(v_ary[1]);
+  io = wm_io_lock(self);
+  wiiuse_set_ir_vres(wm, x, y);
+  wm_io_unlock(io);
   return Qnil;	
 }
 
@@ -804,9 +1052,14 @@ static VALUE rb_wm_pos(VALUE self) {
  
 static VALUE rb_wm_set_pos(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  int pos;
   Data_Get_Struct(self,wiimote,wm);	
   if(!wm) return Qnil;
-  wiiuse_set_ir_position(wm,NUM2INT(arg));
+  pos = NUM2INT(arg);
+  io = wm_io_lock(self);
+  wiiuse_set_ir_position(wm, pos);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -938,40 +1191,49 @@ static VALUE rb_wm_ir_acursor(VALUE self) {
 
 /*
  * call-seq:
- *	wiimote.acceleration	-> array
+ *	wiimote.acceleration		-> array
+ *	wiimote.acceleration(buf)	-> buf
  *
  * Returns an array containing the three components of acceleration [x, y, z] of <i>self</i>.
+ * If <i>buf</i> is given, it is overwritten with [x, y, z] and no new array is created.
  *
+ *	buf = []
+ *	loop { wiimote.acceleration(buf) }
  */
 
-static VALUE rb_wm_accel(VALUE self) {
+static VALUE rb_wm_accel(int argc, VALUE * argv, VALUE self) {
   wiimote *wm;
+  VALUE buf = wii_into(argc, argv);
+  VALUE xyz[3];
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
-  VALUE ary = rb_ary_new();
-  rb_ary_push(ary, INT2NUM(wm->accel.x));
-  rb_ary_push(ary, INT2NUM(wm->accel.y));
-  rb_ary_push(ary, INT2NUM(wm->accel.z));
-  return ary;  
+  xyz[0] = INT2NUM(wm->accel.x);
+  xyz[1] = INT2NUM(wm->accel.y);
+  xyz[2] = INT2NUM(wm->accel.z);
+  return wii_fill(buf, 3, xyz);
 }
 
 /*
  * call-seq:
- *	wiimote.gravity_force	-> array
+ *	wiimote.gravity_force			-> array
+ *	wiimote.gravity_force(buf)	-> buf
  *
  * Returns an array containing the three components of gravity force [x, y, z] of <i>self</i>.
+ * If <i>buf</i> is given, it is overwritten with [x, y, z] and no new array is created
+ * (on 64 bit rubies the floats are immediate values, so nothing is allocated).
  *
  */
  
-static VALUE rb_wm_gforce(VALUE self) {
+static VALUE rb_wm_gforce(int argc, VALUE * argv, VALUE self) {
   wiimote *wm;
+  VALUE buf = wii_into(argc, argv);
+  VALUE xyz[3];
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
-  VALUE ary = rb_ary_new();
-  rb_ary_push(ary, rb_float_new(wm->gforce.x));
-  rb_ary_push(ary, rb_float_new(wm->gforce.y));
-  rb_ary_push(ary, rb_float_new(wm->gforce.z));
-  return ary;
+  xyz[0] = rb_float_new(wm->gforce.x);
+  xyz[1] = rb_float_new(wm->gforce.y);
+  xyz[2] = rb_float_new(wm->gforce.z);
+  return wii_fill(buf, 3, xyz);
 }
 
 /*
@@ -999,9 +1261,14 @@ static VALUE rb_wm_accel_threshold(VALUE self) {
 
 static VALUE rb_wm_set_accel_threshold(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  int threshold;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
-  wiiuse_set_accel_threshold(wm, NUM2INT(arg));
+  threshold = NUM2INT(arg);
+  io = wm_io_lock(self);
+  wiiuse_set_accel_threshold(wm, threshold);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -1030,9 +1297,14 @@ static VALUE rb_wm_orient_threshold(VALUE self) {
 
 static VALUE rb_wm_set_orient_threshold(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
+  float threshold;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
-  wiiuse_set_orient_threshold(wm,(float)NUM2DBL(arg));
+  threshold = (float) NUM2DBL(arg);
+  io = wm_io_lock(self);
+  wiiuse_set_orient_threshold(wm, threshold);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -1046,12 +1318,16 @@ static VALUE rb_wm_set_orient_threshold(VALUE self, VALUE arg) {
 
 static VALUE rb_wm_set_nun_athreshold(VALUE self, VALUE arg) {
   wiimote *wm;
-  VALUE nun = rb_funcall(self, rb_intern("has_nunchuk?"), 0, NULL);
-  if(nun == Qtrue) {
-    Data_Get_Struct(self, wiimote, wm);
-    if(!wm) return Qnil;
+  pthread_mutex_t *io;
+  int threshold;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  if(wm->exp.type == EXP_NUNCHUK) {
     Check_Type(arg, T_FIXNUM);
-    wiiuse_set_nunchuk_accel_threshold(wm, NUM2INT(arg));
+    threshold = NUM2INT(arg);
+    io = wm_io_lock(self);
+    wiiuse_set_nunchuk_accel_threshold(wm, threshold);
+    wm_io_unlock(io);
   }
   return Qnil;
 }
@@ -1066,12 +1342,16 @@ static VALUE rb_wm_set_nun_athreshold(VALUE self, VALUE arg) {
 
 static VALUE rb_wm_set_nun_othreshold(VALUE self, VALUE arg) {
   wiimote *wm;
-  VALUE nun = rb_funcall(self, rb_intern("has_nunchuk?"), 0, NULL);
-  if(nun == Qtrue) {
-    Data_Get_Struct(self, wiimote, wm);
-    if(!wm) return Qnil;
+  pthread_mutex_t *io;
+  float threshold;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  if(wm->exp.type == EXP_NUNCHUK) {
     Check_Type(arg, T_FLOAT);
-    wiiuse_set_nunchuk_orient_threshold(wm, (float)NUM2DBL(arg));
+    threshold = (float) NUM2DBL(arg);
+    io = wm_io_lock(self);
+    wiiuse_set_nunchuk_orient_threshold(wm, threshold);
+    wm_io_unlock(io);
   }
   return Qnil;
 }
@@ -1086,12 +1366,15 @@ static VALUE rb_wm_set_nun_othreshold(VALUE self, VALUE arg) {
 
 static VALUE rb_wm_set_speaker(VALUE self, VALUE arg) {
   wiimote *wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
   int speaker = 0;
   if(arg == Qtrue) speaker = 1;
   else if(arg != Qfalse) rb_raise(rb_eTypeError, "Invalid Argument");
+  io = wm_io_lock(self);
   wiiuse_set_speaker(wm, speaker);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -1105,9 +1388,12 @@ static VALUE rb_wm_set_speaker(VALUE self, VALUE arg) {
 
 static VALUE rb_wm_mute_speaker(VALUE self) {
   wiimote *wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
+  io = wm_io_lock(self);
   wiiuse_mute_speaker(wm, 1);
+  wm_io_unlock(io);
   return Qnil;
 }
 
@@ -1121,49 +1407,1002 @@ static VALUE rb_wm_mute_speaker(VALUE self) {
 
 static VALUE rb_wm_unmute_speaker(VALUE self) {
   wiimote *wm;
+  pthread_mutex_t *io;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
+  io = wm_io_lock(self);
   wiiuse_mute_speaker(wm, 0);
+  wm_io_unlock(io);
+  return Qnil;
+}
+
+//enables and unmutes the speaker of "wm" (wrapped by "self")
+static void wm_speaker_on(VALUE self, wiimote *wm) {
+  pthread_mutex_t *io = wm_io_lock(self);
+  if(!WIIUSE_USING_SPEAKER(wm))
+    wiiuse_set_speaker(wm, 1);
+  if(WIIUSE_SPEAKER_MUTE(wm))
+    wiiuse_mute_speaker(wm, 0);
+  wm_io_unlock(io);
+}
+
+//starts playing "s" on "wm" (wrapped by "self"), releasing it
+static void wm_speaker_start(VALUE self, wiimote *wm, speaker_stream *s) {
+  int started;
+  wm_speaker_on(self, wm);
+  started = speaker_start(s, cm_io_lock(self));
+  speaker_release(s);
+  if(!started) rb_raise(gen_exp_class, "cannot start playing");
+}
+
+typedef struct {
+  speaker_stream *s;
+  VALUE io;
+} sound_feeder;
+
+typedef struct {
+  speaker_stream *s;
+  const byte *data;
+  long len;
+  long ret;
+} sound_chunk;
+
+static void * sound_write_nogvl(void * ptr) {
+  sound_chunk *c = (sound_chunk *) ptr;
+  c->ret = speaker_write(c->s, c->data, c->len);
+  return NULL;
+}
+
+//body of the thread feeding a stream with the samples read from an io
+static VALUE sound_feed_io(VALUE arg) {
+  sound_feeder *f = (sound_feeder *) arg;
+  sound_chunk c;
+  VALUE str;
+  long pos;
+  c.s = f->s;
+  while(!NIL_P(str = rb_funcall(f->io, id_read, 1, INT2FIX(4096)))) {
+    StringValue(str);
+    for(pos = 0; pos < RSTRING_LEN(str); pos += c.ret) {
+      c.data = (const byte *) RSTRING_PTR(str) + pos;
+      c.len = RSTRING_LEN(str) - pos;
+      wii_without_gvl(sound_write_nogvl, &c, speaker_interrupt, f->s);
+      if(c.ret < 0) return Qnil;
+      rb_thread_check_ints();
+    }
+  }
   return Qnil;
 }
 
+static VALUE sound_feed_end(VALUE arg) {
+  sound_feeder *f = (sound_feeder *) arg;
+  speaker_write(f->s, NULL, 0);
+  speaker_release(f->s);
+  return Qnil;
+}
+
+static VALUE sound_feed(void * ptr) {
+  sound_feeder f = *(sound_feeder *) ptr;
+  free(ptr);
+  return rb_ensure(sound_feed_io, (VALUE) &f, sound_feed_end, (VALUE) &f);
+}
+
+//starts playing "s" on "wm", written with the samples read from "io" by a new ruby thread
+static void wm_speaker_feed(VALUE self, wiimote *wm, speaker_stream *s, VALUE io) {
+  sound_feeder *f = malloc(sizeof(sound_feeder));
+  if(!f) {
+    speaker_release(s);
+    rb_raise(gen_exp_class, "not enough memory");
+  }
+  wm_speaker_on(self, wm);
+  if(!speaker_start(s, cm_io_lock(self))) {
+    free(f);
+    speaker_release(s);
+    rb_raise(gen_exp_class, "cannot start playing");
+  }
+  //the thread takes the reference to "s", "io" is kept alive until the next sound
+  f->s = s;
+  f->io = io;
+  rb_ivar_set(self, id_sound_source, io);
+  rb_thread_create(sound_feed, f);
+}
+
 /*
  * call-seq:
  *	wiimote.play(wav_file_path)	-> nil
+ *	wiimote.play(io)		-> nil
+ *	wiimote.play(name)		-> nil
  *
- * Plays the 16 bit WAV file passed as argument, converting it to the right format for the wiimote speaker.
+ * Plays a PCM WAV (8, 16, 24 or 32 bit, or 32 bit float, mono or stereo, at 4 or more frames per second), read from
+ * a file or from <i>io</i>.
  * If speaker is disabled or muted it'll be enabled/unmuted first.
+ * Returns immediately: the sound is converted to the format of the wiimote speaker and sent by a
+ * native thread, reading the samples while it plays. The sound played by <i>self</i> is stopped.
+ * The last form plays the sound <i>name</i> (a Symbol) of the <code>sound_bank</code> of <i>self</i>,
+ * already converted: nothing is read.
+ *
+ *	wmote.play("sounds/beep.wav")
+ *	File.open("long.wav", "rb") { |f| wmote.play(f); sleep 0.1 while wmote.playing? }
+ *	wmote.play(:hit)
  *
  */
 
 static VALUE rb_wm_play(VALUE self, VALUE file) {
   wiimote *wm;
+  speaker_stream *s;
+  speaker_clip *clip;
+  FILE *fp;
+  int rate, channels, format;
+  long len;
   Data_Get_Struct(self, wiimote, wm);
   if(!wm) return Qnil;
+
+  if(SYMBOL_P(file)) {
+    VALUE bank = rb_ivar_get(self, id_sound_bank);
+    if(NIL_P(bank)) rb_raise(gen_exp_class, "no sound bank");
+    clip = sound_bank_clip(bank, file);
+    if(!clip) rb_raise(gen_exp_class, "no sound named %s in the sound bank", rb_id2name(SYM2ID(file)));
+    s = speaker_new_clip(wm, clip);
+    if(!s) rb_raise(gen_exp_class, "not enough memory");
+    wm_speaker_start(self, wm, s);
+    return Qnil;
+  }
+
+  if(rb_respond_to(file, id_read)) {
+    if(!wav_read_header(wii_read_io, &file, &rate, &channels, &format, &len))
+      rb_raise(gen_exp_class, "not a PCM WAV");
+    s = speaker_new(wm, rate, channels, format, NULL, NULL, -1);
+    if(!s) rb_raise(gen_exp_class, "not enough memory");
+    wm_speaker_feed(self, wm, s, file);
+    return Qnil;
+  }
+
   Check_Type(file, T_STRING);
-  
-  byte *w_sample = NULL;
-  w_sample = wiiuse_convert_wav(StringValue(file), 10);
-  if(!WIIUSE_USING_SPEAKER(wm))
-    wiiuse_set_speaker(wm, 1);
-  if(WIIUSE_SPEAKER_MUTE(wm))
-    wiiuse_mute_speaker(wm, 0);
-  wiiuse_play_sound(wm, w_sample, sizeof(w_sample));
+  fp = fopen(StringValueCStr(file), "rb");
+  if(!fp) rb_raise(gen_exp_class, "cannot open %s", StringValueCStr(file));
+  if(!wav_read_header(wii_read_file, fp, &rate, &channels, &format, &len)) {
+    fclose(fp);
+    rb_raise(gen_exp_class, "%s is not a PCM WAV", StringValueCStr(file));
+  }
+  s = speaker_new(wm, rate, channels, format, fp, NULL, len);
+  if(!s) {
+    fclose(fp);
+    rb_raise(gen_exp_class, "not enough memory");
+  }
+  wm_speaker_start(self, wm, s);
+  return Qnil;
+}
+
+/*
+ * call-seq:
+ *	wiimote.play_pcm(data)			-> nil
+ *	wiimote.play_pcm(data, rate)		-> nil
+ *	wiimote.play_pcm(data, rate, channels)	-> nil
+ *	wiimote.play_pcm(data, rate, channels, bits)	-> nil
+ *
+ * Plays raw little endian PCM samples, <i>channels</i> (1 or 2, default 1) interleaved
+ * at <i>rate</i> frames per second (default 8000, at least 4). <i>bits</i> is 8 (unsigned), 16 (the default),
+ * 24, 32 (signed) or :float. <i>data</i> is a String or an io the samples are read from while playing.
+ * Returns immediately, as <code>play</code>.
+ *
+ *	wmote.play_pcm(samples.pack("s<*"), 3000)
+ *	wmote.play_pcm(IO.popen(["sox", "song.mp3", "-t", "raw", "-e", "float", "-b", "32", "-"]), 44100, 2, :float)
+ *
+ */
+
+static VALUE rb_wm_play_pcm(int argc, VALUE * argv, VALUE self) {
+  wiimote *wm;
+  speaker_stream *s;
+  VALUE data, vrate, vchannels, vbits;
+  byte *copy;
+  long len;
+  int rate, channels, format;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  rb_scan_args(argc, argv, "13", &data, &vrate, &vchannels, &vbits);
+  rate = NIL_P(vrate) ? 8000 : NUM2INT(vrate);
+  channels = NIL_P(vchannels) ? 1 : NUM2INT(vchannels);
+  format = wii_pcm_format(vbits);
+  if(rate < SPEAKER_MIN_RATE) rb_raise(rb_eArgError, "rate must be at least %d", SPEAKER_MIN_RATE);
+  if(channels < 1 || channels > 2) rb_raise(rb_eArgError, "channels must be 1 or 2");
+
+  if(rb_respond_to(data, id_read)) {
+    s = speaker_new(wm, rate, channels, format, NULL, NULL, -1);
+    if(!s) rb_raise(gen_exp_class, "not enough memory");
+    wm_speaker_feed(self, wm, s, data);
+    return Qnil;
+  }
+
+  StringValue(data);
+  len = RSTRING_LEN(data);
+  copy = malloc(len ? len : 1);
+  if(!copy) rb_raise(gen_exp_class, "not enough memory");
+  memcpy(copy, RSTRING_PTR(data), len);
+  s = speaker_new(wm, rate, channels, format, NULL, copy, len);
+  if(!s) {
+    free(copy);
+    rb_raise(gen_exp_class, "not enough memory");
+  }
+  wm_speaker_start(self, wm, s);
   return Qnil;
 }
 
+/*
+ * call-seq:
+ *	wiimote.play_sound	-> nil
+ *
+ * Plays a short beep, to test the speaker of <i>self</i>.
+ *
+ */
+
 static VALUE rb_wm_ps(VALUE self) {
   wiimote *wm;
+  speaker_stream *s;
+  byte *beep;
+  int i;
   Data_Get_Struct(self, wiimote, wm);
-  if(!WIIUSE_USING_SPEAKER(wm))
-    wiiuse_set_speaker(wm, 1);
-  if(WIIUSE_SPEAKER_MUTE(wm))
-    wiiuse_mute_speaker(wm, 0);
-  byte song[8] = { 0xCC, 0x33, 0xCC, 0x33, 0xCC, 0x33, 0xCC, 0x33 };
-  wiiuse_play_sound(wm, song, 8);
+  if(!wm) return Qnil;
+  //half a second of a 600 Hz square wave
+  beep = malloc(SPEAKER_RATE);
+  if(!beep) rb_raise(gen_exp_class, "not enough memory");
+  for(i = 0; i < SPEAKER_RATE / 2; i++) {
+    int16_t x = (i / (SPEAKER_RATE / 1200)) & 1 ? -8192 : 8192;
+    beep[2 * i] = x & 0xFF;
+    beep[2 * i + 1] = (x >> 8) & 0xFF;
+  }
+  s = speaker_new(wm, SPEAKER_RATE, 1, PCM_S16, NULL, beep, SPEAKER_RATE);
+  if(!s) {
+    free(beep);
+    rb_raise(gen_exp_class, "not enough memory");
+  }
+  wm_speaker_start(self, wm, s);
+  return Qnil;
+}
+
+/*
+ * call-seq:
+ *	wiimote.sound_bank = bank	-> bank
+ *
+ * Sets the <code>SoundBank</code> (or nil) with the sounds played by <code>play(name)</code>.
+ * A bank can be shared by many wiimotes.
+ *
+ */
+
+static VALUE rb_wm_set_sound_bank(VALUE self, VALUE bank) {
+  if(!NIL_P(bank) && !rb_obj_is_kind_of(bank, bank_class)) rb_raise(rb_eTypeError, "Invalid Argument");
+  rb_ivar_set(self, id_sound_bank, bank);
+  return bank;
+}
+
+/*
+ * call-seq:
+ *	wiimote.sound_bank	-> bank or nil
+ *
+ * Returns the <code>SoundBank</code> of <i>self</i>.
+ *
+ */
+
+static VALUE rb_wm_sound_bank(VALUE self) {
+  return rb_ivar_get(self, id_sound_bank);
+}
+
+//orientation filter of the Wiimote "self", NULL if it is disabled
+static fusion_state * wm_fusion(VALUE self) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn || !(conn->fusion) || !(conn->fusion[slot].tau)) return NULL;
+  return &(conn->fusion[slot]);
+}
+
+/*
+ * call-seq:
+ *	wiimote.orientation_filter = tau	-> tau
+ *
+ * Filters the orientation of <i>self</i> on every report (see <code>orientation</code>) with a time constant
+ * of <i>tau</i> seconds: the lower, the faster it follows the wiimote and the noisier it is. nil disables it.
+ * Motion sensing must be enabled, and ir tracking too for the yaw.
+ *
+ *	wiimote.orientation_filter = 0.1
+ *
+ */
+
+static VALUE rb_wm_set_orientation_filter(VALUE self, VALUE tau) {
+  connman *conn;
+  int slot;
+  double t = NIL_P(tau) ? 0 : NUM2DBL(tau);
+  if(t < 0) rb_raise(rb_eArgError, "tau must not be negative");
+  conn = cm_of(self, &slot);
+  if(!conn) rb_raise(gen_exp_class, "Wiimote not connected to a WiimoteManager, cannot filter the orientation");
+  if(!(conn->fusion) && t > 0) {
+    conn->fusion = calloc(conn->n, sizeof(fusion_state));
+    if(!(conn->fusion)) rb_raise(gen_exp_class, "not enough memory");
+  }
+  if(conn->fusion) fusion_reset(&(conn->fusion[slot]), (float) t);
+  return tau;
+}
+
+/*
+ * call-seq:
+ *	wiimote.orientation_filter	-> float or nil
+ *
+ * Returns the time constant (seconds) of the orientation filter of <i>self</i>, nil if it is disabled.
+ *
+ */
+
+static VALUE rb_wm_orientation_filter(VALUE self) {
+  fusion_state *f = wm_fusion(self);
+  if(!f) return Qnil;
+  return rb_float_new(f->tau);
+}
+
+/*
+ * call-seq:
+ *	wiimote.orientation	-> hash or nil
+ *
+ * Returns the filtered orientation of <i>self</i>, nil if <code>orientation_filter</code> is not set or no report
+ * was polled since: roll (around Y axis, degrees), pitch (around X axis, from -90 to 90 degrees), yaw (around Z axis,
+ * degrees, 0 until the ir sources are seen) and the same rotation as a quaternion [w, x, y, z].
+ * The tilt is smoothed and kept while the wiimote is shaken; the yaw is kept while the ir sources are not visible.
+ *
+ *	wiimote.orientation	#=> {:roll=>12.1, :pitch=>-3.4, :yaw=>0.0, :quaternion=>[0.99, -0.03, -0.1, 0.0]}
+ *
+ */
+
+static VALUE rb_wm_orientation(VALUE self) {
+  fusion_state *f = wm_fusion(self);
+  VALUE hash;
+  float a[3];
+  if(!f || !(f->ts)) return Qnil;
+  fusion_angles(f, a);
+  hash = rb_hash_new();
+  rb_hash_aset(hash, sym_roll, rb_float_new(a[0]));
+  rb_hash_aset(hash, sym_pitch, rb_float_new(a[1]));
+  rb_hash_aset(hash, sym_yaw, rb_float_new(a[2]));
+  rb_hash_aset(hash, sym_quaternion, rb_ary_new3(4, rb_float_new(f->q[0]), rb_float_new(f->q[1]),
+    rb_float_new(f->q[2]), rb_float_new(f->q[3])));
+  return hash;
+}
+
+//smoothing filter "target" (:position or :acceleration) of "s" (NULL if "s" is), its number of axes in "n"
+static smooth_filter * wm_smooth_target(smooth_state *s, VALUE target, int *n) {
+  if(target == sym_position) {
+    *n = 2;
+    return s ? &(s->position) : NULL;
+  }
+  if(target == sym_acceleration) {
+    *n = 3;
+    return s ? &(s->accel) : NULL;
+  }
+  rb_raise(rb_eArgError, "can smooth only :position or :acceleration");
+  return NULL;
+}
+
+//reads the parameter "key" of "params" (a number, or an array of one number per axis) into the
+//parameter "idx" of the "n" axes of "f", "def" if it is not given. Raises if it is not above "min"
+static void wm_smooth_param(smooth_filter *f, int n, int idx, VALUE params, VALUE key, float def, float min) {
+  VALUE v = NIL_P(params) ? Qnil : rb_hash_aref(params, key), x;
+  int i;
+  for(i = 0; i < n; i++) {
+    x = TYPE(v) == T_ARRAY ? rb_ary_entry(v, i) : v;
+    f->param[i][idx] = NIL_P(x) ? def : (float) NUM2DBL(x);
+    if(!(f->param[i][idx] > min)) rb_raise(rb_eArgError, "%s must be greater than %g", rb_id2name(SYM2ID(key)), min);
+  }
+}
+
+/*
+ * call-seq:
+ *	wiimote.smooth(target, :ema, alpha: a)						-> wiimote
+ *	wiimote.smooth(target, :one_euro, min_cutoff: f, beta: b, d_cutoff: d)	-> wiimote
+ *	wiimote.smooth(target, nil)							-> wiimote
+ *
+ * Smooths the <i>target</i> of <i>self</i>, :position (see <code>smoothed_position</code>) or :acceleration
+ * (see <code>smoothed_acceleration</code>), on every report; nil stops it. Every parameter is a number or an array
+ * with one number per axis.
+ * - :ema, exponential moving average: every report moves the value by <i>alpha</i> (0 to 1, default 0.5) towards the
+ *   report
+ * - :one_euro, One Euro filter: a low pass filter whose cutoff frequency is <i>min_cutoff</i> (Hz, default 1.0) when
+ *   the value is still and rises by <i>beta</i> (default 0.0) per unit per second of speed, estimated with a cutoff of
+ *   <i>d_cutoff</i> (Hz, default 1.0). Lower <i>min_cutoff</i> to reduce the jitter, raise <i>beta</i> to reduce the lag.
+ *
+ *	wiimote.smooth(:position, :one_euro, min_cutoff: 1.0, beta: 0.01)
+ *	wiimote.smooth(:acceleration, :ema, alpha: [0.3, 0.3, 0.6])
+ *
+ */
+
+static VALUE rb_wm_smooth(int argc, VALUE * argv, VALUE self) {
+  connman *conn;
+  smooth_filter f, *dst;
+  VALUE target, kind, params;
+  int slot, n, i;
+  rb_scan_args(argc, argv, "12", &target, &kind, &params);
+  if(!NIL_P(params)) Check_Type(params, T_HASH);
+  wm_smooth_target(NULL, target, &n);
+  conn = cm_of(self, &slot);
+  if(!conn) rb_raise(gen_exp_class, "Wiimote not connected to a WiimoteManager, cannot do smooth");
+  if(!(conn->smooth) && !NIL_P(kind)) {
+    conn->smooth = calloc(conn->n, sizeof(smooth_state));
+    if(!(conn->smooth)) rb_raise(gen_exp_class, "not enough memory");
+  }
+  if(!(conn->smooth)) return self;
+  memset(&f, 0, sizeof(smooth_filter));
+  dst = wm_smooth_target(&(conn->smooth[slot]), target, &n);
+  if(kind == sym_ema) {
+    f.kind = SMOOTH_EMA;
+    wm_smooth_param(&f, n, 0, params, sym_alpha, 0.5f, 0);
+    for(i = 0; i < n; i++)
+      if(f.param[i][0] > 1) rb_raise(rb_eArgError, "alpha must not be greater than 1");
+  }
+  else if(kind == sym_one_euro) {
+    f.kind = SMOOTH_ONE_EURO;
+    wm_smooth_param(&f, n, 0, params, sym_min_cutoff, 1.0f, 0);
+    wm_smooth_param(&f, n, 1, params, sym_beta, 0.0f, -1e-9f);
+    wm_smooth_param(&f, n, 2, params, sym_d_cutoff, 1.0f, 0);
+  }
+  else if(!NIL_P(kind)) rb_raise(rb_eArgError, "unknown filter, use :ema or :one_euro");
+  *dst = f;
+  return self;
+}
+
+//the filter "target" of the Wiimote "self", NULL if it never had one
+static smooth_filter * wm_smooth_filter(VALUE self, VALUE target) {
+  connman *conn;
+  int slot, n;
+  conn = cm_of(self, &slot);
+  return wm_smooth_target(conn && conn->smooth ? &(conn->smooth[slot]) : NULL, target, &n);
+}
+
+/*
+ * call-seq:
+ *	wiimote.smoothing(target)	-> symbol or nil
+ *
+ * Returns the filter (:ema or :one_euro) smoothing the <i>target</i> (:position or :acceleration) of <i>self</i>,
+ * nil if there is none.
+ *
+ */
+
+static VALUE rb_wm_smoothing(VALUE self, VALUE target) {
+  smooth_filter *f = wm_smooth_filter(self, target);
+  if(!f) return Qnil;
+  switch(f->kind) {
+    case SMOOTH_EMA:
+      return sym_ema;
+    case SMOOTH_ONE_EURO:
+      return sym_one_euro;
+  }
   return Qnil;
 }
 
+//the filter "target" of the Wiimote "self" if it has a value, NULL otherwise
+static smooth_filter * wm_smoothed(VALUE self, VALUE target) {
+  smooth_filter *f = wm_smooth_filter(self, target);
+  if(!f || !(f->kind) || !(f->ts)) return NULL;
+  return f;
+}
+
+/*
+ * call-seq:
+ *	wiimote.smoothed_position		-> array or nil
+ *	wiimote.smoothed_position(buf)	-> buf or nil
+ *
+ * Returns the ir cursor position [x, y] of <i>self</i> smoothed by <code>smooth(:position, ...)</code>, nil if it is not
+ * smoothed or no ir source is visible. If <i>buf</i> is given, it is overwritten with [x, y] and no new array is created.
+ *
+ */
+
+static VALUE rb_wm_smoothed_position(int argc, VALUE * argv, VALUE self) {
+  VALUE buf = wii_into(argc, argv);
+  VALUE xy[2];
+  smooth_filter *f = wm_smoothed(self, sym_position);
+  if(!f) return Qnil;
+  xy[0] = rb_float_new(f->x[0]);
+  xy[1] = rb_float_new(f->x[1]);
+  return wii_fill(buf, 2, xy);
+}
+
+/*
+ * call-seq:
+ *	wiimote.smoothed_acceleration		-> array or nil
+ *	wiimote.smoothed_acceleration(buf)	-> buf or nil
+ *
+ * Returns the acceleration [x, y, z] of <i>self</i> (in the units of <code>acceleration</code>) smoothed by
+ * <code>smooth(:acceleration, ...)</code>, nil if it is not smoothed or no report was polled since.
+ * If <i>buf</i> is given, it is overwritten with [x, y, z] and no new array is created.
+ *
+ */
+
+static VALUE rb_wm_smoothed_accel(int argc, VALUE * argv, VALUE self) {
+  VALUE buf = wii_into(argc, argv);
+  VALUE xyz[3];
+  smooth_filter *f = wm_smoothed(self, sym_acceleration);
+  if(!f) return Qnil;
+  xyz[0] = rb_float_new(f->x[0]);
+  xyz[1] = rb_float_new(f->x[1]);
+  xyz[2] = rb_float_new(f->x[2]);
+  return wii_fill(buf, 3, xyz);
+}
+
+/*
+ * call-seq:
+ *	wiimote.history = size	-> size
+ *
+ * Keeps the last <i>size</i> reports of <i>self</i> (acceleration, gravity force, ir cursor and nunchuk motion,
+ * 48 bytes each) for <code>window_stats</code>; nil or 0 stops it. The reports kept are dropped.
+ *
+ *	wiimote.history = 1000	# 10 s at 100 reports per second
+ *
+ */
+
+static VALUE rb_wm_set_history(VALUE self, VALUE size) {
+  connman *conn;
+  int slot, n = NIL_P(size) ? 0 : NUM2INT(size);
+  if(n < 0) rb_raise(rb_eArgError, "size must not be negative");
+  conn = cm_of(self, &slot);
+  if(!conn) rb_raise(gen_exp_class, "Wiimote not connected to a WiimoteManager, cannot keep a history");
+  if(!(conn->history) && n) {
+    conn->history = calloc(conn->n, sizeof(history_state));
+    if(!(conn->history)) rb_raise(gen_exp_class, "not enough memory");
+  }
+  if(conn->history && !history_resize(&(conn->history[slot]), n))
+    rb_raise(gen_exp_class, "not enough memory");
+  return size;
+}
+
+//history of the Wiimote "self", NULL if it keeps none
+static history_state * wm_history(VALUE self) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn || !(conn->history) || !(conn->history[slot].size)) return NULL;
+  return &(conn->history[slot]);
+}
+
+/*
+ * call-seq:
+ *	wiimote.history	-> int or nil
+ *
+ * Returns the number of reports of <i>self</i> kept for <code>window_stats</code>, nil if it keeps none.
+ *
+ */
+
+static VALUE rb_wm_history(VALUE self) {
+  history_state *h = wm_history(self);
+  if(!h) return Qnil;
+  return INT2NUM(h->size);
+}
+
+//array with the "n" values of "v"
+static VALUE wm_stats_ary(const double *v, int n) {
+  VALUE ary = rb_ary_new2(n);
+  int i;
+  for(i = 0; i < n; i++) rb_ary_push(ary, rb_float_new(v[i]));
+  return ary;
+}
+
+VALUE wm_window_stats(VALUE wiimote, int exp, int argc, VALUE * argv) {
+  history_state *h;
+  history_stats st;
+  VALUE target, opts, ms, hash;
+  uint64_t since = 0, now;
+  int kind;
+  rb_scan_args(argc, argv, "11", &target, &opts);
+  if(target == sym_accel) kind = exp ? HISTORY_EXP_ACCEL : HISTORY_ACCEL;
+  else if(target == sym_gforce) kind = exp ? HISTORY_EXP_GFORCE : HISTORY_GFORCE;
+  else if(target == sym_position && !exp) kind = HISTORY_POSITION;
+  else rb_raise(rb_eArgError, exp ? "can compute only :accel or :gforce" : "can compute only :accel, :gforce or :position");
+  if(!NIL_P(opts)) Check_Type(opts, T_HASH);
+  ms = NIL_P(opts) ? Qnil : rb_hash_aref(opts, sym_ms);
+  h = NIL_P(wiimote) ? NULL : wm_history(wiimote);
+  if(!h) rb_raise(gen_exp_class, "Wiimote keeps no history, set Wiimote#history first");
+  if(!NIL_P(ms)) {
+    if(NUM2DBL(ms) < 0) rb_raise(rb_eArgError, "ms must not be negative");
+    now = wii_now();
+    since = (uint64_t) (NUM2DBL(ms) * 1e6);
+    since = since < now ? now - since : 0;
+  }
+  if(!history_window(h, kind, since, &st)) return Qnil;
+  hash = rb_hash_new();
+  rb_hash_aset(hash, sym_count, INT2NUM(st.count));
+  rb_hash_aset(hash, sym_min, wm_stats_ary(st.min, st.axes));
+  rb_hash_aset(hash, sym_max, wm_stats_ary(st.max, st.axes));
+  rb_hash_aset(hash, sym_mean, wm_stats_ary(st.mean, st.axes));
+  rb_hash_aset(hash, sym_variance, wm_stats_ary(st.var, st.axes));
+  return hash;
+}
+
+/*
+ * call-seq:
+ *	wiimote.window_stats(target)		-> hash or nil
+ *	wiimote.window_stats(target, ms: ms)	-> hash or nil
+ *
+ * Returns the statistics of the <i>target</i> of the reports of <i>self</i> arrived in the last <i>ms</i> milliseconds
+ * (all the <code>history</code> if not given), computed per axis without creating an object per report:
+ * {count: n, min: [...], max: [...], mean: [...], variance: [...]}. The <i>target</i> is :accel (raw acceleration),
+ * :gforce or :position (ir cursor, only the reports with a visible ir source). Returns nil if there are no reports.
+ *
+ *	wiimote.history = 500
+ *	wiimote.window_stats(:gforce, ms: 500)[:variance]
+ *
+ */
+
+static VALUE rb_wm_window_stats(int argc, VALUE * argv, VALUE self) {
+  return wm_window_stats(self, 0, argc, argv);
+}
+
+//ir tracking of the Wiimote "self", NULL if it is disabled
+static track_state * wm_tracks(VALUE self) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn || !(conn->tracks) || !(conn->tracks[slot].enabled)) return NULL;
+  return &(conn->tracks[slot]);
+}
+
+/*
+ * call-seq:
+ *	wiimote.ir_tracking = true or false	-> true or false
+ *
+ * Follows the ir sources of <i>self</i> on every report (see <code>ir_tracks</code>). Disabling it forgets the tracks.
+ *
+ */
+
+static VALUE rb_wm_set_ir_tracking(VALUE self, VALUE enable) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn) rb_raise(gen_exp_class, "Wiimote not connected to a WiimoteManager, cannot track the ir sources");
+  if(!(conn->tracks) && RTEST(enable)) {
+    conn->tracks = calloc(conn->n, sizeof(track_state));
+    if(!(conn->tracks)) rb_raise(gen_exp_class, "not enough memory");
+  }
+  if(conn->tracks) track_reset(&(conn->tracks[slot]), RTEST(enable));
+  return enable;
+}
+
+/*
+ * call-seq:
+ *	wiimote.ir_tracking?	-> true or false
+ *
+ * Returns true if the ir sources of <i>self</i> are tracked.
+ *
+ */
+
+static VALUE rb_wm_ir_tracking(VALUE self) {
+  return wm_tracks(self) ? Qtrue : Qfalse;
+}
+
+/*
+ * call-seq:
+ *	wiimote.ir_tracks		-> array or nil
+ *	wiimote.ir_tracks(buf)	-> buf or nil
+ *
+ * Returns the ir sources visible in the last report of <i>self</i> as [id, x, y, vx, vy], oldest first: unlike the
+ * order of <code>ir_sources</code>, the <i>id</i> of a source stays the same while it moves, and for a short while
+ * when it is not visible. The velocity is in pixels of the ir camera per second. Returns nil if <code>ir_tracking</code>
+ * is disabled. If <i>buf</i> is given, its elements (and the arrays it already contains) are overwritten and no new
+ * array is created.
+ *
+ *	wiimote.ir_tracking = true
+ *	wm.poll { |(wiimote, event)| wiimote.ir_tracks.each { |id, x, y, vx, vy| ... } }
+ *
+ */
+
+static VALUE rb_wm_ir_tracks(int argc, VALUE * argv, VALUE self) {
+  VALUE buf = wii_into(argc, argv);
+  track_state *tr = wm_tracks(self);
+  VALUE ary, track, v[5];
+  ir_track *t;
+  long n = 0;
+  int i;
+  if(!tr) return Qnil;
+  ary = NIL_P(buf) ? rb_ary_new() : buf;
+  for(i = 0; i < tr->ntracks; i++) {
+    t = &(tr->tracks[i]);
+    if(t->dot < 0) continue;
+    v[0] = UINT2NUM(t->id);
+    v[1] = INT2NUM((int) t->x);
+    v[2] = INT2NUM((int) t->y);
+    v[3] = rb_float_new(t->vx);
+    v[4] = rb_float_new(t->vy);
+    track = n < RARRAY_LEN(ary) ? rb_ary_entry(ary, n) : Qnil;
+    if(TYPE(track) != T_ARRAY || OBJ_FROZEN(track)) track = Qnil;
+    rb_ary_store(ary, n++, wii_fill(track, 5, v));
+  }
+  if(RARRAY_LEN(ary) > n) rb_ary_resize(ary, n);
+  return ary;
+}
+
+//calibration of the Wiimote "self", NULL if it is not calibrated
+static calib_state * wm_calib(VALUE self) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn || !(conn->calib) || !(conn->calib[slot].enabled)) return NULL;
+  return &(conn->calib[slot]);
+}
+
+//calibrates "self" with the homography "h", NULL removes the calibration
+static void wm_set_calib(VALUE self, const double *h) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn) rb_raise(gen_exp_class, "Wiimote not connected to a WiimoteManager, cannot calibrate");
+  if(!(conn->calib) && h) {
+    conn->calib = calloc(conn->n, sizeof(calib_state));
+    if(!(conn->calib)) rb_raise(gen_exp_class, "not enough memory");
+  }
+  if(!(conn->calib)) return;
+  memset(&(conn->calib[slot]), 0, sizeof(calib_state));
+  if(!h) return;
+  memcpy(conn->calib[slot].h, h, sizeof(conn->calib[slot].h));
+  conn->calib[slot].enabled = 1;
+}
+
+//reads the [x, y] array "xy" into "p"
+static void wm_calib_point(VALUE xy, double *p) {
+  Check_Type(xy, T_ARRAY);
+  if(RARRAY_LEN(xy) != 2) rb_raise(rb_eArgError, "points must be [x, y]");
+  p[0] = NUM2DBL(rb_ary_entry(xy, 0));
+  p[1] = NUM2DBL(rb_ary_entry(xy, 1));
+}
+
+/*
+ * call-seq:
+ *	wiimote.calibrate(pairs)	-> wiimote
+ *
+ * Calibrates <i>self</i> on a screen from 4 to 256 <i>pairs</i> [[x, y], [screen_x, screen_y]] of a
+ * <code>position</code> of <i>self</i> and the screen point (e.g. pixel) it aimed at. The perspective transform is
+ * computed once (least squares if there are more than 4 pairs) and then applied on every report
+ * (see <code>calibrated_position</code>). Raises ArgumentError if the points do not determine it, e.g. if 3 of them
+ * are on a line.
+ *
+ *	wiimote.calibrate([[[112, 95], [0, 0]], [[920, 101], [1919, 0]], [[905, 690], [1919, 1079]], [[130, 676], [0, 1079]]])
+ *
+ */
+
+static VALUE rb_wm_calibrate(VALUE self, VALUE pairs) {
+  double *src, *dst, h[9];
+  VALUE pair;
+  long i, n;
+  Check_Type(pairs, T_ARRAY);
+  n = RARRAY_LEN(pairs);
+  if(n < 4 || n > 256) rb_raise(rb_eArgError, "calibrate takes 4 to 256 pairs of points");
+  src = ALLOCA_N(double, 2 * n);
+  dst = ALLOCA_N(double, 2 * n);
+  for(i = 0; i < n; i++) {
+    pair = rb_ary_entry(pairs, i);
+    Check_Type(pair, T_ARRAY);
+    if(RARRAY_LEN(pair) != 2) rb_raise(rb_eArgError, "pairs must be [[x, y], [screen_x, screen_y]]");
+    wm_calib_point(rb_ary_entry(pair, 0), src + 2 * i);
+    wm_calib_point(rb_ary_entry(pair, 1), dst + 2 * i);
+  }
+  if(!homography_solve(src, dst, (int) n, h)) rb_raise(rb_eArgError, "degenerate points, cannot calibrate");
+  wm_set_calib(self, h);
+  return self;
+}
+
+/*
+ * call-seq:
+ *	wiimote.calibration = matrix	-> matrix
+ *
+ * Calibrates <i>self</i> with a 3x3 <i>matrix</i> (an array of 3 rows) given by <code>calibration</code>, e.g. saved
+ * from a previous <code>calibrate</code>; nil removes the calibration.
+ *
+ */
+
+static VALUE rb_wm_set_calibration(VALUE self, VALUE matrix) {
+  double h[9];
+  VALUE row;
+  int i, j;
+  if(NIL_P(matrix)) {
+    wm_set_calib(self, NULL);
+    return matrix;
+  }
+  Check_Type(matrix, T_ARRAY);
+  if(RARRAY_LEN(matrix) != 3) rb_raise(rb_eArgError, "the matrix must have 3 rows");
+  for(i = 0; i < 3; i++) {
+    row = rb_ary_entry(matrix, i);
+    Check_Type(row, T_ARRAY);
+    if(RARRAY_LEN(row) != 3) rb_raise(rb_eArgError, "the matrix must have 3 columns");
+    for(j = 0; j < 3; j++) h[3 * i + j] = NUM2DBL(rb_ary_entry(row, j));
+  }
+  wm_set_calib(self, h);
+  return matrix;
+}
+
+/*
+ * call-seq:
+ *	wiimote.calibration	-> matrix or nil
+ *
+ * Returns the 3x3 matrix (an array of 3 rows) mapping the <code>position</code> of <i>self</i> to the screen,
+ * nil if it is not calibrated.
+ *
+ */
+
+static VALUE rb_wm_calibration(VALUE self) {
+  calib_state *c = wm_calib(self);
+  VALUE matrix, row;
+  int i, j;
+  if(!c) return Qnil;
+  matrix = rb_ary_new2(3);
+  for(i = 0; i < 3; i++) {
+    row = rb_ary_new2(3);
+    for(j = 0; j < 3; j++) rb_ary_push(row, rb_float_new(c->h[3 * i + j]));
+    rb_ary_push(matrix, row);
+  }
+  return matrix;
+}
+
+/*
+ * call-seq:
+ *	wiimote.calibrated_position		-> array or nil
+ *	wiimote.calibrated_position(buf)	-> buf or nil
+ *
+ * Returns the screen position [x, y] <i>self</i> points at, mapped by <code>calibrate</code> when the last report was
+ * polled; nil if <i>self</i> is not calibrated or no ir source was visible.
+ * If <i>buf</i> is given, it is overwritten with [x, y] and no new array is created.
+ *
+ */
+
+static VALUE rb_wm_calibrated_position(int argc, VALUE * argv, VALUE self) {
+  VALUE buf = wii_into(argc, argv);
+  VALUE xy[2];
+  calib_state *c = wm_calib(self);
+  if(!c || !(c->valid)) return Qnil;
+  xy[0] = rb_float_new(c->pos[0]);
+  xy[1] = rb_float_new(c->pos[1]);
+  return wii_fill(buf, 2, xy);
+}
+
+//gesture engine of the Wiimote "self", NULL if it has no GestureSet
+static gesture_state * wm_gestures(VALUE self) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn || !(conn->gestures) || !(conn->gestures[slot].set)) return NULL;
+  return &(conn->gestures[slot]);
+}
+
+/*
+ * call-seq:
+ *	wiimote.gestures = set	-> set
+ *
+ * Sets the <code>GestureSet</code> (or nil) with the gestures recognised on the reports of <i>self</i>
+ * (see <code>WiimoteManager#poll</code>). A set can be shared by many wiimotes.
+ *
+ */
+
+static VALUE rb_wm_set_gestures(VALUE self, VALUE set) {
+  connman *conn;
+  int slot;
+  gesture_set *gs = NIL_P(set) ? NULL : gesture_set_get(set);
+  conn = cm_of(self, &slot);
+  if(!conn) rb_raise(gen_exp_class, "Wiimote not connected to a WiimoteManager, cannot recognise gestures");
+  if(!(conn->gestures) && gs) {
+    conn->gestures = calloc(conn->n, sizeof(gesture_state));
+    if(!(conn->gestures)) rb_raise(gen_exp_class, "not enough memory");
+  }
+  if(conn->gestures) gesture_attach(&(conn->gestures[slot]), gs);
+  rb_ivar_set(self, id_gestures, set);
+  return set;
+}
+
+/*
+ * call-seq:
+ *	wiimote.gestures	-> set or nil
+ *
+ * Returns the <code>GestureSet</code> of <i>self</i>.
+ *
+ */
+
+static VALUE rb_wm_gestures(VALUE self) {
+  return rb_attr_get(self, id_gestures);
+}
+
+/*
+ * call-seq:
+ *	wiimote.record_gesture(name)	-> wiimote
+ *
+ * Adds the next motion of <i>self</i> to its <code>GestureSet</code> as <i>name</i>, instead of matching it.
+ * The motion is recorded when the events are polled (see <code>WiimoteManager#poll</code>).
+ *
+ *	wiimote.record_gesture(:shake)
+ *	wm.poll { } while wiimote.recording_gesture
+ *
+ */
+
+static VALUE rb_wm_record_gesture(VALUE self, VALUE name) {
+  gesture_state *g = wm_gestures(self);
+  if(!g) rb_raise(gen_exp_class, "Wiimote has no GestureSet, cannot do record_gesture");
+  g->recording = rb_to_id(name);
+  return self;
+}
+
+/*
+ * call-seq:
+ *	wiimote.recording_gesture	-> symbol or nil
+ *
+ * Returns the name of the gesture being recorded (see <code>record_gesture</code>), nil if there is none.
+ *
+ */
+
+static VALUE rb_wm_recording_gesture(VALUE self) {
+  gesture_state *g = wm_gestures(self);
+  if(!g || !(g->recording)) return Qnil;
+  return ID2SYM(g->recording);
+}
+
+/*
+ * call-seq:
+ *	wiimote.last_gesture	-> [name, score, time] or nil
+ *
+ * Returns the last gesture recognised on <i>self</i>, its score and the time of the report which ended it
+ * (as yielded by <code>WiimoteManager#poll</code>), nil if there is none.
+ *
+ */
+
+static VALUE rb_wm_last_gesture(VALUE self) {
+  gesture_state *g = wm_gestures(self);
+  if(!g || !(g->last)) return Qnil;
+  return rb_ary_new3(3, ID2SYM(g->last), rb_float_new(g->last_score), ULL2NUM(g->last_ts));
+}
+
+/*
+ * call-seq:
+ *	wiimote.playing?	-> true or false
+ *
+ * Returns true if <i>self</i> is playing a sound.
+ *
+ */
+
+static VALUE rb_wm_playing(VALUE self) {
+  wiimote *wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qfalse;
+  if(speaker_status(wm, NULL, NULL) == 1) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ * call-seq:
+ *	wiimote.stop_sound!	-> true or false
+ *
+ * Stops the sound played by <i>self</i>, returns false if there was none.
+ *
+ */
+
+static VALUE rb_wm_stop_sound(VALUE self) {
+  wiimote *wm;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qfalse;
+  if(speaker_stop(wm)) return Qtrue;
+  else return Qfalse;
+}
+
+/*
+ * call-seq:
+ *	wiimote.sound_stats	-> hash or nil
+ *
+ * Returns the reports sent to the speaker for the last sound played by <i>self</i> and the times
+ * the samples were not ready in time (an io read too slowly), nil if there is none (no sound was
+ * played since the last <code>stop_sound!</code>).
+ *
+ *	wmote.sound_stats	#=> {:reports => 225, :underruns => 0}
+ *
+ */
+
+static VALUE rb_wm_sound_stats(VALUE self) {
+  wiimote *wm;
+  unsigned long reports, underruns;
+  VALUE stats;
+  Data_Get_Struct(self, wiimote, wm);
+  if(!wm) return Qnil;
+  if(speaker_status(wm, &reports, &underruns) < 0) return Qnil;
+  stats = rb_hash_new();
+  rb_hash_aset(stats, sym_reports, ULONG2NUM(reports));
+  rb_hash_aset(stats, sym_underruns, ULONG2NUM(underruns));
+  return stats;
+}
+
 
 /*
  * call-seq:
@@ -1174,7 +2413,25 @@ static VALUE rb_wm_ps(VALUE self) {
  */
 
 static VALUE rb_wm_get_exp(VALUE self) {
-  return rb_iv_get(self, "@exp");
+  return rb_ivar_get(self, id_exp);
+}
+
+/*
+ * call-seq:
+ *	wiimote.snapshot	-> snapshot
+ *
+ * Returns a frozen Snapshot of the buttons, motion, ir and expansion state of <i>self</i> in its last polled report.
+ * The state is copied in a single call, consistent even while the background poller is writing it, so all the values
+ * read from the snapshot belong to the same report.
+ *
+ */
+
+static VALUE rb_wm_snapshot(VALUE self) {
+  connman *conn;
+  int slot;
+  conn = cm_of(self, &slot);
+  if(!conn) return Qnil;
+  return snapshot_new(conn, slot);
 }
 
 /*
@@ -1189,9 +2446,52 @@ static VALUE rb_wm_get_exp(VALUE self) {
  * - manage pressed, held, released buttons
  * - access battery level, acceleration vector and gravity vector
  *
+ * The vector getters (acceleration, gravity_force, position, ir_sources) accept an array to overwrite,
+ * so that a read loop does not allocate: <code>wiimote.acceleration(buf)</code>.
+ * <code>wiimote.acceleration(into: buf)</code> works too, but ruby allocates a hash for the keyword.
+ *
  */
 
 void init_wiimote(void) {
+  id_exp = rb_intern("@exp");
+  id_motion_sensing = rb_intern("@motion_sensing");
+  id_ir = rb_intern("@ir");
+  id_speaker = rb_intern("@speaker");
+  id_sound_source = rb_intern("@sound_source");
+  id_sound_bank = rb_intern("@sound_bank");
+  id_gestures = rb_intern("@gestures");
+  id_wiimote = rb_intern("@wiimote");
+  id_read = rb_intern("read");
+  sym_id = ID2SYM(rb_intern("id"));
+  sym_battery = ID2SYM(rb_intern("battery"));
+  sym_speaker = ID2SYM(rb_intern("speaker"));
+  sym_ir = ID2SYM(rb_intern("ir"));
+  sym_led = ID2SYM(rb_intern("led"));
+  sym_attachment = ID2SYM(rb_intern("attachment"));
+  sym_blink = ID2SYM(rb_intern("blink"));
+  sym_chase = ID2SYM(rb_intern("chase"));
+  sym_reports = ID2SYM(rb_intern("reports"));
+  sym_underruns = ID2SYM(rb_intern("underruns"));
+  sym_roll = ID2SYM(rb_intern("roll"));
+  sym_pitch = ID2SYM(rb_intern("pitch"));
+  sym_yaw = ID2SYM(rb_intern("yaw"));
+  sym_quaternion = ID2SYM(rb_intern("quaternion"));
+  sym_position = ID2SYM(rb_intern("position"));
+  sym_acceleration = ID2SYM(rb_intern("acceleration"));
+  sym_ema = ID2SYM(rb_intern("ema"));
+  sym_one_euro = ID2SYM(rb_intern("one_euro"));
+  sym_alpha = ID2SYM(rb_intern("alpha"));
+  sym_min_cutoff = ID2SYM(rb_intern("min_cutoff"));
+  sym_beta = ID2SYM(rb_intern("beta"));
+  sym_d_cutoff = ID2SYM(rb_intern("d_cutoff"));
+  sym_accel = ID2SYM(rb_intern("accel"));
+  sym_gforce = ID2SYM(rb_intern("gforce"));
+  sym_ms = ID2SYM(rb_intern("ms"));
+  sym_count = ID2SYM(rb_intern("count"));
+  sym_min = ID2SYM(rb_intern("min"));
+  sym_max = ID2SYM(rb_intern("max"));
+  sym_mean = ID2SYM(rb_intern("mean"));
+  sym_variance = ID2SYM(rb_intern("variance"));
 	
   wii_class = rb_define_class_under(cm_class, "Wiimote", rb_cObject);
   //rb_define_singleton_method(wii_class, "new", rb_wm_new, 0);
@@ -1204,6 +2504,7 @@ void init_wiimote(void) {
   rb_define_method(wii_class, "leds=", rb_wm_leds, 1);
   rb_define_method(wii_class, "led", rb_wm_led, 0);
   rb_define_method(wii_class, "turn_off_leds!", rb_wm_turnoff, 0);
+  rb_define_method(wii_class, "leds_pattern", rb_wm_leds_pattern, -1);
   rb_define_method(wii_class, "motion_sensing?", rb_wm_get_ms, 0);
   rb_define_method(wii_class, "motion_sensing=", rb_wm_set_ms, 1);
   rb_define_method(wii_class, "status", rb_wm_status, 0);
@@ -1216,6 +2517,11 @@ void init_wiimote(void) {
   rb_define_method(wii_class, "just_pressed?", rb_wm_just_pressed, 1);
   rb_define_method(wii_class, "held?", rb_wm_held, 1);
   rb_define_method(wii_class, "released?", rb_wm_released, 1);
+  rb_define_method(wii_class, "buttons", rb_wm_buttons, 0);
+  rb_define_method(wii_class, "buttons_pressed", rb_wm_buttons_pressed, 0);
+  rb_define_method(wii_class, "buttons_held", rb_wm_buttons_held, 0);
+  rb_define_method(wii_class, "buttons_released", rb_wm_buttons_released, 0);
+  rb_define_method(wii_class, "all_buttons", rb_wm_all_buttons, 0);
   rb_define_alias(wii_class, "using_accelerometer?", "motion_sensing?");
   rb_define_method(wii_class, "roll", rb_wm_roll, 0);
   rb_define_method(wii_class, "absolute_roll", rb_wm_aroll, 0);
@@ -1223,20 +2529,48 @@ void init_wiimote(void) {
   rb_define_method(wii_class, "absolute_pitch", rb_wm_apitch, 0);
   rb_define_method(wii_class, "yaw", rb_wm_yaw, 0);
   rb_define_method(wii_class, "using_ir?", rb_wm_ir, 0);
-  rb_define_method(wii_class, "ir_sources", rb_wm_ir_sources, 0);
-  rb_define_method(wii_class, "position", rb_wm_ir_cursor, 0);
+  rb_define_method(wii_class, "ir_sources", rb_wm_ir_sources, -1);
+  rb_define_method(wii_class, "position", rb_wm_ir_cursor, -1);
   rb_define_method(wii_class, "absolute_position", rb_wm_ir_acursor, 0);
   rb_define_method(wii_class, "distance", rb_wm_ir_z, 0);
   rb_define_method(wii_class, "ir=", rb_wm_set_ir, 1);
   rb_define_method(wii_class, "speaker=", rb_wm_set_speaker, 1);
   rb_define_method(wii_class, "speaker?", rb_wm_speaker, 0);
   rb_define_method(wii_class, "play", rb_wm_play, 1);
+  rb_define_method(wii_class, "play_pcm", rb_wm_play_pcm, -1);
+  rb_define_method(wii_class, "sound_bank=", rb_wm_set_sound_bank, 1);
+  rb_define_method(wii_class, "sound_bank", rb_wm_sound_bank, 0);
+  rb_define_method(wii_class, "gestures=", rb_wm_set_gestures, 1);
+  rb_define_method(wii_class, "gestures", rb_wm_gestures, 0);
+  rb_define_method(wii_class, "record_gesture", rb_wm_record_gesture, 1);
+  rb_define_method(wii_class, "recording_gesture", rb_wm_recording_gesture, 0);
+  rb_define_method(wii_class, "last_gesture", rb_wm_last_gesture, 0);
+  rb_define_method(wii_class, "orientation_filter=", rb_wm_set_orientation_filter, 1);
+  rb_define_method(wii_class, "orientation_filter", rb_wm_orientation_filter, 0);
+  rb_define_method(wii_class, "orientation", rb_wm_orientation, 0);
+  rb_define_method(wii_class, "smooth", rb_wm_smooth, -1);
+  rb_define_method(wii_class, "smoothing", rb_wm_smoothing, 1);
+  rb_define_method(wii_class, "smoothed_position", rb_wm_smoothed_position, -1);
+  rb_define_method(wii_class, "smoothed_acceleration", rb_wm_smoothed_accel, -1);
+  rb_define_method(wii_class, "history=", rb_wm_set_history, 1);
+  rb_define_method(wii_class, "history", rb_wm_history, 0);
+  rb_define_method(wii_class, "window_stats", rb_wm_window_stats, -1);
+  rb_define_method(wii_class, "ir_tracking=", rb_wm_set_ir_tracking, 1);
+  rb_define_method(wii_class, "ir_tracking?", rb_wm_ir_tracking, 0);
+  rb_define_method(wii_class, "ir_tracks", rb_wm_ir_tracks, -1);
+  rb_define_method(wii_class, "calibrate", rb_wm_calibrate, 1);
+  rb_define_method(wii_class, "calibration=", rb_wm_set_calibration, 1);
+  rb_define_method(wii_class, "calibration", rb_wm_calibration, 0);
+  rb_define_method(wii_class, "calibrated_position", rb_wm_calibrated_position, -1);
   rb_define_method(wii_class, "play_sound", rb_wm_ps, 0);
   rb_define_method(wii_class, "mute!", rb_wm_mute_speaker, 0);
   //rb_define_method(wii_class, "muted?", rb_wm_muted, 0);
-  //rb_define_method(wii_class, "playing?", rb_wm_playing, 0);
+  rb_define_method(wii_class, "playing?", rb_wm_playing, 0);
+  rb_define_method(wii_class, "stop_sound!", rb_wm_stop_sound, 0);
+  rb_define_method(wii_class, "sound_stats", rb_wm_sound_stats, 0);
   rb_define_method(wii_class, "unmute!", rb_wm_unmute_speaker, 0);
   rb_define_method(wii_class, "exp", rb_wm_get_exp, 0);
+  rb_define_method(wii_class, "snapshot", rb_wm_snapshot, 0);
   rb_define_method(wii_class, "sensitivity", rb_wm_sensitivity, 0);
   rb_define_method(wii_class, "sensitivity=", rb_wm_set_sens, 1);
   rb_define_method(wii_class, "sensor_bar_position", rb_wm_pos, 0);
@@ -1246,8 +2580,8 @@ void init_wiimote(void) {
   rb_define_method(wii_class, "aspect_ratio=", rb_wm_set_aratio, 1);
   rb_define_method(wii_class, "aspect_ratio", rb_wm_aratio, 0);
   rb_define_method(wii_class, "battery_level", rb_wm_bl, 0);
-  rb_define_method(wii_class, "acceleration", rb_wm_accel, 0);
-  rb_define_method(wii_class, "gravity_force", rb_wm_gforce, 0);
+  rb_define_method(wii_class, "acceleration", rb_wm_accel, -1);
+  rb_define_method(wii_class, "gravity_force", rb_wm_gforce, -1);
   rb_define_method(wii_class, "orient_threshold", rb_wm_orient_threshold, 0);
   rb_define_method(wii_class, "orient_threshold=", rb_wm_set_orient_threshold, 1);
   rb_define_method(wii_class, "nunchuk_orient_threshold=", rb_wm_set_nun_othreshold, 1);
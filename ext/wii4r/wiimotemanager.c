@@ -22,31 +22,360 @@
 */
 
 #include "wii4r.h"
+#include<string.h>
 
 extern void set_expansion(VALUE self, VALUE exp_obj);
 
-static VALUE rb_cm_new(VALUE self) {
+//ids and event symbols, resolved once by init_wiimotemanager
+static ID id_wiimotes, id_state_buffer, id_manager;
+static VALUE sym_capacity, sym_slot, sym_events, sym_buttons, sym_min_accel_delta;
+static VALUE sym_generic, sym_status, sym_disconnected, sym_unexpected_disconnect, sym_read, sym_connected;
+static VALUE sym_nunchuk_inserted, sym_nunchuk_removed, sym_classic_inserted, sym_classic_removed;
+static VALUE sym_gh3_inserted, sym_gh3_removed, sym_gesture;
+static VALUE sym_decode, sym_dispatch, sym_count, sym_mean, sym_max, sym_p50, sym_p90, sym_p99, sym_buckets;
+
+//arguments of a poll done outside the GVL
+typedef struct _poll_args {
+  connman *conn;
+  int events;			//value returned by wii_poll
+  volatile int cancelled;	//set by the unblocking function
+} poll_args;
+
+//waits for and reads the pending reports, runs without the GVL: it must not touch ruby objects
+static void * cm_poll_nogvl(void * ptr) {
+  poll_args *args = (poll_args *) ptr;
+  if(!args->cancelled)
+    args->events = wii_poll(args->conn);
+  if(args->events)
+    state_refresh(args->conn, wii_now());
+  return NULL;
+}
+
+//called by ruby when the polling thread is killed or interrupted (Ctrl-C).
+//wiiuse_poll returns on its own read timeout, the interrupt is then handled by ruby
+static void cm_poll_ubf(void * ptr) {
+  poll_args *args = (poll_args *) ptr;
+  args->cancelled = 1;
+}
+
+static VALUE cm_poll_body(VALUE ptr) {
+  wii_without_gvl(cm_poll_nogvl, (void *) ptr, cm_poll_ubf, (void *) ptr);
+  return Qnil;
+}
+
+//clears the polling flag even when an interrupt is raised on the way back from the poll
+static VALUE cm_poll_done(VALUE ptr) {
+  ((poll_args *) ptr)->conn->polling = 0;
+  return Qnil;
+}
+
+//polls the wiimotes of "conn" releasing the GVL, returns the number of events
+static int cm_wiiuse_poll(connman *conn) {
+  poll_args args;
+  if(conn->polling) rb_raise(gen_exp_class, "WiimoteManager is already polling in another thread");
+  args.conn = conn;
+  args.events = 0;
+  args.cancelled = 0;
+  conn->polling = 1;
+  rb_ensure(cm_poll_body, (VALUE) &args, cm_poll_done, (VALUE) &args);
+  return args.events;
+}
+
+//maps the wiiuse event "type" of the Wiimote "wm" (wrapping "wmm") to its symbol, updating the expansion of "wm" when needed
+static VALUE cm_event_name(VALUE wm, wiimote *wmm, int type) {
+  VALUE event_name = Qnil, exp = Qnil;
+  switch(type) {
+    case WIIUSE_EVENT:
+      event_name = sym_generic;
+      break;
+    case WIIUSE_STATUS:
+      event_name = sym_status;
+      break;
+    case WIIUSE_DISCONNECT:
+      event_name = sym_disconnected;
+      break;
+    case WIIUSE_UNEXPECTED_DISCONNECT:
+      event_name = sym_unexpected_disconnect;
+      break;
+    case WIIUSE_READ_DATA:
+      event_name = sym_read;
+      break;
+    case WIIUSE_NUNCHUK_INSERTED:
+      event_name = sym_nunchuk_inserted;
+      exp = Data_Wrap_Struct(nun_class, NULL, NULL, &(wmm->exp.nunchuk));
+      set_expansion(wm, exp);
+      break;
+    case WIIUSE_NUNCHUK_REMOVED:
+      event_name = sym_nunchuk_removed;
+      set_expansion(wm, Qnil);
+      break;
+    case WIIUSE_CLASSIC_CTRL_INSERTED:
+      event_name = sym_classic_inserted;
+      exp = Data_Wrap_Struct(cc_class, NULL, NULL, &(wmm->exp.classic));
+      set_expansion(wm, exp);
+      break;
+    case WIIUSE_CLASSIC_CTRL_REMOVED:
+      event_name = sym_classic_removed;
+      set_expansion(wm, Qnil);
+      break;
+    case WIIUSE_GUITAR_HERO_3_CTRL_INSERTED:
+      event_name = sym_gh3_inserted;
+      exp = Data_Wrap_Struct(gh3_class, NULL, NULL, &(wmm->exp.gh3));
+      set_expansion(wm, exp);
+      break;
+    case WIIUSE_GUITAR_HERO_3_CTRL_REMOVED:
+      event_name = sym_gh3_removed;
+      set_expansion(wm, Qnil);
+      break;
+    case WIIUSE_CONNECT:
+      event_name = sym_connected;
+      break;
+  }
+  return event_name;
+}
+
+//yields [wm, event, arrival time] of the event "ev" to the block given to poll
+static void cm_yield_event(connman *conn, const wii_event *ev) {
+  VALUE wm = conn->slots[ev->slot];
+  VALUE ary = rb_ary_new3(3, wm, cm_event_name(wm, conn->wms[ev->slot], ev->type), ULL2NUM(ev->ts));
+  latency_add(&(conn->latency[ev->slot].dispatch), wii_now() - ev->ts);
+  rb_yield(ary);
+}
+
+//keeps the expansion of the Wiimote of "ev" up to date, without yielding the event
+static void cm_track_event(connman *conn, const wii_event *ev) {
+  VALUE wm;
+  switch(ev->type) {
+    case WIIUSE_NUNCHUK_INSERTED:
+    case WIIUSE_NUNCHUK_REMOVED:
+    case WIIUSE_CLASSIC_CTRL_INSERTED:
+    case WIIUSE_CLASSIC_CTRL_REMOVED:
+    case WIIUSE_GUITAR_HERO_3_CTRL_INSERTED:
+    case WIIUSE_GUITAR_HERO_3_CTRL_REMOVED:
+      wm = conn->slots[ev->slot];
+      if(!NIL_P(wm)) cm_event_name(wm, conn->wms[ev->slot], ev->type);
+      break;
+  }
+}
+
+//appends the record "ev" to the drain buffer "str", keeping the expansion of its Wiimote up to date
+static void cm_drain_event(VALUE str, connman *conn, wii_event *ev) {
+  cm_track_event(conn, ev);
+  rb_str_cat(str, (const char *) ev, sizeof(wii_event));
+  latency_add(&(conn->latency[ev->slot].dispatch), wii_now() - ev->ts);
+}
+
+//feeds "ev" to the smoothing, the history, the ir tracking, the calibration, the orientation filter
+//and the gesture engine of its slot, returns the gesture recognised (score in "score") or 0
+static ID cm_native_event(connman *conn, const wii_event *ev, float *score) {
+  if(conn->smooth) smooth_update(&(conn->smooth[ev->slot]), ev);
+  if(conn->history) history_push(&(conn->history[ev->slot]), ev);
+  if(conn->tracks) track_update(&(conn->tracks[ev->slot]), ev);
+  if(conn->calib) calib_update(&(conn->calib[ev->slot]), ev);
+  if(conn->fusion) fusion_update(&(conn->fusion[ev->slot]), ev);
+  if(!(conn->gestures)) return 0;
+  return gesture_update(&(conn->gestures[ev->slot]), ev, score);
+}
+
+//frees the histories of the slots of "conn"
+static void cm_free_history(connman *conn) {
+  int i;
+  if(!(conn->history)) return;
+  for(i = 0; i < conn->n; i++) free(conn->history[i].buf);
+  free(conn->history);
+  conn->history = NULL;
+}
+
+//yields the event "ev" of a Wiimote in a poll, and the gesture it ends
+static void cm_poll_event(connman *conn, wii_event *ev) {
+  wii_event gev;
+  float score;
+  ID gesture = cm_native_event(conn, ev, &score);
+  if(filter_pass(conn, ev)) cm_yield_event(conn, ev);
+  else cm_track_event(conn, ev);
+  if(gesture && conn->wms) {
+    gev = *ev;
+    gev.type = WII_EVENT_GESTURE;
+    if(filter_pass(conn, &gev))
+      rb_yield(rb_ary_new3(5, conn->slots[ev->slot], sym_gesture, ULL2NUM(ev->ts), ID2SYM(gesture), rb_float_new(score)));
+  }
+}
+
+//appends the event "ev" to the drain buffer "str" if it passes the subscriptions
+static void cm_drain_filtered(VALUE str, connman *conn, wii_event *ev) {
+  float score;
+  cm_native_event(conn, ev, &score);
+  if(filter_pass(conn, ev)) cm_drain_event(str, conn, ev);
+  else cm_track_event(conn, ev);
+}
+
+//waits for the claimed poller of "conn" to end, run without the GVL
+static void * cm_poller_join_nogvl(void * ptr) {
+  poller_join((connman *) ptr);
+  return NULL;
+}
+
+static VALUE cm_poller_join(VALUE ptr) {
+  wii_without_gvl(cm_poller_join_nogvl, (void *) ptr, NULL, NULL);
+  return Qnil;
+}
+
+//frees the rings under the GVL, where no poll or drain can be reading them, even if an interrupt is raised
+static VALUE cm_poller_free(VALUE ptr) {
+  poller_free((connman *) ptr);
+  return Qnil;
+}
+
+//stops the background poller of "conn", returns 0 if it was not running. Only one thread joins it,
+//the others wait until it is stopped
+static int cm_poller_stop(connman *conn) {
+  struct timeval wait = { 0, 1000 };
+  if(poller_claim(conn)) {
+    rb_ensure(cm_poller_join, (VALUE) conn, cm_poller_free, (VALUE) conn);
+    return 1;
+  }
+  while(__atomic_load_n(&conn->poller_running, __ATOMIC_ACQUIRE) == POLLER_STOPPING)
+    rb_thread_wait_for(wait);
+  return 0;
+}
+
+//marks the Wiimote objects of the slot table
+static void mark_connman(void * ptr) {
+  connman *conn = (connman *) ptr;
+  int i;
+  if(!(conn->slots)) return;
+  for(i = 0; i < conn->n; i++)
+    rb_gc_mark(conn->slots[i]);
+}
+
+//frees a connman when its WiimoteManager is garbage collected
+static void free_connman(void * ptr) {
+  connman *conn = (connman *) ptr;
+  poller_stop(conn);
+  capture_close(conn);
+  pthread_mutex_destroy(&(conn->capture_lock));
+  if(conn->wms) {
+    effects_cancel_all(conn->wms, conn->n);
+    speakers_stop_all(conn->wms, conn->n);
+  }
+  //the effects and speaker threads no longer use io_lock
+  pthread_mutex_destroy(&(conn->io_lock));
+  if(conn->source) {
+    conn->source->cleanup(conn);
+    free(conn->source);
+  }
+  free(conn->slots);
+  free(conn->state);
+  free(conn->latency);
+  free(conn->filters);
+  free(conn->filter_accel);
+  free(conn->gestures);
+  free(conn->fusion);
+  free(conn->smooth);
+  cm_free_history(conn);
+  free(conn->tracks);
+  free(conn->calib);
+  free(conn);
+}
+
+VALUE cm_alloc(VALUE klass, int max, wii_source *source) {
   connman * conn;
-  VALUE m = rb_const_get(wii_mod, rb_intern("MAX_WIIMOTES"));
-  int max = NUM2INT(m);
-  VALUE obj = Data_Make_Struct(self, connman, NULL, free, conn);
+  int i;
+  VALUE obj = Data_Make_Struct(klass, connman, mark_connman, free_connman, conn);
   if(!conn) rb_raise(gen_exp_class, "not enough memory");
+  conn->source = source;
+  pthread_mutex_init(&(conn->capture_lock), NULL);
+  pthread_mutex_init(&(conn->io_lock), NULL);
+  conn->slots = malloc(max * sizeof(VALUE));
+  if(!(conn->slots)) rb_raise(gen_exp_class, "not enough memory");
+  for(i = 0; i < max; i++) conn->slots[i] = Qnil;
+  conn->n = max;
+  conn->state = calloc(max, sizeof(wii_event));
+  if(!(conn->state)) rb_raise(gen_exp_class, "not enough memory");
+  for(i = 0; i < max; i++) conn->state[i].slot = (uint8_t) i;
+  conn->latency = calloc(max, sizeof(wii_latency));
+  if(!(conn->latency)) rb_raise(gen_exp_class, "not enough memory");
+  return obj;
+}
+
+VALUE cm_attach(VALUE manager, int slot) {
+  connman *conn;
+  VALUE wm, exp = Qnil;
+  Data_Get_Struct(manager, connman, conn);
+  //the structures of a source are not bluetooth devices, there is nothing to disconnect
+  wm = Data_Wrap_Struct(wii_class, NULL, conn->source ? NULL : free_wiimote, conn->wms[slot]);
+  rb_obj_call_init(wm, 0, 0);
+  switch(conn->wms[slot]->exp.type) {
+    case EXP_NUNCHUK:
+      exp = Data_Wrap_Struct(nun_class, NULL, NULL, &(conn->wms[slot]->exp.nunchuk));
+      break;
+    case EXP_CLASSIC:
+      exp = Data_Wrap_Struct(cc_class, NULL, NULL, &(conn->wms[slot]->exp.classic));
+      break;
+    case EXP_GUITAR_HERO_3:
+      exp = Data_Wrap_Struct(gh3_class, NULL, NULL, &(conn->wms[slot]->exp.gh3));
+      break;
+  }
+  set_expansion(wm, exp);
+  conn->slots[slot] = wm;
+  rb_ary_push(rb_ivar_get(manager, id_wiimotes), wm);
+  rb_ivar_set(wm, id_manager, manager);
+  return wm;
+}
+
+connman * cm_of(VALUE wiimote, int *slot) {
+  VALUE manager = rb_attr_get(wiimote, id_manager);
+  connman *conn;
+  int i;
+  if(NIL_P(manager) || !DATA_PTR(wiimote)) return NULL;
+  Data_Get_Struct(manager, connman, conn);
+  if(!conn || !(conn->wms)) return NULL;
+  for(i = 0; i < conn->n; i++) {
+    if(conn->wms[i] == DATA_PTR(wiimote)) {
+      *slot = i;
+      return conn;
+    }
+  }
+  return NULL;
+}
+
+pthread_mutex_t * cm_io_lock(VALUE wiimote) {
+  int slot;
+  connman *conn = cm_of(wiimote, &slot);
+  return conn ? &(conn->io_lock) : NULL;
+}
+
+static VALUE rb_cm_new(int argc, VALUE * argv, VALUE self) {
+  connman * conn;
+  int max = WII4R_MAX_WIIMOTES;
+  VALUE opts, capacity = Qnil;
+  rb_scan_args(argc, argv, "01", &opts);
+  if(TYPE(opts) == T_HASH) capacity = rb_hash_aref(opts, sym_capacity);
+  else if(!NIL_P(opts)) capacity = opts;
+  if(!NIL_P(capacity)) max = NUM2INT(capacity);
+  if(max < 1 || max > 255) rb_raise(rb_eArgError, "capacity must be between 1 and 255");
+  VALUE obj = cm_alloc(self, max, NULL);
+  Data_Get_Struct(obj, connman, conn);
   conn->wms = wiiuse_init(max);
-  conn->n = max; 
-  rb_obj_call_init(obj, 0, 0);
+  if(!(conn->wms)) rb_raise(gen_exp_class, "not enough memory");
+  rb_obj_call_init(obj, argc, argv);
   return obj;
 }
 
 /* 
  *  call-seq:
- *	WiimoteManager.new
+ *	WiimoteManager.new				-> manager
+ *	WiimoteManager.new(capacity: n)	-> manager
+ *
+ *  Returns a new empty WiimoteManager that can handle up to <i>n</i> wiimotes (default MAX_WIIMOTES).
+ *  Every manager has its own capacity, so more managers can be used to handle large numbers of wiimotes.
  *
- *  Returns a new empty WiimoteManager.
+ *	party = WiimoteManager.new(capacity: 8)
  */
  
-static VALUE rb_cm_init(VALUE self) {
+static VALUE rb_cm_init(int argc, VALUE * argv, VALUE self) {
   VALUE ary = rb_ary_new();
-  rb_iv_set(self, "@wiimotes", ary);
+  rb_ivar_set(self, id_wiimotes, ary);
   return self;
 }
 
@@ -62,9 +391,23 @@ static VALUE rb_cm_init(VALUE self) {
  */
 
 static VALUE rb_cm_connected(VALUE self) {
-  VALUE wm = rb_iv_get(self, "@wiimotes");
-  VALUE size = rb_funcall(wm, rb_intern("size"), 0, NULL);
-  return size;
+  VALUE wm = rb_ivar_get(self, id_wiimotes);
+  return LONG2NUM(RARRAY_LEN(wm));
+}
+
+/*
+ *  call-seq:
+ *	manager.capacity	-> int
+ *
+ *  Returns the maximum number of wiimotes that <i>self</i> can handle.
+ *
+ */
+
+static VALUE rb_cm_capacity(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) return INT2NUM(0);
+  return INT2NUM(conn->n);
 }
 
 /*
@@ -77,13 +420,36 @@ static VALUE rb_cm_connected(VALUE self) {
 
 static VALUE rb_cm_cleanup(VALUE self) {
   connman * conn;
+  int i;
   Data_Get_Struct(self, connman, conn);
   if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do cleanup");
   if(!(conn->wms)) return Qnil;
-  wiiuse_cleanup(conn->wms, conn->n);
+  if(conn->polling) rb_raise(gen_exp_class, "WiimoteManager is polling, cannot do cleanup");
+  cm_poller_stop(conn);
+  //another thread may have cleaned up while this one was waiting for the poller
+  if(!(conn->wms)) return Qnil;
+  capture_close(conn);
+  effects_cancel_all(conn->wms, conn->n);
+  speakers_stop_all(conn->wms, conn->n);
+  //the Wiimote objects outliving the manager no longer point to the wiimotes
+  VALUE ary = rb_ivar_get(self, id_wiimotes);
+  for(i = 0; i < RARRAY_LEN(ary); i++) DATA_PTR(rb_ary_entry(ary, i)) = NULL;
+  if(conn->source) conn->source->cleanup(conn);
+  else wiiuse_cleanup(conn->wms, conn->n);
   conn->wms = NULL;
-  VALUE ary = rb_iv_get(self, "@wiimotes");
-  rb_funcall(ary, rb_intern("clear"), 0, NULL);
+  free(conn->gestures);
+  conn->gestures = NULL;
+  free(conn->fusion);
+  conn->fusion = NULL;
+  free(conn->smooth);
+  conn->smooth = NULL;
+  cm_free_history(conn);
+  free(conn->tracks);
+  conn->tracks = NULL;
+  free(conn->calib);
+  conn->calib = NULL;
+  for(i = 0; i < conn->n; i++) conn->slots[i] = Qnil;
+  rb_ary_clear(ary);
   return Qnil;
 }
 
@@ -99,10 +465,27 @@ static VALUE rb_cm_cleanup(VALUE self) {
  */
 
 static VALUE rb_cm_wiimotes(VALUE self) {
-  VALUE wii = rb_iv_get(self, "@wiimotes");
+  VALUE wii = rb_ivar_get(self, id_wiimotes);
   return wii;
 }
 
+/*
+ *  call-seq:
+ *	manager[slot]	-> wiimote or nil
+ *
+ *  Returns the Wiimote connected in the slot <i>slot</i> of <i>self</i>, nil if the slot is empty.
+ *  The slot of a wiimote is the one reported by <code>drain</code>.
+ *
+ */
+
+static VALUE rb_cm_slot(VALUE self, VALUE arg) {
+  connman *conn;
+  int slot = NUM2INT(arg);
+  Data_Get_Struct(self, connman, conn);
+  if(!conn || slot < 0 || slot >= conn->n) return Qnil;
+  return conn->slots[slot];
+}
+
 /*
  *  call-seq:
  *	manager.found	-> int
@@ -115,9 +498,8 @@ static VALUE rb_cm_found(VALUE self) {
   connman * conn;
   Data_Get_Struct(self, connman, conn);
   if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do found");
-  VALUE timeout = rb_const_get(wii_mod, rb_intern("TIMEOUT"));
-  VALUE max = rb_const_get(wii_mod, rb_intern("MAX_WIIMOTES"));
-  int found = wiiuse_find(conn->wms, NUM2INT(max), NUM2INT(timeout));
+  if(conn->polling || conn->poller_running) rb_raise(gen_exp_class, "WiimoteManager is polling, cannot do found");
+  int found = wiiuse_find(conn->wms, conn->n, WII4R_TIMEOUT);
   return INT2NUM(found);
 }
 
@@ -133,18 +515,16 @@ static VALUE rb_cm_connect(VALUE self) {
   connman *conn;
   Data_Get_Struct(self, connman, conn);
   if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do connect");
+  if(conn->polling || conn->poller_running) rb_raise(gen_exp_class, "WiimoteManager is polling, cannot do connect");
   
   int i = 0, led = 1, connected = 0, found = 0;
-  VALUE wm = Qnil, exp = Qnil;
-  VALUE max = rb_const_get(wii_mod, rb_intern("MAX_WIIMOTES"));
-  VALUE timeout = rb_const_get(wii_mod, rb_intern("TIMEOUT"));
   
-  found = wiiuse_find(conn->wms, NUM2INT(max), NUM2INT(timeout));
+  found = wiiuse_find(conn->wms, conn->n, WII4R_TIMEOUT);
   if(!found) return INT2NUM(0); 
-  connected = wiiuse_connect(conn->wms, NUM2INT(max));
+  connected = wiiuse_connect(conn->wms, conn->n);
 
-  for(; i < NUM2INT(max); i++) {
-    if(wm_connected(conn->wms[i])) {
+  for(; i < conn->n; i++) {
+    if(wm_connected(conn->wms[i]) && NIL_P(conn->slots[i])) {
       switch(led) {
         case 1:
           wiiuse_set_leds(conn->wms[i], WIIMOTE_LED_1);
@@ -162,21 +542,7 @@ static VALUE rb_cm_connect(VALUE self) {
           wiiuse_set_leds(conn->wms[i], WIIMOTE_LED_4);
           break;  
       }
-      wm = Data_Wrap_Struct(wii_class, NULL, free_wiimote, conn->wms[i]);
-      rb_obj_call_init(wm, 0, 0);
-      switch(conn->wms[i]->exp.type) {
-        case EXP_NUNCHUK:
-          exp = Data_Wrap_Struct(nun_class, NULL, NULL, &(conn->wms[i]->exp.nunchuk));
-          break;
-        case EXP_CLASSIC:
-          exp = Data_Wrap_Struct(cc_class, NULL, NULL, &(conn->wms[i]->exp.classic));
-          break;
-        case EXP_GUITAR_HERO_3:
-          exp = Data_Wrap_Struct(gh3_class, NULL, NULL, &(conn->wms[i]->exp.gh3));
-          break;
-      }
-      set_expansion(wm, exp);
-      rb_ary_push(rb_iv_get(self, "@wiimotes"), wm);
+      cm_attach(self, i);
     }
   }
   return INT2NUM(connected);
@@ -185,9 +551,21 @@ static VALUE rb_cm_connect(VALUE self) {
 /*
  *  call-seq:
  *	manager.poll { |(wiimote, event)| block }	-> nil
+ *	manager.poll { |(wiimote, event, time)| block }	-> nil
+ *	manager.poll { |(wiimote, event, time, gesture, score)| block }	-> nil
  *
  *  Invokes <i>block</i> once per event captured by the WiimoteManager class. <code>wiimote</code> is the Wiimote which caused 
  *  the event <code>event</code>, a Symbol who represents the type of the event caused.
+ *  <code>time</code> is the monotonic time (nanoseconds, as <code>Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)</code>)
+ *  at which the report arrived.
+ *  Other ruby threads keep running while the manager waits for the wiimote reports.
+ *  If background polling is active (see <code>start_polling</code>) the events queued by the poller are yielded, oldest first.
+ *  The poller thread keeps updating the wiimotes meanwhile: the getters of <code>wiimote</code> (<code>buttons</code>,
+ *  <code>acceleration</code>, <code>ir</code>, the expansion ones, ...) may then mix two reports, none of them the one
+ *  yielded. Only <code>Wiimote#snapshot</code> and <code>drain</code> read consistent values while the poller runs.
+ *  Only the events matching a subscription are yielded, if there is any (see <code>subscribe</code>).
+ *  A wiimote with a GestureSet (see <code>Wiimote#gestures=</code>) yields a :gesture event, with the name of the gesture
+ *  and its score, right after the report which ended it.
  *
  *	wm.poll { |(wiimote, event)|
  *		if event == :generic
@@ -198,87 +576,464 @@ static VALUE rb_cm_connect(VALUE self) {
 
 static VALUE rb_cm_poll(VALUE self) {
   if(rb_block_given_p()) {
-    VALUE connected = rb_funcall(self, rb_intern("connected"), 0, NULL);
+    connman *conn;
+    int i = 0;
+    wii_event ev;
+    Data_Get_Struct(self, connman, conn);
+    if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do poll");
+    if(!(conn->wms)) return Qnil;
     
-    if(NUM2INT(connected) > 0) {
-      connman *conn;
-      Data_Get_Struct(self, connman, conn);
-      if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do poll");
-      
-      VALUE wiimotes = rb_iv_get(self, "@wiimotes");
-      
-      int i = 0;
-      VALUE ary = Qnil, wm = Qnil, event_name = Qnil, exp = Qnil;
-      VALUE argv[1];
-      wiimote * wmm;
-      
-      VALUE max = rb_const_get(wii_mod, rb_intern("MAX_WIIMOTES"));
-      if(wiiuse_poll(conn->wms, NUM2INT(max))) {
-        for(; i < NUM2INT(connected); i++) {
-          argv[0] = INT2NUM(i);
-          wm = rb_ary_aref(1, argv, wiimotes);
-          Data_Get_Struct(wm, wiimote, wmm);
-
-          if(wmm && wmm->event != WIIUSE_NONE) {
-            ary = rb_ary_new();
-            rb_ary_push(ary, wm);
-            switch(wmm->event) {
-              case WIIUSE_EVENT:
-                event_name = ID2SYM(rb_intern("generic"));
-                break;
-              case WIIUSE_STATUS:
-                event_name = ID2SYM(rb_intern("status"));
-                break;
-              case WIIUSE_DISCONNECT:
-                event_name = ID2SYM(rb_intern("disconnected"));
-                break;
-              case WIIUSE_UNEXPECTED_DISCONNECT:
-                event_name = ID2SYM(rb_intern("unexpected_disconnect"));
-                break;
-              case WIIUSE_READ_DATA:
-                event_name = ID2SYM(rb_intern("read"));
-                break;
-              case WIIUSE_NUNCHUK_INSERTED:
-                event_name = ID2SYM(rb_intern("nunchuk_inserted"));
-                exp = Data_Wrap_Struct(nun_class, NULL, NULL, &(wmm->exp.nunchuk));
-                set_expansion(wm, exp);
-                break;
-              case WIIUSE_NUNCHUK_REMOVED:
-                event_name = ID2SYM(rb_intern("nunchuk_removed"));
-                set_expansion(wm, Qnil);
-                break;
-              case WIIUSE_CLASSIC_CTRL_INSERTED:
-                event_name = ID2SYM(rb_intern("classic_inserted"));
-                exp = Data_Wrap_Struct(cc_class, NULL, NULL, &(wmm->exp.classic));
-                set_expansion(wm, exp);
-                break;
-              case WIIUSE_CLASSIC_CTRL_REMOVED:
-                event_name = ID2SYM(rb_intern("classic_removed"));
-                set_expansion(wm, Qnil);
-                break;
-              case WIIUSE_GUITAR_HERO_3_CTRL_INSERTED:
-                event_name = ID2SYM(rb_intern("guitarhero3_inserted"));
-                exp = Data_Wrap_Struct(gh3_class, NULL, NULL, &(wmm->exp.gh3));
-                set_expansion(wm, exp);
-                break;
-              case WIIUSE_GUITAR_HERO_3_CTRL_REMOVED:
-                event_name = ID2SYM(rb_intern("guitarhero3_removed"));
-                set_expansion(wm, Qnil);
-                break;
-              case WIIUSE_CONNECT:
-                event_name = ID2SYM(rb_intern("connected"));
-                break;
-            }
-            rb_ary_push(ary, event_name);
-            rb_yield(ary);
-          }
+    if(conn->rings) {
+      for(; i < conn->n; i++) {
+        while(conn->rings && ring_pop(&(conn->rings[i]), &ev)) {
+          if(!NIL_P(conn->slots[i])) cm_poll_event(conn, &ev);
         }
       }
     }
+    else if(cm_wiiuse_poll(conn)) {
+      for(; i < conn->n && conn->wms; i++) {
+        if(!NIL_P(conn->slots[i]) && conn->wms[i]->event != WIIUSE_NONE)
+          cm_poll_event(conn, &(conn->state[i]));
+      }
+    }
   }
   return Qnil;
 }
 
+/*
+ *  call-seq:
+ *	manager.drain	-> string
+ *
+ *  Returns all the pending events of the wiimotes managed by <i>self</i> packed in a single binary String,
+ *  without creating any other ruby object. If background polling is active the queued events are returned,
+ *  otherwise the wiimotes are polled once. The string is empty if there are no events.
+ *  Only the events matching a subscription are returned, if there is any (see <code>subscribe</code>).
+ *  Gestures are recognised but not returned: see <code>Wiimote#last_gesture</code>.
+ *
+ *  Every event is a record of <code>EVENT_SIZE</code> (128) bytes, in native byte order, that can be
+ *  decoded with <code>unpack(EVENT_FORMAT)</code>:
+ *	timestamp		Q	monotonic arrival time in nanoseconds
+ *	slot, event, exp, flags	C4	slot of the wiimote (see <code>[]</code>), event code (EVENT_* constants),
+ *					expansion (EXP_* constants), 1 = motion sensing, 2 = ir, 4 = expansion
+ *	buttons			S3	pressed, held, released
+ *	expansion buttons	S3	pressed, held, released
+ *	acceleration		C3	x, y, z
+ *	nunchuk acceleration	C3	x, y, z
+ *	ir dots			C	bitmask of the visible ir sources
+ *	gravity force		f3	x, y, z
+ *	orientation		f3	roll, pitch, yaw
+ *	position		s2	x, y
+ *	ir sources		S8	x, y of the 4 sources
+ *	distance		f
+ *	nunchuk gravity force	f3	x, y, z
+ *	nunchuk orientation	f2	roll, pitch
+ *	joysticks		f4	angle, magnitude (left and right joystick)
+ *	analog			f2	shoulders or whammy bar
+ *	absolute position	s2	x, y
+ *
+ *	events = wm.drain
+ *	events.unpack("#{WiimoteManager::EVENT_FORMAT}" * (events.bytesize / WiimoteManager::EVENT_SIZE))
+ */
+
+static VALUE rb_cm_drain(VALUE self) {
+  connman *conn;
+  VALUE str;
+  wii_event ev;
+  int i;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do drain");
+
+  str = rb_str_buf_new(sizeof(wii_event) * conn->n);
+  if(!(conn->wms)) return str;
+
+  if(conn->rings) {
+    for(i = 0; i < conn->n; i++) {
+      while(conn->rings && ring_pop(&(conn->rings[i]), &ev))
+        cm_drain_filtered(str, conn, &ev);
+    }
+  }
+  else if(cm_wiiuse_poll(conn)) {
+    for(i = 0; i < conn->n; i++) {
+      if(conn->wms[i]->event != WIIUSE_NONE)
+        cm_drain_filtered(str, conn, &(conn->state[i]));
+    }
+  }
+  return str;
+}
+
+/*
+ *  call-seq:
+ *	manager.state_buffer	-> state_buffer
+ *
+ *  Returns the StateBuffer holding the last state of every wiimote managed by <i>self</i>,
+ *  refreshed in native memory on every poll.
+ *
+ */
+
+static VALUE rb_cm_state_buffer(VALUE self) {
+  VALUE buf = rb_attr_get(self, id_state_buffer);
+  if(NIL_P(buf)) {
+    buf = state_buffer_new(self);
+    rb_ivar_set(self, id_state_buffer, buf);
+  }
+  return buf;
+}
+
+/*
+ *  call-seq:
+ *	manager.record(path)	-> true
+ *
+ *  Starts writing every event polled by <i>self</i> (also by the background poller) in the capture file <i>path</i>,
+ *  which can be played back by a ReplayManager. The file starts with a 16 bytes header:
+ *	magic		a8	"WII4RCAP"
+ *	version		S	1
+ *	record size	S	EVENT_SIZE
+ *	capacity	S	capacity of the manager
+ *	reserved	S
+ *  followed by one record per event, in the format of <code>drain</code>. All the values are in native byte order.
+ *  A file already recording is closed first.
+ *
+ *	wm.record("session.cap")
+ *	1000.times { wm.poll { |(wiimote, event)| ... } }
+ *	wm.stop_recording	#=> 2000
+ */
+
+static VALUE rb_cm_record(VALUE self, VALUE path) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do record");
+  FilePathValue(path);
+  capture_close(conn);
+  if(!capture_open(conn, StringValueCStr(path))) rb_sys_fail(StringValueCStr(path));
+  return Qtrue;
+}
+
+/*
+ *  call-seq:
+ *	manager.stop_recording	-> int or nil
+ *
+ *  Closes the capture file opened by <code>record</code> and returns the number of events written,
+ *  nil if <i>self</i> was not recording.
+ *
+ */
+
+static VALUE rb_cm_stop_recording(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn || !(conn->capture)) return Qnil;
+  return ULONG2NUM(capture_close(conn));
+}
+
+/*
+ *  call-seq:
+ *	manager.recording?	-> true or false
+ *
+ *  Returns true if the events of <i>self</i> are being written in a capture file.
+ *
+ */
+
+static VALUE rb_cm_recording(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) return Qfalse;
+  return conn->capture ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	manager.start_polling			-> true or false
+ *	manager.start_polling(queue_size)	-> true or false
+ *
+ *  Starts a native thread that polls the wiimotes managed by <i>self</i> continuously, at the full report rate.
+ *  The events are kept in a queue of <i>queue_size</i> events (default 256) for each wiimote until
+ *  <code>poll</code> is called. Returns false if the poller is already running.
+ *  While it runs the Wiimote getters read the reports as the thread writes them: use <code>Wiimote#snapshot</code>
+ *  or <code>drain</code> to read the state of a wiimote (see <code>poll</code>).
+ *
+ *	wm.start_polling
+ *	loop {
+ *		wm.poll { |(wiimote, event)| state = wiimote.snapshot ... }
+ *		do_something_slow
+ *	}
+ */
+
+static VALUE rb_cm_start_polling(int argc, VALUE * argv, VALUE self) {
+  connman *conn;
+  VALUE size;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do start_polling");
+  if(!(conn->wms)) rb_raise(gen_exp_class, "WiimoteManager already cleaned up, cannot do start_polling");
+  rb_scan_args(argc, argv, "01", &size);
+  if(conn->poller_running) return Qfalse;
+  if(conn->polling) rb_raise(gen_exp_class, "WiimoteManager is polling in another thread, cannot do start_polling");
+  if(!poller_start(conn, NIL_P(size) ? 256 : NUM2INT(size)))
+    rb_raise(gen_exp_class, "cannot start the poller thread");
+  return Qtrue;
+}
+
+/*
+ *  call-seq:
+ *	manager.stop_polling	-> true or false
+ *
+ *  Stops the background poller of <i>self</i> and discards the events not yet polled.
+ *  Returns false if the poller was not running.
+ *
+ */
+
+static VALUE rb_cm_stop_polling(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do stop_polling");
+  return cm_poller_stop(conn) ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	manager.polling?	-> true or false
+ *
+ *  Returns true if the background poller of <i>self</i> is running.
+ *
+ */
+
+static VALUE rb_cm_polling(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) return Qfalse;
+  return conn->poller_running == POLLER_RUNNING ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	manager.dropped_events	-> int
+ *
+ *  Returns the number of events discarded by the background poller because the queue of a wiimote was full.
+ *
+ */
+
+static VALUE rb_cm_dropped(VALUE self) {
+  connman *conn;
+  unsigned long dropped = 0;
+  int i;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn || !(conn->rings)) return INT2NUM(0);
+  for(i = 0; i < conn->n; i++)
+    dropped += __atomic_load_n(&(conn->rings[i].dropped), __ATOMIC_RELAXED);
+  return ULONG2NUM(dropped);
+}
+
+//WIIUSE_EVENT_TYPE of the event symbol "sym" (as yielded by poll)
+static int cm_event_type(VALUE sym) {
+  if(sym == sym_generic) return WIIUSE_EVENT;
+  if(sym == sym_status) return WIIUSE_STATUS;
+  if(sym == sym_connected) return WIIUSE_CONNECT;
+  if(sym == sym_disconnected) return WIIUSE_DISCONNECT;
+  if(sym == sym_unexpected_disconnect) return WIIUSE_UNEXPECTED_DISCONNECT;
+  if(sym == sym_read) return WIIUSE_READ_DATA;
+  if(sym == sym_nunchuk_inserted) return WIIUSE_NUNCHUK_INSERTED;
+  if(sym == sym_nunchuk_removed) return WIIUSE_NUNCHUK_REMOVED;
+  if(sym == sym_classic_inserted) return WIIUSE_CLASSIC_CTRL_INSERTED;
+  if(sym == sym_classic_removed) return WIIUSE_CLASSIC_CTRL_REMOVED;
+  if(sym == sym_gh3_inserted) return WIIUSE_GUITAR_HERO_3_CTRL_INSERTED;
+  if(sym == sym_gh3_removed) return WIIUSE_GUITAR_HERO_3_CTRL_REMOVED;
+  if(sym == sym_gesture) return WII_EVENT_GESTURE;
+  rb_raise(rb_eArgError, "unknown event %s", RSTRING_PTR(rb_inspect(sym)));
+  return WIIUSE_NONE;
+}
+
+/*
+ *  call-seq:
+ *	manager.subscribe(slot: n, events: [event, ...], buttons: mask, min_accel_delta: d)	-> int
+ *
+ *  Adds a subscription to <i>self</i> and returns its id (see <code>unsubscribe</code>). Once there is a subscription,
+ *  <code>poll</code> and <code>drain</code> skip, without creating any ruby object, the events which match none.
+ *  Every option can be omitted (it matches anything):
+ *  - <i>slot</i>: only the events of the wiimote in that slot (see <code>[]</code>)
+ *  - <i>events</i>: only these events (a Symbol or an Array of the Symbols yielded by <code>poll</code>, :gesture included)
+ *  - <i>buttons</i>: only the :generic events in which one of these buttons (BUTTON_* constants, or'ed) was
+ *    just pressed or released
+ *  - <i>min_accel_delta</i>: only the :generic events in which the acceleration of an axis changed at least this much
+ *    since the last event of the wiimote that was not skipped
+ *  A :generic event matching either <i>buttons</i> or <i>min_accel_delta</i>, when both are given, matches.
+ *  Expansions inserted or removed are tracked even if their events are skipped.
+ *
+ *	wm.subscribe(slot: 0, buttons: BUTTON_A | BUTTON_B)
+ *	wm.subscribe(events: [:disconnected, :unexpected_disconnect])
+ */
+
+static VALUE rb_cm_subscribe(int argc, VALUE * argv, VALUE self) {
+  connman *conn;
+  wii_filter filter;
+  VALUE opts, slot = Qnil, events = Qnil, buttons = Qnil, delta = Qnil;
+  long i;
+  int id;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do subscribe");
+  rb_scan_args(argc, argv, "01", &opts);
+  if(!NIL_P(opts)) {
+    Check_Type(opts, T_HASH);
+    slot = rb_hash_aref(opts, sym_slot);
+    events = rb_hash_aref(opts, sym_events);
+    buttons = rb_hash_aref(opts, sym_buttons);
+    delta = rb_hash_aref(opts, sym_min_accel_delta);
+  }
+  memset(&filter, 0, sizeof(wii_filter));
+  filter.slot = NIL_P(slot) ? -1 : NUM2INT(slot);
+  if(filter.slot < -1 || filter.slot >= conn->n) rb_raise(rb_eArgError, "slot must be between 0 and %d", conn->n - 1);
+  if(NIL_P(events)) filter.events = ~0U;
+  else if(SYMBOL_P(events)) filter.events = 1U << cm_event_type(events);
+  else {
+    Check_Type(events, T_ARRAY);
+    for(i = 0; i < RARRAY_LEN(events); i++)
+      filter.events |= 1U << cm_event_type(rb_ary_entry(events, i));
+  }
+  filter.buttons = NIL_P(buttons) ? 0 : (uint16_t) NUM2INT(buttons);
+  filter.accel_delta = NIL_P(delta) ? 0 : NUM2INT(delta);
+  if(filter.accel_delta < 0) rb_raise(rb_eArgError, "min_accel_delta must not be negative");
+  id = filter_add(conn, &filter);
+  if(!id) rb_raise(gen_exp_class, "not enough memory");
+  return INT2NUM(id);
+}
+
+/*
+ *  call-seq:
+ *	manager.unsubscribe(id)	-> true or false
+ *
+ *  Removes the subscription <i>id</i> (returned by <code>subscribe</code>), returns false if there was none.
+ *  Without subscriptions every event is yielded again.
+ *
+ */
+
+static VALUE rb_cm_unsubscribe(VALUE self, VALUE id) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do unsubscribe");
+  return filter_remove(conn, NUM2INT(id)) ? Qtrue : Qfalse;
+}
+
+/*
+ *  call-seq:
+ *	manager.subscriptions	-> array
+ *
+ *  Returns the ids of the subscriptions of <i>self</i> (see <code>subscribe</code>).
+ *
+ */
+
+static VALUE rb_cm_subscriptions(VALUE self) {
+  connman *conn;
+  VALUE ary;
+  int i;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) return rb_ary_new();
+  ary = rb_ary_new2(conn->nfilters);
+  for(i = 0; i < conn->nfilters; i++)
+    rb_ary_push(ary, INT2NUM(conn->filters[i].id));
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *	manager.filtered_events	-> int
+ *
+ *  Returns the number of events skipped because they matched no subscription (see <code>subscribe</code>).
+ *
+ */
+
+static VALUE rb_cm_filtered(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) return INT2NUM(0);
+  return ULONG2NUM(conn->filtered);
+}
+
+//upper bound (ns) of the "p" percentile of the "count" latencies counted in "buckets"
+static uint64_t cm_percentile(const uint64_t *buckets, uint64_t count, double p) {
+  uint64_t seen = 0, rank = (uint64_t) (count * p);
+  int i;
+  for(i = 0; i < WII_LATENCY_BUCKETS; i++) {
+    seen += buckets[i];
+    if(seen > rank) break;
+  }
+  if(i == WII_LATENCY_BUCKETS) i--;
+  return 1000ULL << i;
+}
+
+static VALUE cm_latency_hash(const latency_hist *hist) {
+  uint64_t buckets[WII_LATENCY_BUCKETS], count, sum, max;
+  VALUE h = rb_hash_new(), ary = rb_ary_new2(WII_LATENCY_BUCKETS);
+  int i;
+  count = __atomic_load_n(&(hist->count), __ATOMIC_ACQUIRE);
+  sum = __atomic_load_n(&(hist->sum), __ATOMIC_RELAXED);
+  max = __atomic_load_n(&(hist->max), __ATOMIC_RELAXED);
+  for(i = 0; i < WII_LATENCY_BUCKETS; i++) {
+    buckets[i] = __atomic_load_n(&(hist->buckets[i]), __ATOMIC_RELAXED);
+    rb_ary_push(ary, ULL2NUM(buckets[i]));
+  }
+  rb_hash_aset(h, sym_count, ULL2NUM(count));
+  rb_hash_aset(h, sym_mean, ULL2NUM(count ? sum / count : 0));
+  rb_hash_aset(h, sym_max, ULL2NUM(max));
+  rb_hash_aset(h, sym_p50, count ? ULL2NUM(cm_percentile(buckets, count, 0.50)) : Qnil);
+  rb_hash_aset(h, sym_p90, count ? ULL2NUM(cm_percentile(buckets, count, 0.90)) : Qnil);
+  rb_hash_aset(h, sym_p99, count ? ULL2NUM(cm_percentile(buckets, count, 0.99)) : Qnil);
+  rb_hash_aset(h, sym_buckets, ary);
+  return h;
+}
+
+static VALUE cm_latency_slot(connman *conn, int slot) {
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, sym_decode, cm_latency_hash(&(conn->latency[slot].decode)));
+  rb_hash_aset(h, sym_dispatch, cm_latency_hash(&(conn->latency[slot].dispatch)));
+  return h;
+}
+
+/*
+ *  call-seq:
+ *	manager.latency_stats		-> array
+ *	manager.latency_stats(slot)	-> hash
+ *
+ *  Returns the latencies of the events of the wiimote in <i>slot</i>, or an array with the ones of every slot.
+ *  The latencies are measured in nanoseconds from the arrival of the report (when the wiimotes have been read):
+ *	:decode		until the report is decoded in the native state of the wiimote
+ *	:dispatch	until the event is yielded by <code>poll</code> or returned by <code>drain</code>
+ *  Each one is a hash with :count, :mean, :max, :p50, :p90, :p99 and :buckets, the counts of the
+ *  latencies under 1 us, 2 us, 4 us ... 2^31 us. The percentiles are the upper bound of their bucket.
+ *
+ *	wm.latency_stats(0)[:dispatch][:p99]	#=> 64000
+ */
+
+static VALUE rb_cm_latency_stats(int argc, VALUE * argv, VALUE self) {
+  connman *conn;
+  VALUE slot, ary;
+  int i;
+  rb_scan_args(argc, argv, "01", &slot);
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do latency_stats");
+  if(!NIL_P(slot)) {
+    i = NUM2INT(slot);
+    if(i < 0 || i >= conn->n) return Qnil;
+    return cm_latency_slot(conn, i);
+  }
+  ary = rb_ary_new2(conn->n);
+  for(i = 0; i < conn->n; i++)
+    rb_ary_push(ary, cm_latency_slot(conn, i));
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *	manager.reset_latency_stats	-> nil
+ *
+ *  Clears the latencies measured so far. Do it while the background poller is stopped to not lose events.
+ *
+ */
+
+static VALUE rb_cm_reset_latency_stats(VALUE self) {
+  connman *conn;
+  Data_Get_Struct(self, connman, conn);
+  if(!conn) rb_raise(gen_exp_class, "WiimoteManager not properly initialized, cannot do reset_latency_stats");
+  memset(conn->latency, 0, conn->n * sizeof(wii_latency));
+  return Qnil;
+}
+
 /*
  *  call-seq:
  *	manager.each_wiimote { |wiimote| block }	-> nil
@@ -292,18 +1047,11 @@ static VALUE rb_cm_poll(VALUE self) {
 
 static VALUE rb_cm_each(VALUE self) {
   if(rb_block_given_p()) {
-    VALUE connected = rb_funcall(self, rb_intern("connected"), 0, NULL);
-    VALUE wiimotes = rb_iv_get(self, "@wiimotes");
-    VALUE argv[1];
-    VALUE wm;
-    
-    int i = 0;
+    VALUE wiimotes = rb_ivar_get(self, id_wiimotes);
+    long i = 0;
     
-    for(; i < NUM2INT(connected); i++) {
-      argv[0] = INT2NUM(i);
-      wm = rb_ary_aref(1, argv, wiimotes);
-      rb_yield(wm);
-    }
+    for(; i < RARRAY_LEN(wiimotes); i++)
+      rb_yield(rb_ary_entry(wiimotes, i));
   } 
   return Qnil;
 }
@@ -318,18 +1066,14 @@ static VALUE rb_cm_each(VALUE self) {
  */
 
 static VALUE rb_cm_pos(VALUE self) {
-  VALUE wiimotes = rb_iv_get(self, "@wiimotes");
-  VALUE ary = rb_ary_new();
-  VALUE wsize = rb_funcall(wiimotes, rb_intern("size"), 0, NULL);
-  int size = NUM2INT(wsize);
-  short i;
-  VALUE argv[1], wm, pos;
+  VALUE wiimotes = rb_ivar_get(self, id_wiimotes);
+  long i, size = RARRAY_LEN(wiimotes);
+  VALUE ary = rb_ary_new2(size);
+  wiimote *wm;
   
   for(i = 0; i < size; i++) {
-    argv[0] = INT2NUM(i);
-    wm = rb_ary_aref(1, argv, wiimotes);
-    pos = rb_funcall(wm, rb_intern("position"), 0, NULL);
-    rb_ary_push(ary, pos);
+    Data_Get_Struct(rb_ary_entry(wiimotes, i), wiimote, wm);
+    rb_ary_push(ary, wm_position(wm));
   }
   return ary;
 }
@@ -355,15 +1099,65 @@ static VALUE rb_cm_pos(VALUE self) {
   
 void init_wiimotemanager(void) {
   
+  id_wiimotes = rb_intern("@wiimotes");
+  id_state_buffer = rb_intern("@state_buffer");
+  id_manager = rb_intern("@manager");
+  sym_capacity = ID2SYM(rb_intern("capacity"));
+  sym_slot = ID2SYM(rb_intern("slot"));
+  sym_events = ID2SYM(rb_intern("events"));
+  sym_buttons = ID2SYM(rb_intern("buttons"));
+  sym_min_accel_delta = ID2SYM(rb_intern("min_accel_delta"));
+  sym_generic = ID2SYM(rb_intern("generic"));
+  sym_status = ID2SYM(rb_intern("status"));
+  sym_disconnected = ID2SYM(rb_intern("disconnected"));
+  sym_unexpected_disconnect = ID2SYM(rb_intern("unexpected_disconnect"));
+  sym_read = ID2SYM(rb_intern("read"));
+  sym_nunchuk_inserted = ID2SYM(rb_intern("nunchuk_inserted"));
+  sym_nunchuk_removed = ID2SYM(rb_intern("nunchuk_removed"));
+  sym_classic_inserted = ID2SYM(rb_intern("classic_inserted"));
+  sym_classic_removed = ID2SYM(rb_intern("classic_removed"));
+  sym_gh3_inserted = ID2SYM(rb_intern("guitarhero3_inserted"));
+  sym_gh3_removed = ID2SYM(rb_intern("guitarhero3_removed"));
+  sym_gesture = ID2SYM(rb_intern("gesture"));
+  sym_connected = ID2SYM(rb_intern("connected"));
+  sym_decode = ID2SYM(rb_intern("decode"));
+  sym_dispatch = ID2SYM(rb_intern("dispatch"));
+  sym_count = ID2SYM(rb_intern("count"));
+  sym_mean = ID2SYM(rb_intern("mean"));
+  sym_max = ID2SYM(rb_intern("max"));
+  sym_p50 = ID2SYM(rb_intern("p50"));
+  sym_p90 = ID2SYM(rb_intern("p90"));
+  sym_p99 = ID2SYM(rb_intern("p99"));
+  sym_buckets = ID2SYM(rb_intern("buckets"));
+  
   cm_class = rb_define_class_under(wii_mod, "WiimoteManager", rb_cObject);
-  rb_define_singleton_method(cm_class, "new", rb_cm_new, 0);
+  rb_define_const(cm_class, "EVENT_SIZE", INT2NUM(sizeof(wii_event)));
+  rb_define_const(cm_class, "EVENT_FORMAT", rb_obj_freeze(rb_str_new2("QC4S6C7xf6s2S8f12s2")));
+  rb_define_singleton_method(cm_class, "new", rb_cm_new, -1);
   rb_define_method(cm_class, "wiimotes", rb_cm_wiimotes, 0);
-  rb_define_method(cm_class, "initialize", rb_cm_init, 0);
+  rb_define_method(cm_class, "[]", rb_cm_slot, 1);
+  rb_define_method(cm_class, "initialize", rb_cm_init, -1);
   rb_define_method(cm_class, "connected", rb_cm_connected, 0);
+  rb_define_method(cm_class, "capacity", rb_cm_capacity, 0);
   rb_define_method(cm_class, "cleanup!", rb_cm_cleanup, 0);
   rb_define_method(cm_class, "found", rb_cm_found, 0);
   rb_define_method(cm_class, "connect", rb_cm_connect, 0);
   rb_define_method(cm_class, "poll", rb_cm_poll, 0);
+  rb_define_method(cm_class, "drain", rb_cm_drain, 0);
+  rb_define_method(cm_class, "record", rb_cm_record, 1);
+  rb_define_method(cm_class, "stop_recording", rb_cm_stop_recording, 0);
+  rb_define_method(cm_class, "recording?", rb_cm_recording, 0);
+  rb_define_method(cm_class, "state_buffer", rb_cm_state_buffer, 0);
+  rb_define_method(cm_class, "start_polling", rb_cm_start_polling, -1);
+  rb_define_method(cm_class, "stop_polling", rb_cm_stop_polling, 0);
+  rb_define_method(cm_class, "polling?", rb_cm_polling, 0);
+  rb_define_method(cm_class, "dropped_events", rb_cm_dropped, 0);
+  rb_define_method(cm_class, "subscribe", rb_cm_subscribe, -1);
+  rb_define_method(cm_class, "unsubscribe", rb_cm_unsubscribe, 1);
+  rb_define_method(cm_class, "subscriptions", rb_cm_subscriptions, 0);
+  rb_define_method(cm_class, "filtered_events", rb_cm_filtered, 0);
+  rb_define_method(cm_class, "latency_stats", rb_cm_latency_stats, -1);
+  rb_define_method(cm_class, "reset_latency_stats", rb_cm_reset_latency_stats, 0);
   rb_define_method(cm_class, "each_wiimote", rb_cm_each, 0);
   rb_define_method(cm_class, "positions", rb_cm_pos, 0);
 }